@@ -0,0 +1,64 @@
+#pragma once
+#include "CpuFeatures.hpp"
+
+#include <cstdint>
+#include <string>
+
+// What happens to headless frames once they're back on the host
+enum class ReadbackMode
+{
+  Disabled, // Nothing is copied back at all
+  Hash,     // A checksum per frame, see readbackOutputPath
+  Ppm       // Every frame written as a PPM into readbackOutputPath
+};
+
+struct ApplicationSettings
+{
+  // How many frames the CPU may record/submit ahead of the GPU
+  uint32_t framesInFlight = 2;
+
+  // Render into offscreen images with no window, surface or swap chain
+  bool headless = false;
+
+  // Frames to render before exiting in headless mode
+  uint32_t frameCount = 1000;
+
+  // Hash: optional file listing every frame's checksum. Ppm: directory the frames go in, the current one when empty.
+  // Off unless asked for, reading frames back competes with the frame's own work and would skew benchmark fps.
+  ReadbackMode readbackMode = ReadbackMode::Disabled;
+  std::string readbackOutputPath;
+
+  // Where the pipeline cache is loaded from at startup and saved to at shutdown
+  std::string pipelineCachePath = "pipeline.cache";
+
+  // Seconds the animation advances each frame, 0 follows the wall clock. A fixed step makes runs repeatable.
+  float fixedTimeStep = 0.f;
+
+  // Scene size, a grid of quads split evenly across drawCount draw calls
+  uint32_t quadCount = 1;
+  uint32_t drawCount = 1;
+  // Draws come from an indirect buffer in a constant number of calls, otherwise one drawIndexed each
+  bool indirectDraws = true;
+  // Frustum cull draw commands in a compute pass before drawing them, needs indirectDraws
+  bool gpuCulling = true;
+
+  // .lmesh file (see MeshConverter) drawn instead of the grid of quads, and which of its LODs to draw
+  std::string meshPath;
+  uint32_t meshLod = 0;
+  // Reorder the mesh for the vertex cache and vertex fetch before uploading it, converted files already are
+  bool optimizeMesh = false;
+
+  // Copies of the whole scene drawn with instancing, each draw call covers all of them
+  uint32_t instanceCount = 1;
+
+  // Job system threads (including the render thread) used for per-object updates and recording secondary
+  // command buffers, 0 uses one per hardware thread
+  uint32_t jobThreads = 0;
+
+  // Widest SIMD the per-object transform kernels may use, they still drop to whatever the CPU actually has.
+  // Scalar gives the same results on every machine.
+  SimdLevel maxSimdLevel = SimdLevel::Avx2;
+
+  // Chrome trace (JSON) of the profiler's scopes written at exit, nothing is written when empty
+  std::string traceOutputPath;
+};
@@ -0,0 +1,471 @@
+#include "Benchmark.hpp"
+#include "HelloTriangleApplication.hpp"
+#include "JobSystem.hpp"
+#include "TransformBatch.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <algorithm>
+
+std::vector<BenchmarkScene> buildBenchmarkScenes(BenchmarkSettings const &benchmarkSettings)
+{
+  std::vector<BenchmarkScene> scenes;
+  for (uint32_t quadCount : benchmarkSettings.quadCounts)
+  {
+    for (uint32_t drawCount : benchmarkSettings.drawCounts)
+    {
+      if (drawCount > quadCount) continue;
+      for (uint32_t instanceCount : benchmarkSettings.instanceCounts)
+      {
+        if (static_cast<uint64_t>(quadCount) * instanceCount > BenchmarkSettings::MaxQuadsPerFrame) continue;
+        for (uint32_t framesInFlight : benchmarkSettings.framesInFlight)
+        {
+          scenes.push_back({ quadCount, drawCount, instanceCount, framesInFlight });
+        }
+      }
+    }
+  }
+  return scenes;
+}
+
+void runBenchmarks(ApplicationSettings const &baseSettings, BenchmarkSettings const &benchmarkSettings)
+{
+  std::vector<BenchmarkScene> scenes = buildBenchmarkScenes(benchmarkSettings);
+  std::vector<RunStatistics> results;
+
+  ApplicationSettings settings = baseSettings;
+  settings.headless = true;
+  settings.traceOutputPath.clear();
+  // Wall clock time would make the animation, and so the work per frame, differ between runs
+  if (settings.fixedTimeStep <= 0.f) settings.fixedTimeStep = 1.f / 60.f;
+
+  for (size_t i = 0; i < scenes.size(); i++)
+  {
+    std::cout << "Benchmark " << (i + 1) << "/" << scenes.size() << ": "
+              << scenes[i].quadCount << " quads, "
+              << scenes[i].drawCount << " draws, "
+              << scenes[i].instanceCount << " instances, "
+              << scenes[i].framesInFlight << " frames in flight" << std::endl;
+
+    settings.quadCount = scenes[i].quadCount;
+    settings.drawCount = scenes[i].drawCount;
+    settings.instanceCount = scenes[i].instanceCount;
+    settings.framesInFlight = scenes[i].framesInFlight;
+
+    HelloTriangleApplication app(settings);
+    app.run();
+    results.push_back(app.getRunStatistics());
+  }
+
+  if (benchmarkSettings.outputPath == "-")
+  {
+    writeBenchmarkJson(std::cout, settings, scenes, results);
+    return;
+  }
+
+  std::ofstream file(benchmarkSettings.outputPath, std::ios::trunc);
+  if (!file.is_open())
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to open benchmark output file!"), "runBenchmarks");
+  }
+  writeBenchmarkJson(file, settings, scenes, results);
+  std::cout << "Wrote benchmark results to " << benchmarkSettings.outputPath << std::endl;
+}
+
+static void writeStats(std::ostream &out, const char *name, ProfileStats const &stats)
+{
+  out << ",\"" << name << "\":{\"mean\":" << stats.mean
+      << ",\"min\":" << stats.min
+      << ",\"p99\":" << stats.p99
+      << ",\"max\":" << stats.max << "}";
+}
+
+void writeBenchmarkJson(std::ostream &out, ApplicationSettings const &baseSettings, std::vector<BenchmarkScene> const &scenes, std::vector<RunStatistics> const &results)
+{
+  out << std::fixed << std::setprecision(4);
+  out << "{\"frames\":" << baseSettings.frameCount
+      << ",\"fixedTimeStep\":" << baseSettings.fixedTimeStep
+      << ",\"scenes\":[\n";
+
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    RunStatistics const &result = results[i];
+    double framesPerSecond = result.seconds > 0.0 ? result.frames / result.seconds : 0.0;
+
+    out << "{\"quads\":" << scenes[i].quadCount
+        << ",\"draws\":" << result.drawCount
+        << ",\"drawCommands\":" << result.drawCommandCount
+        << ",\"drawCalls\":" << result.drawCallCount
+        << ",\"visibleDrawCommands\":" << result.visibleDrawCommands
+        << ",\"instances\":" << result.instanceCount
+        << ",\"uniformBytesPerFrame\":" << result.uniformBytesPerFrame
+        << ",\"framesInFlight\":" << result.framesInFlight
+        << ",\"vertices\":" << result.vertexCount
+        << ",\"indices\":" << result.indexCount
+        << ",\"vertexBytes\":" << result.vertexBytes
+        << ",\"indexBits\":" << result.indexBits
+        << ",\"subMeshes\":" << result.subMeshCount
+        << ",\"indexBytes\":" << result.indexBytes
+        << ",\"indexBytesSaved\":" << result.indexBytesSaved
+        << ",\"indexBytesSavedPerFrame\":" << result.indexBytesSavedPerFrame
+        << ",\"acmrBefore\":" << result.vertexCacheBefore.acmr
+        << ",\"acmrAfter\":" << result.vertexCacheAfter.acmr
+        << ",\"atvrBefore\":" << result.vertexCacheBefore.atvr
+        << ",\"atvrAfter\":" << result.vertexCacheAfter.atvr
+        << ",\"frames\":" << result.frames
+        << ",\"seconds\":" << result.seconds
+        << ",\"fps\":" << framesPerSecond;
+    writeStats(out, "cpuMsPerFrame", result.cpuFrame);
+    writeStats(out, "waitMsPerFrame", result.waitForFrame);
+    writeStats(out, "gpuMsPerFrame", result.gpuFrame);
+    double readbackSeconds = result.readbackSeconds > 0.0 ? result.readbackSeconds : 1.0;
+    out << ",\"readbackFps\":" << result.readbackFrames / readbackSeconds
+        << ",\"readbackMBps\":" << result.readbackBytes / (1024.0 * 1024.0) / readbackSeconds
+        << ",\"readbackStalls\":" << result.readbackStalls;
+    out << ",\"deviceAllocations\":" << result.deviceAllocations
+        << ",\"subAllocations\":" << result.subAllocations
+        << ",\"descriptorPools\":" << result.descriptorPools
+        << ",\"descriptorSets\":" << result.descriptorSets
+        << ",\"descriptorPoolExhaustions\":" << result.descriptorPoolExhaustions << "}"
+        << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+
+  out << "]}" << std::endl;
+}
+
+struct JobSystemResult
+{
+  uint32_t threads;
+  double spawnNsPerJob;
+  double parallelForMs;
+};
+
+static double secondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Enough arithmetic per item that a batch outweighs the cost of scheduling it
+static float busyWork(uint32_t item)
+{
+  float value = static_cast<float>(item);
+  for (int i = 0; i < 64; i++) value = std::sin(value) * 0.5f + std::cos(value * 0.25f);
+  return value;
+}
+
+static JobSystemResult measureJobSystem(uint32_t threadCount)
+{
+  const uint32_t SpawnJobs = 1 << 18;
+  const uint32_t SpawnRound = 1024; // Stays well under JobSystem::MaxJobsPerThread
+  const uint32_t WorkItems = 1 << 18;
+  const uint32_t WorkBatch = 1024;
+  const int Repeats = 5;
+
+  JobSystem jobSystem;
+  jobSystem.init(threadCount);
+
+  JobSystemResult result = { jobSystem.getThreadCount(), 0.0, 0.0 };
+  std::vector<float> output(WorkItems);
+  double bestSpawn = 0.0;
+  double bestWork = 0.0;
+
+  // Best of several runs, the first also wakes every worker up
+  for (int repeat = 0; repeat < Repeats; repeat++)
+  {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t spawned = 0; spawned < SpawnJobs; spawned += SpawnRound)
+    {
+      JobSystem::Counter counter;
+      for (uint32_t i = 0; i < SpawnRound; i++) jobSystem.run([] {}, &counter);
+      jobSystem.wait(counter);
+    }
+    double spawnSeconds = secondsSince(start);
+    if (repeat == 0 || spawnSeconds < bestSpawn) bestSpawn = spawnSeconds;
+
+    start = std::chrono::high_resolution_clock::now();
+    JobSystem::Counter counter;
+    jobSystem.parallelFor(WorkItems, WorkBatch, [&output](uint32_t first, uint32_t count)
+    {
+      for (uint32_t i = first; i < first + count; i++) output[i] = busyWork(i);
+    }, &counter);
+    jobSystem.wait(counter);
+    double workSeconds = secondsSince(start);
+    if (repeat == 0 || workSeconds < bestWork) bestWork = workSeconds;
+  }
+
+  jobSystem.destroy();
+
+  result.spawnNsPerJob = bestSpawn * 1e9 / SpawnJobs;
+  result.parallelForMs = bestWork * 1e3;
+  return result;
+}
+
+void runJobSystemBenchmark(BenchmarkSettings const &benchmarkSettings)
+{
+  uint32_t maxThreads = std::min(std::max(std::thread::hardware_concurrency(), 1U), JobSystem::MaxThreads);
+
+  // Powers of two, plus the full machine if it isn't one
+  std::vector<uint32_t> threadCounts;
+  for (uint32_t threads = 1; threads < maxThreads; threads *= 2) threadCounts.push_back(threads);
+  threadCounts.push_back(maxThreads);
+
+  std::vector<JobSystemResult> results;
+  for (uint32_t threads : threadCounts)
+  {
+    results.push_back(measureJobSystem(threads));
+    std::cout << "Job system " << threads << " threads: "
+              << results.back().spawnNsPerJob << " ns per job, "
+              << results.back().parallelForMs << " ms parallelFor" << std::endl;
+  }
+
+  std::ofstream file;
+  if (benchmarkSettings.outputPath != "-")
+  {
+    file.open(benchmarkSettings.outputPath, std::ios::trunc);
+    if (!file.is_open())
+    {
+      throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to open benchmark output file!"), "runJobSystemBenchmark");
+    }
+  }
+  std::ostream &out = file.is_open() ? static_cast<std::ostream&>(file) : std::cout;
+
+  out << std::fixed << std::setprecision(4);
+  out << "{\"jobSystem\":[\n";
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    out << "{\"threads\":" << results[i].threads
+        << ",\"spawnNsPerJob\":" << results[i].spawnNsPerJob
+        << ",\"parallelForMs\":" << results[i].parallelForMs
+        << ",\"speedUp\":" << results[0].parallelForMs / results[i].parallelForMs << "}"
+        << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  out << "]}" << std::endl;
+
+  if (file.is_open()) std::cout << "Wrote benchmark results to " << benchmarkSettings.outputPath << std::endl;
+}
+
+struct TransformKernelResult
+{
+  const char *kernel;
+  uint32_t objects;
+  double updateNsPerObject;
+  double cullNsPerObject;
+  uint32_t visible;
+  float maxError;              // Largest difference from glm's models
+  uint32_t visibleMismatches;  // Objects only one of this kernel and the glm loop found visible
+};
+
+// What the glm loop works on, one struct per object
+struct BenchmarkObject
+{
+  glm::vec3 position;
+  glm::vec3 scale;
+  float spin;
+  BoundingSphere bounds;
+};
+
+// Scattered through a cube around the camera, so roughly a tenth end up in the frustum
+static std::vector<BenchmarkObject> makeBenchmarkObjects(uint32_t count)
+{
+  std::mt19937 random(count);
+  std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+  std::uniform_real_distribution<float> scale(0.5f, 1.5f);
+  std::uniform_real_distribution<float> spin(-2.0f, 2.0f);
+
+  std::vector<BenchmarkObject> objects(count);
+  for (BenchmarkObject &object : objects)
+  {
+    object.position = glm::vec3(position(random), position(random), position(random));
+    object.scale = glm::vec3(scale(random), scale(random), scale(random));
+    object.spin = spin(random);
+    object.bounds = { glm::vec3(0.1f, -0.2f, 0.0f), 1.0f };
+  }
+  return objects;
+}
+
+static TransformBatch makeTransformBatch(std::vector<BenchmarkObject> const &objects)
+{
+  TransformBatch batch;
+  batch.resize(static_cast<uint32_t>(objects.size()));
+  for (uint32_t i = 0; i < batch.size(); i++)
+  {
+    BenchmarkObject const &object = objects[i];
+    batch.positionX[i] = object.position.x;
+    batch.positionY[i] = object.position.y;
+    batch.positionZ[i] = object.position.z;
+    batch.scaleX[i] = object.scale.x;
+    batch.scaleY[i] = object.scale.y;
+    batch.scaleZ[i] = object.scale.z;
+    batch.spin[i] = object.spin;
+    batch.boundsX[i] = object.bounds.centre.x;
+    batch.boundsY[i] = object.bounds.centre.y;
+    batch.boundsZ[i] = object.bounds.centre.z;
+    batch.boundsRadius[i] = object.bounds.radius;
+  }
+  return batch;
+}
+
+static std::vector<TransformKernelResult> measureTransformKernels(uint32_t objectCount)
+{
+  const int Repeats = 5;
+  const float Time = 1.25f;
+
+  glm::mat4 proj = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  Frustum frustum = Frustum::fromMatrix(proj * view);
+
+  std::vector<BenchmarkObject> objects = makeBenchmarkObjects(objectCount);
+  std::vector<glm::mat4> glmModels(objectCount);
+  std::vector<BoundingSphere> worldBounds(objectCount);
+  std::vector<uint32_t> visible(objectCount);
+  std::vector<uint32_t> glmVisible(objectCount);
+
+  // The loop the kernels replace, glm calls one object at a time. Best of several runs for each half.
+  TransformKernelResult glmResult = { "glm", objectCount, 0.0, 0.0, 0, 0.0f, 0 };
+  for (int repeat = 0; repeat < Repeats; repeat++)
+  {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < objectCount; i++)
+    {
+      BenchmarkObject const &object = objects[i];
+      glm::mat4 model = glm::translate(glm::mat4(1.0f), object.position);
+      model = glm::rotate(model, Time * object.spin, glm::vec3(0.0f, 0.0f, 1.0f));
+      model = glm::scale(model, object.scale);
+      glmModels[i] = model;
+
+      float maxScale = std::max({ std::abs(object.scale.x), std::abs(object.scale.y), std::abs(object.scale.z) });
+      worldBounds[i] = { glm::vec3(model * glm::vec4(object.bounds.centre, 1.0f)), object.bounds.radius * maxScale };
+    }
+    double updateSeconds = secondsSince(start);
+
+    start = std::chrono::high_resolution_clock::now();
+    uint32_t visibleCount = 0;
+    for (uint32_t i = 0; i < objectCount; i++)
+    {
+      bool inside = true;
+      for (glm::vec4 const &plane : frustum.planes)
+      {
+        inside = inside && glm::dot(glm::vec3(plane), worldBounds[i].centre) + plane.w >= -worldBounds[i].radius;
+      }
+      if (inside) glmVisible[visibleCount++] = i;
+    }
+    double cullSeconds = secondsSince(start);
+
+    double updateNs = updateSeconds * 1e9 / objectCount;
+    double cullNs = cullSeconds * 1e9 / objectCount;
+    if (repeat == 0 || updateNs < glmResult.updateNsPerObject) glmResult.updateNsPerObject = updateNs;
+    if (repeat == 0 || cullNs < glmResult.cullNsPerObject) glmResult.cullNsPerObject = cullNs;
+    glmResult.visible = visibleCount;
+  }
+
+  std::vector<TransformKernelResult> results = { glmResult };
+  std::vector<glm::mat4> models(objectCount);
+  for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2 })
+  {
+    TransformKernels const &kernels = getTransformKernels(level);
+    if (kernels.level != level) continue; // Not on this CPU
+
+    TransformBatch batch = makeTransformBatch(objects);
+    TransformKernelResult result = { getSimdLevelName(level), objectCount, 0.0, 0.0, 0, 0.0f, 0 };
+    for (int repeat = 0; repeat < Repeats; repeat++)
+    {
+      auto start = std::chrono::high_resolution_clock::now();
+      kernels.updateTransforms(batch, Time, 0, objectCount, models.data());
+      double updateNs = secondsSince(start) * 1e9 / objectCount;
+
+      start = std::chrono::high_resolution_clock::now();
+      result.visible = kernels.cullSpheres(batch, frustum, 0, objectCount, visible.data());
+      double cullNs = secondsSince(start) * 1e9 / objectCount;
+
+      if (repeat == 0 || updateNs < result.updateNsPerObject) result.updateNsPerObject = updateNs;
+      if (repeat == 0 || cullNs < result.cullNsPerObject) result.cullNsPerObject = cullNs;
+    }
+
+    for (uint32_t i = 0; i < objectCount; i++)
+    {
+      for (int column = 0; column < 4; column++)
+      {
+        for (int row = 0; row < 4; row++) result.maxError = std::max(result.maxError, std::abs(models[i][column][row] - glmModels[i][column][row]));
+      }
+    }
+
+    // Both lists are in object order, so walking them together finds every object only one of them has
+    uint32_t kernelIndex = 0, glmIndex = 0;
+    while (kernelIndex < result.visible || glmIndex < glmResult.visible)
+    {
+      if (glmIndex == glmResult.visible || (kernelIndex < result.visible && visible[kernelIndex] < glmVisible[glmIndex]))
+      {
+        result.visibleMismatches++;
+        kernelIndex++;
+      }
+      else if (kernelIndex == result.visible || glmVisible[glmIndex] < visible[kernelIndex])
+      {
+        result.visibleMismatches++;
+        glmIndex++;
+      }
+      else
+      {
+        kernelIndex++;
+        glmIndex++;
+      }
+    }
+    results.push_back(result);
+  }
+  return results;
+}
+
+void runTransformBenchmark(BenchmarkSettings const &benchmarkSettings)
+{
+  std::cout << "Transform kernels: " << getSimdLevelName(detectSimdLevel()) << " is the best this CPU has" << std::endl;
+
+  std::vector<TransformKernelResult> results;
+  for (uint32_t objectCount : { 1U << 10, 1U << 16, 1U << 20 })
+  {
+    for (TransformKernelResult const &result : measureTransformKernels(objectCount))
+    {
+      std::cout << result.objects << " objects, " << result.kernel << ": "
+                << result.updateNsPerObject << " ns update, " << result.cullNsPerObject << " ns cull per object, "
+                << result.visible << " visible";
+      if (result.visibleMismatches > 0) std::cout << ", " << result.visibleMismatches << " differ from glm's";
+      std::cout << std::endl;
+      results.push_back(result);
+    }
+  }
+
+  std::ofstream file;
+  if (benchmarkSettings.outputPath != "-")
+  {
+    file.open(benchmarkSettings.outputPath, std::ios::trunc);
+    if (!file.is_open())
+    {
+      throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to open benchmark output file!"), "runTransformBenchmark");
+    }
+  }
+  std::ostream &out = file.is_open() ? static_cast<std::ostream&>(file) : std::cout;
+
+  // Speed ups are against the glm loop for the same object count, which always comes first
+  out << std::fixed << std::setprecision(4);
+  out << "{\"transformKernels\":[\n";
+  TransformKernelResult const *baseline = nullptr;
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    if (baseline == nullptr || baseline->objects != results[i].objects) baseline = &results[i];
+    out << "{\"kernel\":\"" << results[i].kernel << "\""
+        << ",\"objects\":" << results[i].objects
+        << ",\"updateNsPerObject\":" << results[i].updateNsPerObject
+        << ",\"cullNsPerObject\":" << results[i].cullNsPerObject
+        << ",\"updateSpeedUp\":" << baseline->updateNsPerObject / results[i].updateNsPerObject
+        << ",\"cullSpeedUp\":" << baseline->cullNsPerObject / results[i].cullNsPerObject
+        << ",\"visible\":" << results[i].visible
+        << ",\"visibleMismatches\":" << results[i].visibleMismatches
+        << ",\"maxError\":" << std::scientific << results[i].maxError << std::fixed << "}"
+        << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  out << "]}" << std::endl;
+
+  if (file.is_open()) std::cout << "Wrote benchmark results to " << benchmarkSettings.outputPath << std::endl;
+}
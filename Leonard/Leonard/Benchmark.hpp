@@ -0,0 +1,84 @@
+#pragma once
+#include "ApplicationSettings.hpp"
+#include "FrameProfiler.hpp"
+#include "MeshOptimizer.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+
+// What a headless run measured, filled in by HelloTriangleApplication before it tears down
+struct RunStatistics
+{
+  uint32_t vertexCount = 0;
+  uint32_t indexCount = 0;
+  uint64_t vertexBytes = 0;
+  uint32_t indexBits = 16;
+  uint32_t subMeshCount = 1;
+  uint64_t indexBytes = 0;
+  uint64_t indexBytesSaved = 0;         // Against 32 bit indices
+  uint64_t indexBytesSavedPerFrame = 0; // Index fetches saved across every instance
+  VertexCacheStats vertexCacheBefore;   // Of the drawn range, only filled in when the mesh is optimised
+  VertexCacheStats vertexCacheAfter;
+  uint32_t drawCount = 0;
+  uint32_t drawCommandCount = 0; // Draws split at sub-mesh boundaries
+  uint32_t drawCallCount = 0;    // vkCmdDraw* calls recorded per frame
+  double visibleDrawCommands = 0.0; // Average per frame left after GPU culling, drawCommandCount without it
+  uint32_t instanceCount = 0;
+  uint64_t uniformBytesPerFrame = 0; // Camera plus every object's uniforms
+  uint32_t framesInFlight = 0;
+  uint32_t frames = 0;
+  double seconds = 0.0;
+  ProfileStats cpuFrame;     // Milliseconds, the whole frame including waiting on the GPU
+  ProfileStats waitForFrame; // Milliseconds spent blocked on frame fences
+  ProfileStats gpuFrame;     // Milliseconds, from timestamp queries
+  uint32_t deviceAllocations = 0;
+  uint64_t subAllocations = 0;
+  uint32_t descriptorPools = 0;
+  uint64_t descriptorSets = 0;            // Persistent and per-frame sets allocated over the run
+  uint64_t descriptorPoolExhaustions = 0; // Pools which filled up, see DescriptorAllocatorStats
+  uint64_t readbackFrames = 0;  // Frames consumed, see ApplicationSettings::readbackMode
+  uint64_t readbackBytes = 0;
+  double readbackSeconds = 0.0; // Until the last frame was consumed
+  uint32_t readbackStalls = 0;  // Frames which had to wait for a readback slot
+};
+
+struct BenchmarkScene
+{
+  uint32_t quadCount;
+  uint32_t drawCount;
+  uint32_t instanceCount;
+  uint32_t framesInFlight;
+};
+
+// Every combination of the lists is run, skipping scenes with more draws than quads and scenes with more
+// than MaxQuadsPerFrame quads once instanced
+struct BenchmarkSettings
+{
+  static const uint64_t MaxQuadsPerFrame = 1 << 22;
+
+  bool enabled = false;
+  bool jobSystem = false; // Run the job system micro-benchmark instead of any scenes
+  bool transformKernels = false; // Run the transform and culling kernel micro-benchmark instead of any scenes
+  std::string outputPath = "benchmark.json"; // "-" writes to stdout
+  std::vector<uint32_t> quadCounts = { 1, 1024, 16384, 262144 };
+  std::vector<uint32_t> drawCounts = { 1, 64, 1024 };
+  std::vector<uint32_t> instanceCounts = { 1, 256, 16384 };
+  std::vector<uint32_t> framesInFlight = { 1, 2, 3 };
+};
+
+std::vector<BenchmarkScene> buildBenchmarkScenes(BenchmarkSettings const &benchmarkSettings);
+
+// Runs each scene headless with a fixed time step and writes the results as JSON, one scene per line so
+// results from two builds can be diffed directly
+void runBenchmarks(ApplicationSettings const &baseSettings, BenchmarkSettings const &benchmarkSettings);
+void writeBenchmarkJson(std::ostream &out, ApplicationSettings const &baseSettings, std::vector<BenchmarkScene> const &scenes, std::vector<RunStatistics> const &results);
+
+// Measures the job system alone: the cost of spawning and waiting on empty jobs, and how a fixed CPU bound
+// parallelFor scales from one thread up to one per hardware thread. Written to outputPath like runBenchmarks().
+void runJobSystemBenchmark(BenchmarkSettings const &benchmarkSettings);
+
+// Measures each TransformBatch kernel level this CPU has against the plain per-object glm loop they replace,
+// model updates and frustum culling separately, for a few object counts. Written to outputPath like runBenchmarks().
+void runTransformBenchmark(BenchmarkSettings const &benchmarkSettings);
@@ -0,0 +1,100 @@
+#include "BuddyAllocator.hpp"
+#include "UnrecoverableException.hpp"
+
+#include <algorithm>
+
+static uint64_t roundUpToPowerOfTwo(uint64_t value)
+{
+  uint64_t result = 1;
+  while (result < value) result <<= 1;
+  return result;
+}
+
+static bool isPowerOfTwo(uint64_t value)
+{
+  return value != 0 && (value & (value - 1)) == 0;
+}
+
+BuddyAllocator::BuddyAllocator(uint64_t _size, uint64_t _minBlockSize)
+  : size(_size)
+  , minBlockSize(_minBlockSize)
+{
+  if (!isPowerOfTwo(size) || !isPowerOfTwo(minBlockSize) || minBlockSize > size)
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Buddy allocator sizes must be powers of two!"), "BuddyAllocator");
+  }
+
+  levelCount = 1;
+  while ((size >> (levelCount - 1)) > minBlockSize) levelCount++;
+
+  freeBlocks.resize(levelCount);
+  freeBlocks[0].insert(0);
+}
+
+uint64_t BuddyAllocator::allocate(uint64_t _size, uint64_t alignment)
+{
+  if (_size == 0 || _size > size) return InvalidOffset;
+
+  uint64_t neededSize = roundUpToPowerOfTwo(std::max({ _size, alignment, minBlockSize }));
+  if (neededSize > size) return InvalidOffset;
+
+  uint32_t neededLevel = 0;
+  while (getBlockSize(neededLevel) > neededSize) neededLevel++;
+
+  // Find the smallest free block that fits, then split it down to the level we want
+  int32_t level = static_cast<int32_t>(neededLevel);
+  while (level >= 0 && freeBlocks[level].empty()) level--;
+  if (level < 0) return InvalidOffset;
+
+  uint64_t offset = *freeBlocks[level].begin();
+  freeBlocks[level].erase(freeBlocks[level].begin());
+
+  for (uint32_t splitLevel = static_cast<uint32_t>(level); splitLevel < neededLevel; splitLevel++)
+  {
+    // Keep the lower half, the upper half becomes free at the next level down
+    freeBlocks[splitLevel + 1].insert(offset + getBlockSize(splitLevel + 1));
+  }
+
+  allocations[offset] = { neededLevel, _size };
+  requestedSize += _size;
+  allocatedSize += getBlockSize(neededLevel);
+
+  return offset;
+}
+
+void BuddyAllocator::free(uint64_t offset)
+{
+  auto it = allocations.find(offset);
+  if (it == allocations.end())
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Freeing an offset that was never allocated!"), "BuddyAllocator::free");
+  }
+
+  uint32_t level = it->second.level;
+  requestedSize -= it->second.requestedSize;
+  allocatedSize -= getBlockSize(level);
+  allocations.erase(it);
+
+  // Merge with the buddy for as long as it's also free
+  while (level > 0)
+  {
+    uint64_t buddy = offset ^ getBlockSize(level);
+    auto buddyIt = freeBlocks[level].find(buddy);
+    if (buddyIt == freeBlocks[level].end()) break;
+
+    freeBlocks[level].erase(buddyIt);
+    offset = std::min(offset, buddy);
+    level--;
+  }
+
+  freeBlocks[level].insert(offset);
+}
+
+uint64_t BuddyAllocator::getLargestFreeBlock() const
+{
+  for (uint32_t level = 0; level < levelCount; level++)
+  {
+    if (!freeBlocks[level].empty()) return getBlockSize(level);
+  }
+  return 0;
+}
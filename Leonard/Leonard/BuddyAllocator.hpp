@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+
+// Power-of-two buddy sub-allocator over an abstract [0, size) range, knows nothing about Vulkan.
+// Every block is aligned to its own size, so any alignment up to the rounded request size comes for free.
+class BuddyAllocator
+{
+public:
+  static const uint64_t InvalidOffset = ~0ULL;
+
+  BuddyAllocator(uint64_t _size, uint64_t _minBlockSize);
+
+  // Returns InvalidOffset if there's no free block big enough
+  uint64_t allocate(uint64_t size, uint64_t alignment);
+  void free(uint64_t offset);
+
+  uint64_t getSize() const { return size; }
+  uint64_t getRequestedSize() const { return requestedSize; }   // What callers asked for
+  uint64_t getAllocatedSize() const { return allocatedSize; }   // Including power-of-two round up
+  uint64_t getFreeSize() const { return size - allocatedSize; }
+  uint64_t getLargestFreeBlock() const;
+  size_t getAllocationCount() const { return allocations.size(); }
+  bool isEmpty() const { return allocations.empty(); }
+
+private:
+  uint64_t getBlockSize(uint32_t level) const { return size >> level; }
+
+  struct AllocationInfo
+  {
+    uint32_t level;
+    uint64_t requestedSize;
+  };
+
+  uint64_t size;
+  uint64_t minBlockSize;
+  uint32_t levelCount;
+  uint64_t requestedSize = 0;
+  uint64_t allocatedSize = 0;
+
+  // Level 0 is the whole range, each level down halves the block size
+  std::vector<std::unordered_set<uint64_t>> freeBlocks;
+  std::unordered_map<uint64_t, AllocationInfo> allocations;
+};
@@ -0,0 +1,109 @@
+#include "CommandRecorder.hpp"
+#include "UnrecoverableException.hpp"
+
+void CommandRecorder::init(vk::Device _device, uint32_t queueFamilyIndex, uint32_t frameCount, JobSystem &_jobSystem)
+{
+  device = _device;
+  jobSystem = &_jobSystem;
+
+  // Pools are reset as a whole each frame, individual buffers are never reset
+  vk::CommandPoolCreateInfo poolInfo;
+  poolInfo.setQueueFamilyIndex(queueFamilyIndex)
+          .setFlags(vk::CommandPoolCreateFlagBits::eTransient);
+
+  threadPools.resize(jobSystem->getThreadCount());
+  for (auto &framePools : threadPools)
+  {
+    framePools.resize(frameCount);
+    for (auto &framePool : framePools)
+    {
+      framePool.pool = device.createCommandPool(poolInfo);
+    }
+  }
+}
+
+void CommandRecorder::destroy()
+{
+  for (auto &framePools : threadPools)
+  {
+    for (auto &framePool : framePools)
+    {
+      if (framePool.pool) device.destroyCommandPool(framePool.pool);
+    }
+  }
+  threadPools.clear();
+  batches.clear();
+  recorded.clear();
+  jobSystem = nullptr;
+}
+
+void CommandRecorder::beginFrame(uint32_t frame)
+{
+  for (auto &framePools : threadPools)
+  {
+    FramePool &framePool = framePools[frame];
+    if (framePool.used == 0) continue;
+    device.resetCommandPool(framePool.pool, vk::CommandPoolResetFlags());
+    framePool.used = 0;
+  }
+}
+
+std::vector<vk::CommandBuffer> const &CommandRecorder::recordSecondary(uint32_t frame, vk::CommandBufferInheritanceInfo const &inheritance, uint32_t itemCount, RecordFunction const &record)
+{
+  if (jobSystem->getThreadIndex() == JobSystem::ExternalThread)
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Secondary command buffers must be recorded from a job system thread!"), "CommandRecorder::recordSecondary");
+  }
+
+  // One batch per thread keeps the number of secondaries down, stealing evens out whatever imbalance is left
+  uint32_t threadCount = jobSystem->getThreadCount();
+  uint32_t batchSize = (itemCount + threadCount - 1) / threadCount;
+  batches.assign(batchSize ? (itemCount + batchSize - 1) / batchSize : 0, Batch());
+
+  JobSystem::Counter counter;
+  jobSystem->parallelFor(itemCount, batchSize, [&](uint32_t first, uint32_t count)
+  {
+    recordBatch(frame, inheritance, batches[first / batchSize], first, count, record);
+  }, &counter);
+  jobSystem->wait(counter);
+
+  recorded.clear();
+  for (auto &batch : batches)
+  {
+    if (batch.error) std::rethrow_exception(batch.error);
+    recorded.push_back(batch.result);
+  }
+  return recorded;
+}
+
+void CommandRecorder::recordBatch(uint32_t frame, vk::CommandBufferInheritanceInfo const &inheritance, Batch &batch, uint32_t first, uint32_t count, RecordFunction const &record)
+{
+  // Errors are handed back to the caller of recordSecondary() rather than taking down the worker
+  try
+  {
+    FramePool &framePool = threadPools[jobSystem->getThreadIndex()][frame];
+    if (framePool.used == framePool.commandBuffers.size())
+    {
+      vk::CommandBufferAllocateInfo allocInfo;
+      allocInfo.setCommandPool(framePool.pool)
+               .setLevel(vk::CommandBufferLevel::eSecondary)
+               .setCommandBufferCount(1);
+      framePool.commandBuffers.push_back(device.allocateCommandBuffers(allocInfo)[0]);
+    }
+    vk::CommandBuffer commandBuffer = framePool.commandBuffers[framePool.used++];
+
+    vk::CommandBufferBeginInfo beginInfo;
+    beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue)
+             .setPInheritanceInfo(&inheritance);
+
+    commandBuffer.begin(beginInfo);
+    record(commandBuffer, first, count);
+    commandBuffer.end();
+
+    batch.result = commandBuffer;
+  }
+  catch (...)
+  {
+    batch.error = std::current_exception();
+  }
+}
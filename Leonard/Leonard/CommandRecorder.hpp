@@ -0,0 +1,52 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include "JobSystem.hpp"
+
+#include <vector>
+#include <functional>
+#include <exception>
+
+// Records secondary command buffers in parallel on the job system. Every job system thread owns one command pool
+// per frame in flight, so a pool is never touched by two threads at once and all of a frame's pools can be reset
+// in one go once that frame's fence has signalled.
+class CommandRecorder
+{
+public:
+  // Records items [first, first + count) into commandBuffer, called on several threads at once
+  using RecordFunction = std::function<void(vk::CommandBuffer commandBuffer, uint32_t first, uint32_t count)>;
+
+  void init(vk::Device _device, uint32_t queueFamilyIndex, uint32_t frameCount, JobSystem &_jobSystem);
+  void destroy();
+
+  // Recycles every command buffer recorded for the frame, its previous submission must have completed
+  void beginFrame(uint32_t frame);
+
+  // Splits [0, itemCount) into one batch per thread, each recorded by a job into a secondary command buffer which
+  // continues the render pass described by inheritance. Must be called from a job system thread, it helps with
+  // the recording until every batch is done and returns the buffers in item order, ready for executeCommands().
+  std::vector<vk::CommandBuffer> const &recordSecondary(uint32_t frame, vk::CommandBufferInheritanceInfo const &inheritance, uint32_t itemCount, RecordFunction const &record);
+
+  uint32_t getThreadCount() const { return jobSystem ? jobSystem->getThreadCount() : 0; }
+
+private:
+  struct FramePool
+  {
+    vk::CommandPool pool;
+    std::vector<vk::CommandBuffer> commandBuffers;
+    uint32_t used = 0;
+  };
+
+  struct Batch
+  {
+    vk::CommandBuffer result;
+    std::exception_ptr error;
+  };
+
+  void recordBatch(uint32_t frame, vk::CommandBufferInheritanceInfo const &inheritance, Batch &batch, uint32_t first, uint32_t count, RecordFunction const &record);
+
+  vk::Device device;
+  JobSystem *jobSystem = nullptr;
+  std::vector<std::vector<FramePool>> threadPools; // [thread][frame]
+  std::vector<Batch> batches;
+  std::vector<vk::CommandBuffer> recorded;
+};
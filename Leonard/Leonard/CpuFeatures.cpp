@@ -0,0 +1,78 @@
+#include "CpuFeatures.hpp"
+
+#include <cstdint>
+
+#if LEONARD_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static void cpuid(uint32_t leaf, uint32_t subLeaf, uint32_t registers[4])
+{
+#if defined(_MSC_VER)
+  int values[4];
+  __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subLeaf));
+  for (int i = 0; i < 4; i++) registers[i] = static_cast<uint32_t>(values[i]);
+#else
+  __cpuid_count(leaf, subLeaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+// Which register state the OS saves on a context switch
+static uint64_t xgetbv()
+{
+#if defined(_MSC_VER)
+  return _xgetbv(0);
+#else
+  uint32_t low, high;
+  __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+  return (static_cast<uint64_t>(high) << 32) | low;
+#endif
+}
+
+static SimdLevel querySimdLevel()
+{
+  uint32_t registers[4]; // eax, ebx, ecx, edx
+  cpuid(0, 0, registers);
+  uint32_t maxLeaf = registers[0];
+  if (maxLeaf < 1) return SimdLevel::Scalar;
+
+  cpuid(1, 0, registers);
+  bool sse2 = (registers[3] & (1U << 26)) != 0;
+  bool fma = (registers[2] & (1U << 12)) != 0;
+  bool osxsave = (registers[2] & (1U << 27)) != 0;
+  bool avx = (registers[2] & (1U << 28)) != 0;
+  if (!sse2) return SimdLevel::Scalar;
+
+  // AVX needs the OS to save the xmm and ymm registers, or they'd get trashed on a context switch
+  bool avx2 = false;
+  if (maxLeaf >= 7 && osxsave && avx && fma && (xgetbv() & 6) == 6)
+  {
+    cpuid(7, 0, registers);
+    avx2 = (registers[1] & (1U << 5)) != 0;
+  }
+  return avx2 ? SimdLevel::Avx2 : SimdLevel::Sse2;
+}
+#endif
+
+SimdLevel detectSimdLevel()
+{
+#if LEONARD_X86
+  static const SimdLevel level = querySimdLevel();
+  return level;
+#else
+  return SimdLevel::Scalar;
+#endif
+}
+
+const char *getSimdLevelName(SimdLevel level)
+{
+  switch (level)
+  {
+  case SimdLevel::Sse2: return "SSE2";
+  case SimdLevel::Avx2: return "AVX2";
+  default:              return "Scalar";
+  }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LEONARD_X86 1
+#else
+#define LEONARD_X86 0
+#endif
+
+// Lets one function use AVX2 and FMA intrinsics without building its whole file for them, which would let the
+// compiler use them in shared inline code too. MSVC allows any intrinsic anywhere.
+#if defined(__GNUC__) || defined(__clang__)
+#define LEONARD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define LEONARD_TARGET_AVX2
+#endif
+
+// Instruction sets kernels are written for, in order, each one implies the ones before it
+enum class SimdLevel
+{
+  Scalar,
+  Sse2, // 4 floats at a time
+  Avx2  // 8 floats at a time, with FMA
+};
+
+// Best level both the CPU and the OS (for the wider registers' state) support, checked with CPUID once
+SimdLevel detectSimdLevel();
+const char *getSimdLevelName(SimdLevel level);
@@ -0,0 +1,249 @@
+#include "DescriptorAllocator.hpp"
+#include "UnrecoverableException.hpp"
+
+#include <algorithm>
+#include <functional>
+
+static uint32_t roundUpToPowerOfTwo(uint32_t value)
+{
+  uint32_t rounded = 1;
+  while (rounded < value) rounded <<= 1;
+  return rounded;
+}
+
+static void hashCombine(size_t &seed, size_t value)
+{
+  seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+bool DescriptorAllocator::LayoutBinding::operator==(LayoutBinding const &other) const
+{
+  return binding == other.binding
+      && descriptorType == other.descriptorType
+      && descriptorCount == other.descriptorCount
+      && stageFlags == other.stageFlags
+      && immutableSamplers == other.immutableSamplers;
+}
+
+size_t DescriptorAllocator::LayoutKeyHash::operator()(LayoutKey const &key) const
+{
+  size_t seed = std::hash<uint32_t>()(static_cast<VkDescriptorSetLayoutCreateFlags>(key.flags));
+  for (LayoutBinding const &binding : key.bindings)
+  {
+    hashCombine(seed, std::hash<uint32_t>()(binding.binding));
+    hashCombine(seed, std::hash<uint32_t>()(static_cast<uint32_t>(binding.descriptorType)));
+    hashCombine(seed, std::hash<uint32_t>()(binding.descriptorCount));
+    hashCombine(seed, std::hash<uint32_t>()(static_cast<VkShaderStageFlags>(binding.stageFlags)));
+    for (vk::Sampler sampler : binding.immutableSamplers) hashCombine(seed, std::hash<VkSampler>()(static_cast<VkSampler>(sampler)));
+  }
+  return seed;
+}
+
+void DescriptorAllocator::init(vk::Device _device, uint32_t frameCount)
+{
+  device = _device;
+  frameChains.resize(std::max(frameCount, 1U));
+  frameSetCounts.assign(frameChains.size(), 0);
+}
+
+void DescriptorAllocator::destroy()
+{
+  auto destroyChains = [this](std::vector<PoolChain> &chains)
+  {
+    for (PoolChain &chain : chains)
+    {
+      for (Pool &pool : chain.pools) device.destroyDescriptorPool(pool.pool);
+    }
+    chains.clear();
+  };
+  destroyChains(persistentChains);
+  for (auto &chains : frameChains) destroyChains(chains);
+
+  for (auto const &layout : layouts) device.destroyDescriptorSetLayout(layout.second);
+  layouts.clear();
+  layoutSizeClasses.clear();
+  sizeClassIndices.clear();
+  sizeClasses.clear();
+}
+
+vk::DescriptorSetLayout DescriptorAllocator::getLayout(vk::DescriptorSetLayoutCreateInfo const &layoutInfo)
+{
+  LayoutKey key;
+  key.flags = layoutInfo.flags;
+  key.bindings.reserve(layoutInfo.bindingCount);
+  for (uint32_t i = 0; i < layoutInfo.bindingCount; i++)
+  {
+    vk::DescriptorSetLayoutBinding const &binding = layoutInfo.pBindings[i];
+    LayoutBinding keyBinding = { binding.binding, binding.descriptorType, binding.descriptorCount, binding.stageFlags, {} };
+    if (binding.pImmutableSamplers)
+    {
+      keyBinding.immutableSamplers.assign(binding.pImmutableSamplers, binding.pImmutableSamplers + binding.descriptorCount);
+    }
+    key.bindings.push_back(keyBinding);
+  }
+  std::sort(key.bindings.begin(), key.bindings.end(), [](LayoutBinding const &a, LayoutBinding const &b) { return a.binding < b.binding; });
+
+  auto found = layouts.find(key);
+  if (found != layouts.end())
+  {
+    layoutCacheHits++;
+    return found->second;
+  }
+
+  SizeClass sizeClass = {};
+  for (LayoutBinding const &binding : key.bindings)
+  {
+    uint32_t type = static_cast<uint32_t>(binding.descriptorType);
+    if (type >= DescriptorTypeCount)
+    {
+      throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Descriptor type isn't one the allocator knows about!"), "DescriptorAllocator::getLayout");
+    }
+    sizeClass[type] += binding.descriptorCount;
+  }
+  for (uint32_t &count : sizeClass)
+  {
+    if (count > 0) count = roundUpToPowerOfTwo(count);
+  }
+
+  auto classFound = sizeClassIndices.find(sizeClass);
+  uint32_t classIndex;
+  if (classFound != sizeClassIndices.end())
+  {
+    classIndex = classFound->second;
+  }
+  else
+  {
+    classIndex = static_cast<uint32_t>(sizeClasses.size());
+    sizeClassIndices[sizeClass] = classIndex;
+    sizeClasses.push_back(sizeClass);
+    persistentChains.resize(sizeClasses.size());
+    for (auto &chains : frameChains) chains.resize(sizeClasses.size());
+  }
+
+  vk::DescriptorSetLayout layout = device.createDescriptorSetLayout(layoutInfo);
+  layouts[key] = layout;
+  layoutSizeClasses[static_cast<VkDescriptorSetLayout>(layout)] = classIndex;
+  return layout;
+}
+
+uint32_t DescriptorAllocator::findSizeClass(vk::DescriptorSetLayout layout) const
+{
+  auto found = layoutSizeClasses.find(static_cast<VkDescriptorSetLayout>(layout));
+  if (found == layoutSizeClasses.end())
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Descriptor set layout didn't come from DescriptorAllocator::getLayout!"), "DescriptorAllocator::findSizeClass");
+  }
+  return found->second;
+}
+
+vk::DescriptorSet DescriptorAllocator::allocate(vk::DescriptorSetLayout layout)
+{
+  uint32_t sizeClass = findSizeClass(layout);
+  persistentSets++;
+  return allocateFrom(persistentChains[sizeClass], sizeClass, layout);
+}
+
+vk::DescriptorSet DescriptorAllocator::allocateForFrame(uint32_t frame, vk::DescriptorSetLayout layout)
+{
+  uint32_t sizeClass = findSizeClass(layout);
+  frameSets++;
+  frameSetCounts[frame]++;
+  return allocateFrom(frameChains[frame][sizeClass], sizeClass, layout);
+}
+
+vk::DescriptorSet DescriptorAllocator::allocateFrom(PoolChain &chain, uint32_t sizeClass, vk::DescriptorSetLayout layout)
+{
+  // Every set in the chain fits its size class, so counting sets is enough to know when a pool is full
+  if (chain.current < chain.pools.size() && chain.pools[chain.current].used == chain.pools[chain.current].capacity)
+  {
+    chain.current++;
+  }
+
+  // Stepping onto a pool kept from before the last reset is free, only running out of them counts
+  if (chain.current == chain.pools.size())
+  {
+    if (!chain.pools.empty()) poolExhaustions++;
+
+    Pool pool;
+    uint32_t capacity = chain.pools.empty() ? InitialSetsPerPool : chain.pools.back().capacity * 2;
+    pool.capacity = capacity < MaxSetsPerPool ? capacity : MaxSetsPerPool;
+
+    std::vector<vk::DescriptorPoolSize> poolSizes;
+    for (uint32_t type = 0; type < DescriptorTypeCount; type++)
+    {
+      if (sizeClasses[sizeClass][type] == 0) continue;
+      poolSizes.push_back(vk::DescriptorPoolSize(static_cast<vk::DescriptorType>(type), sizeClasses[sizeClass][type] * pool.capacity));
+    }
+
+    // Layouts without any descriptors still take a set
+    vk::DescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.setMaxSets(pool.capacity)
+            .setPoolSizeCount(static_cast<uint32_t>(poolSizes.size()))
+            .setPPoolSizes(poolSizes.data());
+
+    pool.pool = device.createDescriptorPool(poolInfo);
+    chain.pools.push_back(pool);
+  }
+
+  Pool &pool = chain.pools[chain.current];
+  vk::DescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.setDescriptorPool(pool.pool)
+           .setDescriptorSetCount(1)
+           .setPSetLayouts(&layout);
+
+  vk::DescriptorSet set;
+  vk::Result result = device.allocateDescriptorSets(&allocInfo, &set);
+  if (result != vk::Result::eSuccess)
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to allocate descriptor set: " + vk::to_string(result)), "DescriptorAllocator::allocateFrom");
+  }
+  pool.used++;
+  return set;
+}
+
+void DescriptorAllocator::resetFrame(uint32_t frame)
+{
+  if (frameSetCounts[frame] == 0) return;
+
+  for (PoolChain &chain : frameChains[frame])
+  {
+    for (Pool &pool : chain.pools)
+    {
+      if (pool.used == 0) continue;
+      device.resetDescriptorPool(pool.pool, vk::DescriptorPoolResetFlags());
+      pool.used = 0;
+    }
+    chain.current = 0;
+  }
+  frameSetCounts[frame] = 0;
+  frameResets++;
+}
+
+DescriptorAllocatorStats DescriptorAllocator::getStats() const
+{
+  DescriptorAllocatorStats stats;
+  stats.layoutCount = static_cast<uint32_t>(layouts.size());
+  stats.layoutCacheHits = layoutCacheHits;
+  stats.sizeClassCount = static_cast<uint32_t>(sizeClasses.size());
+  for (PoolChain const &chain : persistentChains) stats.poolCount += static_cast<uint32_t>(chain.pools.size());
+  for (auto const &chains : frameChains)
+  {
+    for (PoolChain const &chain : chains) stats.poolCount += static_cast<uint32_t>(chain.pools.size());
+  }
+  stats.persistentSets = persistentSets;
+  stats.frameSets = frameSets;
+  stats.frameResets = frameResets;
+  stats.poolExhaustions = poolExhaustions;
+  return stats;
+}
+
+void DescriptorAllocator::printStats(std::ostream &out) const
+{
+  DescriptorAllocatorStats stats = getStats();
+  out << "Descriptors: " << stats.layoutCount << " layouts (" << stats.layoutCacheHits << " cache hits), "
+      << stats.sizeClassCount << " size classes, " << stats.poolCount << " pools, "
+      << stats.poolExhaustions << " pool exhaustions" << std::endl;
+  out << "\t" << stats.persistentSets << " persistent sets, " << stats.frameSets << " per-frame sets";
+  if (stats.frameResets > 0) out << " (" << static_cast<double>(stats.frameSets) / stats.frameResets << " per frame)";
+  out << std::endl;
+}
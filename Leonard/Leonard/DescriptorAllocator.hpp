@@ -0,0 +1,115 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <ostream>
+
+struct DescriptorAllocatorStats
+{
+  uint32_t layoutCount = 0;     // Distinct layouts actually created
+  uint64_t layoutCacheHits = 0; // Layout requests handed an existing layout
+  uint32_t sizeClassCount = 0;
+  uint32_t poolCount = 0;
+  uint64_t persistentSets = 0;
+  uint64_t frameSets = 0;       // Every per-frame set allocated so far, across all resets
+  uint64_t frameResets = 0;     // Frame slots which had sets to throw away
+  uint64_t poolExhaustions = 0; // Times a chain ran out of pools and had to create a new one
+};
+
+// Hands out descriptor sets from chains of pools, one chain per size class. A layout's size class is its
+// descriptor count of each type rounded up to a power of two, and every pool in a chain has room for whole
+// sets of that class, so sets of very different shapes never compete for the same pool and a pool can't end
+// up with descriptors left over that no set fits. A full pool is followed by one twice its size, up to
+// MaxSetsPerPool.
+//
+// Sets either live until destroy(), or belong to a frame slot and are thrown away in one go by resetFrame()
+// once that frame's fence has signalled. Sets are never freed individually.
+//
+// Layouts go through getLayout(), which hands back the same vk::DescriptorSetLayout for identical bindings.
+// Only layouts from getLayout() can be allocated from. Not thread safe, sets are allocated on the render thread.
+class DescriptorAllocator
+{
+public:
+  static const uint32_t InitialSetsPerPool = 16;
+  static const uint32_t MaxSetsPerPool = 4096;
+
+  void init(vk::Device _device, uint32_t frameCount);
+  void destroy();
+
+  // Owned by the allocator, destroyed along with it
+  vk::DescriptorSetLayout getLayout(vk::DescriptorSetLayoutCreateInfo const &layoutInfo);
+
+  vk::DescriptorSet allocate(vk::DescriptorSetLayout layout);
+  vk::DescriptorSet allocateForFrame(uint32_t frame, vk::DescriptorSetLayout layout);
+
+  // Every set allocated for the frame is invalid afterwards, its previous submission must have completed
+  void resetFrame(uint32_t frame);
+
+  DescriptorAllocatorStats getStats() const;
+  void printStats(std::ostream &out) const;
+
+private:
+  // Vulkan 1.0 descriptor types, eSampler to eInputAttachment
+  static const uint32_t DescriptorTypeCount = 11;
+  using SizeClass = std::array<uint32_t, DescriptorTypeCount>;
+
+  struct LayoutBinding
+  {
+    uint32_t binding;
+    vk::DescriptorType descriptorType;
+    uint32_t descriptorCount;
+    vk::ShaderStageFlags stageFlags;
+    std::vector<vk::Sampler> immutableSamplers;
+
+    bool operator==(LayoutBinding const &other) const;
+  };
+
+  // Bindings sorted by binding number, so the order they were listed in doesn't matter
+  struct LayoutKey
+  {
+    vk::DescriptorSetLayoutCreateFlags flags;
+    std::vector<LayoutBinding> bindings;
+
+    bool operator==(LayoutKey const &other) const { return flags == other.flags && bindings == other.bindings; }
+  };
+
+  struct LayoutKeyHash
+  {
+    size_t operator()(LayoutKey const &key) const;
+  };
+
+  struct Pool
+  {
+    vk::DescriptorPool pool;
+    uint32_t capacity = 0;
+    uint32_t used = 0;
+  };
+
+  struct PoolChain
+  {
+    std::vector<Pool> pools;
+    uint32_t current = 0; // Pools before this one are full
+  };
+
+  vk::DescriptorSet allocateFrom(PoolChain &chain, uint32_t sizeClass, vk::DescriptorSetLayout layout);
+  uint32_t findSizeClass(vk::DescriptorSetLayout layout) const;
+
+  vk::Device device;
+  std::unordered_map<LayoutKey, vk::DescriptorSetLayout, LayoutKeyHash> layouts;
+  std::unordered_map<VkDescriptorSetLayout, uint32_t> layoutSizeClasses;
+  std::map<SizeClass, uint32_t> sizeClassIndices;
+  std::vector<SizeClass> sizeClasses;
+
+  std::vector<PoolChain> persistentChains;           // [size class]
+  std::vector<std::vector<PoolChain>> frameChains;   // [frame][size class]
+  std::vector<uint64_t> frameSetCounts;              // Sets allocated for each frame since its last reset
+
+  uint64_t layoutCacheHits = 0;
+  uint64_t persistentSets = 0;
+  uint64_t frameSets = 0;
+  uint64_t frameResets = 0;
+  uint64_t poolExhaustions = 0;
+};
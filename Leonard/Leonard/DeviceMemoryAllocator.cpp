@@ -0,0 +1,284 @@
+#include "DeviceMemoryAllocator.hpp"
+#include "UnrecoverableException.hpp"
+
+#include <algorithm>
+
+void DeviceMemoryAllocator::init(vk::PhysicalDevice _physicalDevice, vk::Device _device, vk::DeviceSize _blockSize)
+{
+  physicalDevice = _physicalDevice;
+  device = _device;
+  blockSize = _blockSize;
+
+  memoryProperties = physicalDevice.getMemoryProperties();
+
+  vk::PhysicalDeviceLimits limits = physicalDevice.getProperties().limits;
+  bufferImageGranularity = limits.bufferImageGranularity;
+  maxMemoryAllocationCount = limits.maxMemoryAllocationCount;
+}
+
+void DeviceMemoryAllocator::destroy()
+{
+  for (auto &pool : pools)
+  {
+    for (auto &block : pool.blocks)
+    {
+      if (!block) continue;
+      if (block->mapped) device.unmapMemory(block->memory);
+      device.freeMemory(block->memory);
+    }
+  }
+  for (auto &allocation : dedicatedAllocations)
+  {
+    if (allocation.mapped) device.unmapMemory(allocation.memory);
+    device.freeMemory(allocation.memory);
+  }
+  pools.clear();
+  dedicatedAllocations.clear();
+  deviceAllocationCount = 0;
+}
+
+MemoryAllocation DeviceMemoryAllocator::allocate(vk::MemoryRequirements const &requirements, uint32_t memoryTypeIndex, bool linear)
+{
+  MemoryAllocation allocation;
+  allocation.memoryTypeIndex = memoryTypeIndex;
+  allocation.size = requirements.size;
+
+  // Anything bigger than half a block would waste most of it, give it its own memory instead
+  if (requirements.size > blockSize / 2)
+  {
+    allocation.memory = allocateDeviceMemory(requirements.size, memoryTypeIndex, &allocation.mapped);
+    allocation.offset = 0;
+    allocation.dedicated = true;
+    dedicatedAllocations.push_back(allocation);
+    totalSubAllocationCount++;
+    return allocation;
+  }
+
+  uint32_t poolIndex = findPool(memoryTypeIndex, linear);
+  MemoryPool &pool = pools[poolIndex];
+
+  vk::DeviceSize alignment = requirements.alignment;
+
+  for (uint32_t i = 0; i < pool.blocks.size(); i++)
+  {
+    if (!pool.blocks[i]) continue;
+
+    uint64_t offset = pool.blocks[i]->buddy.allocate(requirements.size, alignment);
+    if (offset != BuddyAllocator::InvalidOffset)
+    {
+      allocation.memory = pool.blocks[i]->memory;
+      allocation.offset = offset;
+      allocation.mapped = pool.blocks[i]->mapped ? static_cast<char*>(pool.blocks[i]->mapped) + offset : nullptr;
+      allocation.poolIndex = poolIndex;
+      allocation.blockIndex = i;
+      totalSubAllocationCount++;
+      return allocation;
+    }
+  }
+
+  // Nothing free, grab a new block (reusing a released slot if there is one)
+  auto block = std::make_unique<MemoryBlock>(blockSize);
+  block->memory = allocateDeviceMemory(blockSize, memoryTypeIndex, &block->mapped);
+
+  uint32_t blockIndex = static_cast<uint32_t>(std::find(pool.blocks.begin(), pool.blocks.end(), nullptr) - pool.blocks.begin());
+  if (blockIndex == pool.blocks.size())
+  {
+    pool.blocks.push_back(std::move(block));
+  }
+  else
+  {
+    pool.blocks[blockIndex] = std::move(block);
+  }
+
+  MemoryBlock &newBlock = *pool.blocks[blockIndex];
+  uint64_t offset = newBlock.buddy.allocate(requirements.size, alignment);
+  if (offset == BuddyAllocator::InvalidOffset)
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Allocation doesn't fit in an empty memory block!"), "DeviceMemoryAllocator::allocate");
+  }
+
+  allocation.memory = newBlock.memory;
+  allocation.offset = offset;
+  allocation.mapped = newBlock.mapped ? static_cast<char*>(newBlock.mapped) + offset : nullptr;
+  allocation.poolIndex = poolIndex;
+  allocation.blockIndex = blockIndex;
+  totalSubAllocationCount++;
+  return allocation;
+}
+
+void DeviceMemoryAllocator::free(MemoryAllocation &allocation)
+{
+  if (!allocation) return;
+
+  if (allocation.dedicated)
+  {
+    auto it = std::find_if(dedicatedAllocations.begin(), dedicatedAllocations.end(),
+      [&allocation](MemoryAllocation const &a) { return a.memory == allocation.memory; });
+    if (it != dedicatedAllocations.end())
+    {
+      if (it->mapped) device.unmapMemory(it->memory);
+      device.freeMemory(it->memory);
+      dedicatedAllocations.erase(it);
+      deviceAllocationCount--;
+    }
+  }
+  else
+  {
+    pools[allocation.poolIndex].blocks[allocation.blockIndex]->buddy.free(allocation.offset);
+  }
+
+  allocation = MemoryAllocation();
+}
+
+uint32_t DeviceMemoryAllocator::findPool(uint32_t memoryTypeIndex, bool linear)
+{
+  // With a granularity of 1 there's nothing to keep apart, so linear and non-linear resources share pools
+  bool separate = bufferImageGranularity > 1;
+
+  for (uint32_t i = 0; i < pools.size(); i++)
+  {
+    if (pools[i].memoryTypeIndex == memoryTypeIndex && (!separate || pools[i].linear == linear))
+    {
+      return i;
+    }
+  }
+
+  MemoryPool pool;
+  pool.memoryTypeIndex = memoryTypeIndex;
+  pool.linear = linear;
+  pools.push_back(std::move(pool));
+  return static_cast<uint32_t>(pools.size() - 1);
+}
+
+vk::DeviceMemory DeviceMemoryAllocator::allocateDeviceMemory(vk::DeviceSize size, uint32_t memoryTypeIndex, void **mapped)
+{
+  if (maxMemoryAllocationCount > 0 && deviceAllocationCount >= maxMemoryAllocationCount)
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Exceeded maxMemoryAllocationCount!"), "DeviceMemoryAllocator::allocateDeviceMemory");
+  }
+
+  vk::MemoryAllocateInfo allocInfo;
+  allocInfo.setAllocationSize(size)
+           .setMemoryTypeIndex(memoryTypeIndex);
+
+  vk::DeviceMemory memory = device.allocateMemory(allocInfo);
+  deviceAllocationCount++;
+
+  // Host visible memory is mapped once for its whole lifetime
+  *mapped = isHostVisible(memoryTypeIndex) ? device.mapMemory(memory, 0, VK_WHOLE_SIZE) : nullptr;
+
+  return memory;
+}
+
+bool DeviceMemoryAllocator::isHostVisible(uint32_t memoryTypeIndex) const
+{
+  return static_cast<bool>(memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible);
+}
+
+std::vector<MemoryHeapStats> DeviceMemoryAllocator::getHeapStats() const
+{
+  std::vector<MemoryHeapStats> stats(memoryProperties.memoryHeapCount);
+  for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+  {
+    stats[i].heapSize = memoryProperties.memoryHeaps[i].size;
+  }
+
+  for (auto const &pool : pools)
+  {
+    MemoryHeapStats &heap = stats[memoryProperties.memoryTypes[pool.memoryTypeIndex].heapIndex];
+    for (auto const &block : pool.blocks)
+    {
+      if (!block) continue;
+      heap.blockCount++;
+      heap.blockBytes += block->buddy.getSize();
+      heap.usedBytes += block->buddy.getRequestedSize();
+      heap.allocationCount += static_cast<uint32_t>(block->buddy.getAllocationCount());
+      heap.fragmentedBytes += (block->buddy.getAllocatedSize() - block->buddy.getRequestedSize())
+                            + (block->buddy.getFreeSize() - block->buddy.getLargestFreeBlock());
+    }
+  }
+
+  for (auto const &allocation : dedicatedAllocations)
+  {
+    MemoryHeapStats &heap = stats[memoryProperties.memoryTypes[allocation.memoryTypeIndex].heapIndex];
+    heap.blockCount++;
+    heap.blockBytes += allocation.size;
+    heap.usedBytes += allocation.size;
+    heap.allocationCount++;
+  }
+
+  for (auto &heap : stats)
+  {
+    heap.freeBytes = heap.blockBytes - heap.usedBytes;
+  }
+
+  return stats;
+}
+
+void DeviceMemoryAllocator::printStats(std::ostream &out) const
+{
+  auto stats = getHeapStats();
+  out << "Device memory: " << deviceAllocationCount << " device allocations, "
+      << totalSubAllocationCount << " sub-allocations made" << std::endl;
+  for (size_t i = 0; i < stats.size(); i++)
+  {
+    if (stats[i].blockCount == 0) continue;
+    out << "\tHeap " << i << ": " << stats[i].blockCount << " blocks, "
+        << stats[i].allocationCount << " allocations, "
+        << stats[i].usedBytes / 1024 << " KiB used, "
+        << stats[i].freeBytes / 1024 << " KiB free, "
+        << stats[i].fragmentedBytes / 1024 << " KiB fragmented" << std::endl;
+  }
+}
+
+std::vector<MemoryAllocation> DeviceMemoryAllocator::getDefragmentationCandidates(float maxBlockOccupancy) const
+{
+  // The buddy allocator doesn't expose its allocations, so candidates are reported per block; the owner
+  // matches them against its own allocations by memory handle
+  std::vector<MemoryAllocation> candidates;
+  for (uint32_t poolIndex = 0; poolIndex < pools.size(); poolIndex++)
+  {
+    auto const &pool = pools[poolIndex];
+    for (uint32_t blockIndex = 0; blockIndex < pool.blocks.size(); blockIndex++)
+    {
+      auto const &block = pool.blocks[blockIndex];
+      if (!block || block->buddy.isEmpty()) continue;
+
+      float occupancy = static_cast<float>(block->buddy.getAllocatedSize()) / static_cast<float>(block->buddy.getSize());
+      if (occupancy <= maxBlockOccupancy)
+      {
+        MemoryAllocation candidate;
+        candidate.memory = block->memory;
+        candidate.size = block->buddy.getSize();
+        candidate.memoryTypeIndex = pool.memoryTypeIndex;
+        candidate.poolIndex = poolIndex;
+        candidate.blockIndex = blockIndex;
+        candidates.push_back(candidate);
+      }
+    }
+  }
+  return candidates;
+}
+
+void DeviceMemoryAllocator::releaseEmptyBlocks()
+{
+  for (auto &pool : pools)
+  {
+    // Keep the first empty block of each pool around so alloc/free churn doesn't hit the driver every time
+    bool keptOne = false;
+    for (auto &block : pool.blocks)
+    {
+      if (!block || !block->buddy.isEmpty()) continue;
+      if (!keptOne)
+      {
+        keptOne = true;
+        continue;
+      }
+
+      if (block->mapped) device.unmapMemory(block->memory);
+      device.freeMemory(block->memory);
+      block.reset();
+      deviceAllocationCount--;
+    }
+  }
+}
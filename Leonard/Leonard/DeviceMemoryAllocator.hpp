@@ -0,0 +1,96 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+#include "BuddyAllocator.hpp"
+
+#include <vector>
+#include <memory>
+#include <ostream>
+
+struct MemoryAllocation
+{
+  vk::DeviceMemory memory;
+  vk::DeviceSize offset = 0;
+  vk::DeviceSize size = 0;
+  void *mapped = nullptr; // Points at offset, only set for host visible memory which stays mapped
+  uint32_t memoryTypeIndex = 0;
+
+  // Where the allocation lives inside the allocator
+  uint32_t poolIndex = 0;
+  uint32_t blockIndex = 0;
+  bool dedicated = false;
+
+  explicit operator bool() const { return static_cast<bool>(memory); }
+};
+
+struct MemoryHeapStats
+{
+  vk::DeviceSize heapSize = 0;
+  vk::DeviceSize blockBytes = 0;      // Device memory actually allocated from the driver
+  vk::DeviceSize usedBytes = 0;       // Bytes requested by live allocations
+  vk::DeviceSize freeBytes = 0;       // blockBytes - usedBytes
+  vk::DeviceSize fragmentedBytes = 0; // Free bytes that can't be handed out as part of the largest free block, plus round up waste
+  uint32_t blockCount = 0;
+  uint32_t allocationCount = 0;
+};
+
+// Carves large vk::DeviceMemory blocks per memory type into buddy sub-allocations, so the number of
+// vkAllocateMemory calls stays well below maxMemoryAllocationCount.
+class DeviceMemoryAllocator
+{
+public:
+  static const vk::DeviceSize DefaultBlockSize = 64 * 1024 * 1024;
+  static const vk::DeviceSize MinAllocationSize = 256;
+
+  void init(vk::PhysicalDevice _physicalDevice, vk::Device _device, vk::DeviceSize _blockSize = DefaultBlockSize);
+  void destroy();
+
+  // Linear resources are buffers and linear tiled images, everything else is non-linear (optimal tiled images)
+  MemoryAllocation allocate(vk::MemoryRequirements const &requirements, uint32_t memoryTypeIndex, bool linear);
+  void free(MemoryAllocation &allocation);
+
+  std::vector<MemoryHeapStats> getHeapStats() const;
+  void printStats(std::ostream &out) const;
+  uint32_t getDeviceAllocationCount() const { return deviceAllocationCount; }
+  uint64_t getTotalSubAllocationCount() const { return totalSubAllocationCount; }
+
+  // Defragmentation hooks, the allocator can't move resources itself since it doesn't own them.
+  // Returns the sparsely used blocks (memory + pool/block index); the owner re-creates whatever of its resources live in
+  // them, copies the contents over and frees the old allocations, then calls releaseEmptyBlocks() to give the memory back.
+  std::vector<MemoryAllocation> getDefragmentationCandidates(float maxBlockOccupancy) const;
+  void releaseEmptyBlocks();
+
+private:
+  struct MemoryBlock
+  {
+    MemoryBlock(vk::DeviceSize size) : buddy(size, MinAllocationSize) {}
+
+    vk::DeviceMemory memory;
+    void *mapped = nullptr;
+    BuddyAllocator buddy;
+  };
+
+  struct MemoryPool
+  {
+    uint32_t memoryTypeIndex;
+    bool linear;
+    std::vector<std::unique_ptr<MemoryBlock>> blocks; // Null entries are released blocks, keeps indices stable
+  };
+
+  uint32_t findPool(uint32_t memoryTypeIndex, bool linear);
+  vk::DeviceMemory allocateDeviceMemory(vk::DeviceSize size, uint32_t memoryTypeIndex, void **mapped);
+  bool isHostVisible(uint32_t memoryTypeIndex) const;
+
+  vk::PhysicalDevice physicalDevice;
+  vk::Device device;
+  vk::PhysicalDeviceMemoryProperties memoryProperties;
+  vk::DeviceSize blockSize = DefaultBlockSize;
+  vk::DeviceSize bufferImageGranularity = 1;
+  uint32_t maxMemoryAllocationCount = 0;
+
+  std::vector<MemoryPool> pools;
+  std::vector<MemoryAllocation> dedicatedAllocations;
+
+  uint32_t deviceAllocationCount = 0;
+  uint64_t totalSubAllocationCount = 0;
+};
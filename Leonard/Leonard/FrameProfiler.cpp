@@ -0,0 +1,232 @@
+#include "FrameProfiler.hpp"
+#include "UnrecoverableException.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <thread>
+
+void FrameProfiler::init(vk::PhysicalDevice physicalDevice, vk::Device _device, uint32_t queueFamilyIndex)
+{
+  device = _device;
+
+  vk::PhysicalDeviceProperties properties = physicalDevice.getProperties();
+  std::vector<vk::QueueFamilyProperties> queueFamilies = physicalDevice.getQueueFamilyProperties();
+  uint32_t validBits = queueFamilies[queueFamilyIndex].timestampValidBits;
+
+  // Without valid timestamp bits on the queue the GPU scopes are silently skipped
+  gpuTimingSupported = validBits > 0 && properties.limits.timestampPeriod > 0.f;
+  timestampPeriod = properties.limits.timestampPeriod;
+  timestampMask = validBits >= 64 ? ~0ULL : ((1ULL << validBits) - 1);
+}
+
+void FrameProfiler::destroy()
+{
+  if (queryPool) device.destroyQueryPool(queryPool);
+  queryPool = nullptr;
+  slotCount = 0;
+  slots.clear();
+}
+
+void FrameProfiler::setSlotCount(uint32_t count)
+{
+  if (!gpuTimingSupported || count <= slotCount) return;
+
+  if (queryPool) device.destroyQueryPool(queryPool);
+
+  vk::QueryPoolCreateInfo createInfo;
+  createInfo.setQueryType(vk::QueryType::eTimestamp)
+            .setQueryCount(count * MaxGpuScopes * 2);
+  queryPool = device.createQueryPool(createInfo);
+
+  slotCount = count;
+  slots.assign(count, Slot());
+}
+
+FrameProfiler::ScopeId FrameProfiler::addCpuScope(std::string const &name)
+{
+  Scope scope;
+  scope.name = name;
+  scope.gpu = false;
+  scope.gpuIndex = 0;
+  scope.history = std::make_unique<LockFreeRing<float, HistorySize>>();
+  scopes.push_back(std::move(scope));
+  return static_cast<ScopeId>(scopes.size() - 1);
+}
+
+FrameProfiler::ScopeId FrameProfiler::addGpuScope(std::string const &name)
+{
+  if (gpuScopeCount >= MaxGpuScopes)
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Too many GPU profiler scopes!"), "FrameProfiler::addGpuScope");
+  }
+
+  Scope scope;
+  scope.name = name;
+  scope.gpu = true;
+  scope.gpuIndex = gpuScopeCount++;
+  scope.history = std::make_unique<LockFreeRing<float, HistorySize>>();
+  scopes.push_back(std::move(scope));
+  return static_cast<ScopeId>(scopes.size() - 1);
+}
+
+void FrameProfiler::resetGpuScopes(vk::CommandBuffer commandBuffer, uint32_t slot)
+{
+  if (!gpuTimingSupported || slot >= slotCount) return;
+
+  commandBuffer.resetQueryPool(queryPool, slot * MaxGpuScopes * 2, MaxGpuScopes * 2);
+  slots[slot].scopesRecorded = 0;
+}
+
+void FrameProfiler::beginGpuScope(vk::CommandBuffer commandBuffer, uint32_t slot, ScopeId scope, vk::PipelineStageFlagBits stage)
+{
+  if (!gpuTimingSupported || slot >= slotCount) return;
+
+  uint32_t gpuIndex = scopes[scope].gpuIndex;
+  commandBuffer.writeTimestamp(stage, queryPool, (slot * MaxGpuScopes + gpuIndex) * 2);
+}
+
+void FrameProfiler::endGpuScope(vk::CommandBuffer commandBuffer, uint32_t slot, ScopeId scope, vk::PipelineStageFlagBits stage)
+{
+  if (!gpuTimingSupported || slot >= slotCount) return;
+
+  uint32_t gpuIndex = scopes[scope].gpuIndex;
+  commandBuffer.writeTimestamp(stage, queryPool, (slot * MaxGpuScopes + gpuIndex) * 2 + 1);
+  slots[slot].scopesRecorded |= 1U << gpuIndex;
+}
+
+void FrameProfiler::markSubmitted(uint32_t slot)
+{
+  if (!gpuTimingSupported || slot >= slotCount) return;
+
+  slots[slot].submitted = true;
+  slots[slot].submitMicroseconds = toMicroseconds(std::chrono::high_resolution_clock::now());
+}
+
+void FrameProfiler::collectGpuResults(uint32_t slot)
+{
+  if (!gpuTimingSupported || slot >= slotCount || !slots[slot].submitted) return;
+  slots[slot].submitted = false;
+
+  for (ScopeId id = 0; id < scopes.size(); id++)
+  {
+    Scope &scope = scopes[id];
+    if (!scope.gpu || !(slots[slot].scopesRecorded & (1U << scope.gpuIndex))) continue;
+
+    // Only the pairs which were written, the rest of the slot's queries stay unavailable after the reset. The
+    // slot's fence has signalled by now, so waiting on a written pair never actually blocks.
+    std::array<uint64_t, 2> timestamps;
+    vk::Result result = device.getQueryPoolResults( queryPool
+                                                  , (slot * MaxGpuScopes + scope.gpuIndex) * 2
+                                                  , 2
+                                                  , sizeof(timestamps)
+                                                  , timestamps.data()
+                                                  , sizeof(uint64_t)
+                                                  , vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+    if (result != vk::Result::eSuccess) continue;
+
+    uint64_t begin = timestamps[0] & timestampMask;
+    uint64_t end = timestamps[1] & timestampMask;
+    double durationMicroseconds = static_cast<double>((end - begin) & timestampMask) * timestampPeriod / 1000.0;
+
+    if (!gpuTimelineAnchored)
+    {
+      gpuTimelineAnchored = true;
+      gpuAnchorTicks = begin;
+      gpuAnchorMicroseconds = slots[slot].submitMicroseconds;
+    }
+
+    scope.history->push(static_cast<float>(durationMicroseconds / 1000.0));
+
+    TraceEvent event;
+    event.scope = id;
+    event.threadId = ~0U; // GPU track
+    event.startMicroseconds = gpuAnchorMicroseconds + static_cast<double>((begin - gpuAnchorTicks) & timestampMask) * timestampPeriod / 1000.0;
+    event.durationMicroseconds = durationMicroseconds;
+    trace->push(event);
+  }
+}
+
+void FrameProfiler::recordCpuScope(ScopeId scope, std::chrono::high_resolution_clock::time_point start, std::chrono::high_resolution_clock::time_point end)
+{
+  double startMicroseconds = toMicroseconds(start);
+  double durationMicroseconds = toMicroseconds(end) - startMicroseconds;
+
+  scopes[scope].history->push(static_cast<float>(durationMicroseconds / 1000.0));
+
+  TraceEvent event;
+  event.scope = scope;
+  event.threadId = getThreadId();
+  event.startMicroseconds = startMicroseconds;
+  event.durationMicroseconds = durationMicroseconds;
+  trace->push(event);
+}
+
+ProfileStats FrameProfiler::getStats(ScopeId scope) const
+{
+  ProfileStats stats;
+  std::vector<float> samples = scopes[scope].history->snapshot();
+  if (samples.empty()) return stats;
+
+  std::sort(samples.begin(), samples.end());
+
+  double sum = 0.0;
+  for (float sample : samples) sum += sample;
+
+  stats.count = samples.size();
+  stats.min = samples.front();
+  stats.max = samples.back();
+  stats.mean = sum / samples.size();
+  stats.p99 = samples[std::min(samples.size() - 1, (samples.size() * 99) / 100)];
+  return stats;
+}
+
+void FrameProfiler::printStats(std::ostream &out) const
+{
+  out << "Profile (ms over the last " << HistorySize << " samples):" << std::endl;
+  for (ScopeId id = 0; id < scopes.size(); id++)
+  {
+    ProfileStats stats = getStats(id);
+    if (stats.count == 0) continue;
+    out << "\t" << (scopes[id].gpu ? "[GPU] " : "[CPU] ") << scopes[id].name
+        << ": min " << stats.min
+        << ", mean " << stats.mean
+        << ", p99 " << stats.p99
+        << ", max " << stats.max << std::endl;
+  }
+}
+
+bool FrameProfiler::exportChromeTrace(std::string const &path) const
+{
+  std::ofstream file(path, std::ios::trunc);
+  if (!file.is_open()) return false;
+
+  std::vector<TraceEvent> events = trace->snapshot();
+
+  // chrome://tracing and Perfetto both read this, one track per CPU thread plus one for the GPU
+  file << "{\"traceEvents\":[\n";
+  file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}";
+  for (auto const &event : events)
+  {
+    uint32_t tid = event.threadId == ~0U ? 0 : event.threadId + 1;
+    file << ",\n{\"name\":\"" << scopes[event.scope].name << "\""
+         << ",\"cat\":\"" << (scopes[event.scope].gpu ? "gpu" : "cpu") << "\""
+         << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+         << ",\"ts\":" << event.startMicroseconds
+         << ",\"dur\":" << event.durationMicroseconds << "}";
+  }
+  file << "\n]}\n";
+
+  return true;
+}
+
+double FrameProfiler::toMicroseconds(std::chrono::high_resolution_clock::time_point time) const
+{
+  return std::chrono::duration<double, std::chrono::microseconds::period>(time - epoch).count();
+}
+
+uint32_t FrameProfiler::getThreadId()
+{
+  static std::atomic<uint32_t> nextThreadId{ 0 };
+  thread_local uint32_t threadId = nextThreadId++;
+  return threadId;
+}
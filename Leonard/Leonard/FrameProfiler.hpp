@@ -0,0 +1,162 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+#include <atomic>
+#include <array>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <ostream>
+#include <memory>
+
+// Fixed size ring which any number of threads can push into without locking. Readers take a snapshot of the most
+// recent entries; an entry which is being overwritten mid-read is skipped thanks to its sequence number.
+template<typename T, size_t Capacity>
+class LockFreeRing
+{
+public:
+  void push(T const &value)
+  {
+    uint64_t index = writeIndex.fetch_add(1, std::memory_order_relaxed);
+    Entry &entry = entries[index % Capacity];
+    entry.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.value = value;
+    entry.sequence.store(index + 1, std::memory_order_release);
+  }
+
+  std::vector<T> snapshot() const
+  {
+    std::vector<T> values;
+    uint64_t end = writeIndex.load(std::memory_order_acquire);
+    uint64_t begin = end > Capacity ? end - Capacity : 0;
+    values.reserve(static_cast<size_t>(end - begin));
+    for (uint64_t index = begin; index < end; index++)
+    {
+      Entry const &entry = entries[index % Capacity];
+      if (entry.sequence.load(std::memory_order_acquire) != index + 1) continue;
+      T value = entry.value;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (entry.sequence.load(std::memory_order_relaxed) != index + 1) continue;
+      values.push_back(value);
+    }
+    return values;
+  }
+
+private:
+  struct Entry
+  {
+    std::atomic<uint64_t> sequence{ 0 };
+    T value;
+  };
+
+  std::array<Entry, Capacity> entries;
+  std::atomic<uint64_t> writeIndex{ 0 };
+};
+
+struct ProfileStats
+{
+  size_t count = 0;
+  double min = 0.0;
+  double mean = 0.0;
+  double p99 = 0.0;
+  double max = 0.0;
+};
+
+// CPU scopes are timed with the high resolution clock, GPU scopes with timestamp queries written into the command
+// buffer. GPU results are collected per submission slot (one per command buffer that can be in flight) once the
+// caller knows that slot's previous submission has completed.
+class FrameProfiler
+{
+public:
+  using ScopeId = uint32_t;
+
+  static const uint32_t MaxGpuScopes = 8;
+  static const size_t HistorySize = 1024;
+  static const size_t TraceSize = 64 * 1024;
+
+  void init(vk::PhysicalDevice physicalDevice, vk::Device _device, uint32_t queueFamilyIndex);
+  void destroy();
+
+  // Make sure there are query ranges for this many submission slots, the device must be idle
+  void setSlotCount(uint32_t count);
+
+  // Scopes must all be added up front, before anything is recorded
+  ScopeId addCpuScope(std::string const &name);
+  ScopeId addGpuScope(std::string const &name);
+
+  // Recorded into the command buffer of a slot, reset must happen outside of a render pass
+  void resetGpuScopes(vk::CommandBuffer commandBuffer, uint32_t slot);
+  void beginGpuScope(vk::CommandBuffer commandBuffer, uint32_t slot, ScopeId scope, vk::PipelineStageFlagBits stage = vk::PipelineStageFlagBits::eTopOfPipe);
+  void endGpuScope(vk::CommandBuffer commandBuffer, uint32_t slot, ScopeId scope, vk::PipelineStageFlagBits stage = vk::PipelineStageFlagBits::eBottomOfPipe);
+
+  // Note when a slot was submitted, and pull its timestamps back once it's known to have completed (after its fence)
+  void markSubmitted(uint32_t slot);
+  void collectGpuResults(uint32_t slot);
+
+  void recordCpuScope(ScopeId scope, std::chrono::high_resolution_clock::time_point start, std::chrono::high_resolution_clock::time_point end);
+
+  // RAII helper for CPU scopes
+  class CpuScope
+  {
+  public:
+    CpuScope(FrameProfiler &_profiler, ScopeId _scope)
+      : profiler(_profiler), scope(_scope), start(std::chrono::high_resolution_clock::now())
+    {}
+    ~CpuScope() { profiler.recordCpuScope(scope, start, std::chrono::high_resolution_clock::now()); }
+
+  private:
+    FrameProfiler &profiler;
+    ScopeId scope;
+    std::chrono::high_resolution_clock::time_point start;
+  };
+
+  ProfileStats getStats(ScopeId scope) const;
+  void printStats(std::ostream &out) const;
+  bool exportChromeTrace(std::string const &path) const;
+
+private:
+  struct Scope
+  {
+    std::string name;
+    bool gpu;
+    uint32_t gpuIndex; // Which pair of queries in a slot's range this scope uses
+    std::unique_ptr<LockFreeRing<float, HistorySize>> history; // Milliseconds
+  };
+
+  struct TraceEvent
+  {
+    ScopeId scope;
+    uint32_t threadId;
+    double startMicroseconds;
+    double durationMicroseconds;
+  };
+
+  struct Slot
+  {
+    uint32_t scopesRecorded = 0; // Bitmask of gpuIndex written by the slot's command buffer
+    bool submitted = false;
+    double submitMicroseconds = 0.0;
+  };
+
+  double toMicroseconds(std::chrono::high_resolution_clock::time_point time) const;
+  static uint32_t getThreadId();
+
+  vk::Device device;
+  vk::QueryPool queryPool;
+  uint32_t slotCount = 0;
+  std::vector<Slot> slots;
+  bool gpuTimingSupported = false;
+  double timestampPeriod = 1.0; // Nanoseconds per tick
+  uint64_t timestampMask = ~0ULL;
+
+  // GPU ticks are lined up with the CPU timeline using the first collected frame
+  bool gpuTimelineAnchored = false;
+  uint64_t gpuAnchorTicks = 0;
+  double gpuAnchorMicroseconds = 0.0;
+
+  std::vector<Scope> scopes;
+  uint32_t gpuScopeCount = 0;
+  std::chrono::high_resolution_clock::time_point epoch = std::chrono::high_resolution_clock::now();
+  std::unique_ptr<LockFreeRing<TraceEvent, TraceSize>> trace = std::make_unique<LockFreeRing<TraceEvent, TraceSize>>();
+};
@@ -0,0 +1,214 @@
+#include "FrameReadback.hpp"
+#include "UnrecoverableException.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <limits>
+
+void FrameReadback::init(vk::Device _device, vk::Queue _queue, JobSystem &_jobSystem, vk::Extent2D _extent, uint32_t slotCount, vk::DeviceSize _nonCoherentAtomSize, ConsumeFunction _consume)
+{
+  device = _device;
+  queue = _queue;
+  jobSystem = &_jobSystem;
+  extent = _extent;
+  frameSize = static_cast<vk::DeviceSize>(extent.width) * extent.height * 4;
+  nonCoherentAtomSize = std::max<vk::DeviceSize>(_nonCoherentAtomSize, 1);
+  consumeFunction = std::move(_consume);
+  nextSlot = 0;
+  nextFrameNumber = 0;
+  framesConsumed = 0;
+  stalls = 0;
+
+  // Fences start signalled so a slot's first acquire doesn't need special casing
+  vk::FenceCreateInfo fenceInfo;
+  fenceInfo.setFlags(vk::FenceCreateFlagBits::eSignaled);
+
+  for (uint32_t i = 0; i < slotCount; i++)
+  {
+    slots.push_back(std::make_unique<Slot>());
+    slots.back()->fence = device.createFence(fenceInfo);
+  }
+}
+
+void FrameReadback::setSlotStorage(uint32_t slot, vk::Buffer buffer, MemoryAllocation const &allocation, bool coherent)
+{
+  slots[slot]->buffer = buffer;
+  slots[slot]->allocation = allocation;
+  slots[slot]->coherent = coherent;
+}
+
+void FrameReadback::destroy()
+{
+  // Consumers read straight out of the buffers, which the caller is about to free
+  for (auto &slot : slots)
+  {
+    jobSystem->wait(slot->consumer);
+    if (slot->fence) device.destroyFence(slot->fence);
+  }
+  slots.clear();
+}
+
+uint32_t FrameReadback::acquireSlot()
+{
+  poll();
+
+  uint32_t index = nextSlot;
+  Slot &slot = *slots[index];
+  if (slot.state != SlotState::Free) stalls++;
+
+  if (slot.state == SlotState::Copying)
+  {
+    device.waitForFences(slot.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+    consume(slot);
+  }
+  if (slot.state == SlotState::Consuming)
+  {
+    waitForConsumer(slot);
+  }
+
+  nextSlot = (nextSlot + 1) % getSlotCount();
+  return index;
+}
+
+void FrameReadback::recordCopy(vk::CommandBuffer commandBuffer, vk::Image image, uint32_t slot)
+{
+  vk::BufferImageCopy region;
+  region.setBufferOffset(0)
+        .setBufferRowLength(0)
+        .setBufferImageHeight(0)
+        .setImageSubresource({ vk::ImageAspectFlagBits::eColor, 0, 0, 1 })
+        .setImageOffset({ 0, 0, 0 })
+        .setImageExtent({ extent.width, extent.height, 1 });
+  commandBuffer.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, slots[slot]->buffer, region);
+
+  // Make the copy visible to the host once the slot's fence has signalled
+  vk::BufferMemoryBarrier readbackBarrier;
+  readbackBarrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+                 .setDstAccessMask(vk::AccessFlagBits::eHostRead)
+                 .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                 .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                 .setBuffer(slots[slot]->buffer)
+                 .setOffset(0)
+                 .setSize(VK_WHOLE_SIZE);
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, vk::DependencyFlags(), nullptr, readbackBarrier, nullptr);
+}
+
+void FrameReadback::submitted(uint32_t slot)
+{
+  Slot &s = *slots[slot];
+  s.frameNumber = nextFrameNumber++;
+  s.state = SlotState::Copying;
+
+  // An empty submission's fence signals once everything before it on the queue has finished, so the frame keeps its
+  // own fence for its own frame slot and the readback slot gets one it can hold on to for longer
+  device.resetFences(s.fence);
+  queue.submit(nullptr, s.fence);
+}
+
+void FrameReadback::poll()
+{
+  for (auto &slot : slots)
+  {
+    if (slot->state == SlotState::Copying && device.getFenceStatus(slot->fence) == vk::Result::eSuccess)
+    {
+      consume(*slot);
+    }
+  }
+}
+
+void FrameReadback::flush()
+{
+  for (auto &slot : slots)
+  {
+    if (slot->state == SlotState::Copying)
+    {
+      device.waitForFences(slot->fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+      consume(*slot);
+    }
+  }
+  for (auto &slot : slots)
+  {
+    if (slot->state == SlotState::Consuming) waitForConsumer(*slot);
+  }
+}
+
+void FrameReadback::consume(Slot &slot)
+{
+  if (!slot.coherent)
+  {
+    // Invalidated ranges have to be whole atoms, allocations from the allocator's blocks already are
+    vk::DeviceSize begin = slot.allocation.offset / nonCoherentAtomSize * nonCoherentAtomSize;
+    vk::DeviceSize end = (slot.allocation.offset + frameSize + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize;
+
+    vk::MappedMemoryRange range;
+    range.setMemory(slot.allocation.memory)
+         .setOffset(begin)
+         .setSize(slot.allocation.dedicated ? VK_WHOLE_SIZE : end - begin);
+    device.invalidateMappedMemoryRanges(range);
+  }
+
+  slot.state = SlotState::Consuming;
+  ReadbackFrame frame = { slot.frameNumber, extent.width, extent.height, static_cast<uint8_t const*>(slot.allocation.mapped), static_cast<size_t>(frameSize) };
+
+  // Errors are handed back to whoever waits on the slot rather than taking down the worker
+  jobSystem->run([this, &slot, frame]
+  {
+    try
+    {
+      consumeFunction(frame);
+      framesConsumed.fetch_add(1, std::memory_order_relaxed);
+    }
+    catch (...)
+    {
+      slot.error = std::current_exception();
+    }
+  }, &slot.consumer);
+}
+
+void FrameReadback::waitForConsumer(Slot &slot)
+{
+  jobSystem->wait(slot.consumer);
+  slot.state = SlotState::Free;
+
+  if (slot.error)
+  {
+    std::exception_ptr error = slot.error;
+    slot.error = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+uint64_t hashReadbackFrame(ReadbackFrame const &frame)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < frame.size; i++)
+  {
+    hash ^= frame.pixels[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+void writeReadbackPpm(ReadbackFrame const &frame, std::string const &path)
+{
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to open readback output file!"), "writeReadbackPpm");
+  }
+
+  file << "P6\n" << frame.width << " " << frame.height << "\n255\n";
+
+  std::vector<char> row(static_cast<size_t>(frame.width) * 3);
+  for (uint32_t y = 0; y < frame.height; y++)
+  {
+    uint8_t const *pixel = frame.pixels + static_cast<size_t>(y) * frame.width * 4;
+    for (uint32_t x = 0; x < frame.width; x++)
+    {
+      row[x * 3 + 0] = static_cast<char>(pixel[x * 4 + 0]);
+      row[x * 3 + 1] = static_cast<char>(pixel[x * 4 + 1]);
+      row[x * 3 + 2] = static_cast<char>(pixel[x * 4 + 2]);
+    }
+    file.write(row.data(), row.size());
+  }
+}
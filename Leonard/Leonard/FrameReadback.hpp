@@ -0,0 +1,105 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include "DeviceMemoryAllocator.hpp"
+#include "JobSystem.hpp"
+
+#include <vector>
+#include <functional>
+#include <exception>
+#include <atomic>
+#include <memory>
+#include <string>
+
+// A frame back on the host, tightly packed RGBA8
+struct ReadbackFrame
+{
+  uint64_t frameNumber;
+  uint32_t width;
+  uint32_t height;
+  uint8_t const *pixels;
+  size_t size;
+};
+
+// Streams rendered frames back to the host without stalling the GPU. Every slot of the ring owns a persistently
+// mapped host buffer and a fence, signalled by an empty submit straight after the frame which copied into the slot.
+// Once that fence has signalled the frame goes to the consumer as a job, reading straight out of the mapping, and
+// the slot is only reused after the consumer has returned.
+class FrameReadback
+{
+public:
+  // Called on a job system thread, possibly for several frames at once and not in frame order
+  using ConsumeFunction = std::function<void(ReadbackFrame const &frame)>;
+
+  void init(vk::Device _device, vk::Queue _queue, JobSystem &_jobSystem, vk::Extent2D _extent, uint32_t slotCount, vk::DeviceSize _nonCoherentAtomSize, ConsumeFunction _consume);
+
+  // Each slot's buffer is owned by the caller, it must be at least getFrameSize() bytes, have eTransferDst usage and
+  // be host visible and mapped. Host cached memory is faster to read, it needn't be coherent.
+  void setSlotStorage(uint32_t slot, vk::Buffer buffer, MemoryAllocation const &allocation, bool coherent);
+
+  // Waits for every consumer still running, then destroys the fences
+  void destroy();
+
+  // Picks the slot the next frame copies into, waiting for its previous frame to be consumed if it hasn't been yet
+  uint32_t acquireSlot();
+
+  // Copies image, which must be in eTransferSrcOptimal, into the slot and makes it visible to the host
+  void recordCopy(vk::CommandBuffer commandBuffer, vk::Image image, uint32_t slot);
+
+  // Call straight after submitting the frame which recorded the copy
+  void submitted(uint32_t slot);
+
+  // Hands every frame whose copy has finished to the consumer, without waiting on anything
+  void poll();
+
+  // Waits until every submitted frame has been consumed
+  void flush();
+
+  vk::DeviceSize getFrameSize() const { return frameSize; }
+  uint32_t getSlotCount() const { return static_cast<uint32_t>(slots.size()); }
+  uint64_t getFramesConsumed() const { return framesConsumed.load(std::memory_order_relaxed); }
+  uint64_t getBytesConsumed() const { return getFramesConsumed() * frameSize; }
+  uint32_t getStalls() const { return stalls; } // acquireSlot() calls which had to wait
+
+private:
+  enum class SlotState
+  {
+    Free,
+    Copying,  // Submitted, waiting on the fence
+    Consuming // Copy landed, the consumer job owns the mapping
+  };
+
+  struct Slot
+  {
+    vk::Buffer buffer;
+    MemoryAllocation allocation;
+    bool coherent = true;
+    vk::Fence fence;
+    SlotState state = SlotState::Free;
+    uint64_t frameNumber = 0;
+    JobSystem::Counter consumer;
+    std::exception_ptr error;
+  };
+
+  void consume(Slot &slot);
+  void waitForConsumer(Slot &slot);
+
+  vk::Device device;
+  vk::Queue queue;
+  JobSystem *jobSystem = nullptr;
+  vk::Extent2D extent;
+  vk::DeviceSize frameSize = 0;
+  vk::DeviceSize nonCoherentAtomSize = 1;
+  ConsumeFunction consumeFunction;
+
+  std::vector<std::unique_ptr<Slot>> slots;
+  uint32_t nextSlot = 0;
+  uint64_t nextFrameNumber = 0;
+  std::atomic<uint64_t> framesConsumed{ 0 };
+  uint32_t stalls = 0;
+};
+
+// 64 bit FNV-1a of the pixels, the same image hashes the same on every machine
+uint64_t hashReadbackFrame(ReadbackFrame const &frame);
+
+// Binary PPM, the alpha channel is dropped
+void writeReadbackPpm(ReadbackFrame const &frame, std::string const &path);
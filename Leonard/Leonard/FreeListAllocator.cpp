@@ -0,0 +1,76 @@
+#include "FreeListAllocator.hpp"
+#include "UnrecoverableException.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+FreeListAllocator::FreeListAllocator(uint64_t _size)
+  : size(_size)
+{
+  if (size > 0) freeRanges[0] = size;
+}
+
+uint64_t FreeListAllocator::allocate(uint64_t _size, uint64_t alignment)
+{
+  if (_size == 0) return InvalidOffset;
+  if (alignment == 0) alignment = 1;
+
+  for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+  {
+    uint64_t rangeStart = it->first;
+    uint64_t rangeEnd = it->first + it->second;
+    uint64_t offset = (rangeStart + alignment - 1) / alignment * alignment;
+    if (offset > rangeEnd || rangeEnd - offset < _size) continue;
+
+    // Whatever is left either side of the allocation stays free
+    freeRanges.erase(it);
+    if (offset > rangeStart) freeRanges[rangeStart] = offset - rangeStart;
+    if (offset + _size < rangeEnd) freeRanges[offset + _size] = rangeEnd - (offset + _size);
+
+    allocations[offset] = _size;
+    allocatedSize += _size;
+    return offset;
+  }
+
+  return InvalidOffset;
+}
+
+void FreeListAllocator::free(uint64_t offset)
+{
+  auto allocation = allocations.find(offset);
+  if (allocation == allocations.end())
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Freeing an offset that was never allocated!"), "FreeListAllocator::free");
+  }
+
+  uint64_t rangeSize = allocation->second;
+  allocatedSize -= rangeSize;
+  allocations.erase(allocation);
+
+  // Merge with the free range after, then the one before
+  auto next = freeRanges.lower_bound(offset);
+  if (next != freeRanges.end() && next->first == offset + rangeSize)
+  {
+    rangeSize += next->second;
+    next = freeRanges.erase(next);
+  }
+
+  if (next != freeRanges.begin())
+  {
+    auto previous = std::prev(next);
+    if (previous->first + previous->second == offset)
+    {
+      previous->second += rangeSize;
+      return;
+    }
+  }
+
+  freeRanges[offset] = rangeSize;
+}
+
+uint64_t FreeListAllocator::getLargestFreeRange() const
+{
+  uint64_t largest = 0;
+  for (auto const &range : freeRanges) largest = std::max(largest, range.second);
+  return largest;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <unordered_map>
+
+// First fit sub-allocator over an abstract [0, size) range, knows nothing about Vulkan. Unlike BuddyAllocator
+// nothing is rounded up, freed ranges are merged with their free neighbours instead.
+class FreeListAllocator
+{
+public:
+  static const uint64_t InvalidOffset = ~0ULL;
+
+  explicit FreeListAllocator(uint64_t _size = 0);
+
+  // Returns InvalidOffset if there's no free range big enough
+  uint64_t allocate(uint64_t size, uint64_t alignment);
+  void free(uint64_t offset);
+
+  uint64_t getSize() const { return size; }
+  uint64_t getAllocatedSize() const { return allocatedSize; }
+  uint64_t getFreeSize() const { return size - allocatedSize; }
+  uint64_t getLargestFreeRange() const;
+  size_t getFreeRangeCount() const { return freeRanges.size(); }
+  size_t getAllocationCount() const { return allocations.size(); }
+
+private:
+  uint64_t size;
+  uint64_t allocatedSize = 0;
+  std::map<uint64_t, uint64_t> freeRanges; // Offset to size, sorted so neighbours can be found on free
+  std::unordered_map<uint64_t, uint64_t> allocations;
+};
@@ -0,0 +1,48 @@
+#include "FrustumCulling.hpp"
+
+#include <algorithm>
+
+Frustum Frustum::fromMatrix(glm::mat4 const &matrix)
+{
+  // glm is column major, so a row is one element from each column
+  glm::vec4 rows[4];
+  for (int row = 0; row < 4; row++)
+  {
+    rows[row] = glm::vec4(matrix[0][row], matrix[1][row], matrix[2][row], matrix[3][row]);
+  }
+
+  // Near is -w < z rather than Vulkan's 0 < z, as glm builds OpenGL style projections. That only moves it
+  // towards the camera, so nothing visible gets culled.
+  Frustum frustum;
+  frustum.planes[0] = rows[3] + rows[0];
+  frustum.planes[1] = rows[3] - rows[0];
+  frustum.planes[2] = rows[3] + rows[1];
+  frustum.planes[3] = rows[3] - rows[1];
+  frustum.planes[4] = rows[3] + rows[2];
+  frustum.planes[5] = rows[3] - rows[2];
+
+  for (glm::vec4 &plane : frustum.planes)
+  {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return frustum;
+}
+
+BoundingSphere computeBoundingSphere(Vertex const *vertices, void const *indices, uint32_t indexSize, uint32_t firstIndex, uint32_t indexCount)
+{
+  if (indexCount == 0) return { glm::vec3(0.0f), 0.0f };
+
+  glm::vec2 low(1.0f);
+  glm::vec2 high(-1.0f);
+  for (uint32_t i = firstIndex; i < firstIndex + indexCount; i++)
+  {
+    uint32_t index = indexSize == sizeof(uint16_t) ? static_cast<uint16_t const*>(indices)[i] : static_cast<uint32_t const*>(indices)[i];
+    glm::vec2 pos = glm::unpackSnorm2x16(vertices[index].pos);
+    low = glm::min(low, pos);
+    high = glm::max(high, pos);
+  }
+
+  // Meshes are flat, z is always 0
+  glm::vec2 centre = (low + high) * 0.5f;
+  return { glm::vec3(centre, 0.0f), glm::length(high - centre) };
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+
+#include "Vertex.hpp"
+
+// Object space bounds of a draw command, laid out like the vec4 cull.comp reads
+struct BoundingSphere
+{
+  glm::vec3 centre;
+  float radius;
+};
+static_assert(sizeof(BoundingSphere) == 16, "BoundingSphere must match a vec4");
+
+// The planes of a view frustum as (a, b, c, d) with ax + by + cz + d >= 0 inside and (a, b, c) unit length.
+// Left, right, bottom, top, near, far.
+struct Frustum
+{
+  glm::vec4 planes[6];
+
+  // Gribb/Hartmann, each plane is a sum or difference of the matrix's rows. proj * view gives a world space frustum.
+  static Frustum fromMatrix(glm::mat4 const &matrix);
+};
+
+// Sphere around the box the vertices used by indices [firstIndex, firstIndex + indexCount) span. Looser than the
+// smallest sphere, but one pass and good enough to cull with. indexSize is 2 or 4.
+BoundingSphere computeBoundingSphere(Vertex const *vertices, void const *indices, uint32_t indexSize, uint32_t firstIndex, uint32_t indexCount);
@@ -0,0 +1,85 @@
+#include "GeometryPool.hpp"
+
+void GeometryPool::init( vk::Buffer _vertexBuffer, vk::DeviceSize vertexBufferSize, uint32_t _vertexStride
+                       , vk::Buffer _indexBuffer, vk::DeviceSize indexBufferSize
+                       , uint32_t _framesInFlight)
+{
+  vertexBuffer = _vertexBuffer;
+  indexBuffer = _indexBuffer;
+  vertexStride = _vertexStride;
+  framesInFlight = _framesInFlight;
+  frame = 0;
+
+  vertexRanges = FreeListAllocator(vertexBufferSize / vertexStride);
+  indexRanges = FreeListAllocator(indexBufferSize);
+  retired.clear();
+}
+
+void GeometryPool::destroy()
+{
+  vertexBuffer = nullptr;
+  indexBuffer = nullptr;
+  vertexRanges = FreeListAllocator();
+  indexRanges = FreeListAllocator();
+  retired.clear();
+}
+
+GeometryAllocation GeometryPool::allocate(uint32_t vertexCount, uint32_t indexCount, vk::IndexType indexType)
+{
+  uint32_t indexSize = getIndexSize(indexType);
+  uint64_t vertexOffset = vertexRanges.allocate(vertexCount, 1);
+  if (vertexOffset == FreeListAllocator::InvalidOffset) return GeometryAllocation();
+
+  uint64_t indexOffset = indexRanges.allocate(static_cast<uint64_t>(indexCount) * indexSize, indexSize);
+  if (indexOffset == FreeListAllocator::InvalidOffset)
+  {
+    vertexRanges.free(vertexOffset);
+    return GeometryAllocation();
+  }
+
+  GeometryAllocation allocation;
+  allocation.vertexOffset = static_cast<uint32_t>(vertexOffset);
+  allocation.vertexCount = vertexCount;
+  allocation.firstIndex = static_cast<uint32_t>(indexOffset / indexSize);
+  allocation.indexCount = indexCount;
+  allocation.indexType = indexType;
+  return allocation;
+}
+
+void GeometryPool::free(GeometryAllocation &allocation)
+{
+  if (!allocation) return;
+
+  retired.push_back({ allocation, frame });
+  allocation = GeometryAllocation();
+}
+
+void GeometryPool::beginFrame()
+{
+  frame++;
+
+  // Anything freed framesInFlight frames ago can't be drawn from any more
+  size_t kept = 0;
+  for (RetiredAllocation const &entry : retired)
+  {
+    if (frame - entry.frame >= framesInFlight)
+    {
+      vertexRanges.free(entry.allocation.vertexOffset);
+      indexRanges.free(getIndexByteOffset(entry.allocation));
+    }
+    else
+    {
+      retired[kept++] = entry;
+    }
+  }
+  retired.resize(kept);
+}
+
+void GeometryPool::printStats(std::ostream &out) const
+{
+  out << "Geometry pool: " << getMeshCount() << " meshes, "
+      << vertexRanges.getAllocatedSize() << "/" << vertexRanges.getSize() << " vertices ("
+      << vertexRanges.getFreeRangeCount() << " free ranges, largest " << vertexRanges.getLargestFreeRange() << "), "
+      << indexRanges.getAllocatedSize() << "/" << indexRanges.getSize() << " index bytes ("
+      << indexRanges.getFreeRangeCount() << " free ranges, largest " << indexRanges.getLargestFreeRange() << ")" << std::endl;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+#include "FreeListAllocator.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <ostream>
+
+// A mesh's ranges of the pool's buffers, in the units draws take
+struct GeometryAllocation
+{
+  uint32_t vertexOffset = 0; // In vertices, added to every index (drawIndexed's vertexOffset)
+  uint32_t vertexCount = 0;
+  uint32_t firstIndex = 0;   // In indices of indexType, with the index buffer bound at offset 0
+  uint32_t indexCount = 0;
+  vk::IndexType indexType = vk::IndexType::eUint16;
+
+  explicit operator bool() const { return vertexCount > 0; }
+};
+
+// Shared vertex and index buffers which meshes are sub-allocated from, so a whole scene binds its geometry once
+// (again only when the index type changes). The buffers are owned by the caller, device local with eTransferDst
+// and eVertexBuffer/eIndexBuffer usage. The pool just hands out ranges, the caller uploads into them.
+// Freed ranges are only reused once every frame in flight which might still draw from them has finished.
+class GeometryPool
+{
+public:
+  void init( vk::Buffer _vertexBuffer, vk::DeviceSize vertexBufferSize, uint32_t _vertexStride
+           , vk::Buffer _indexBuffer, vk::DeviceSize indexBufferSize
+           , uint32_t _framesInFlight);
+  void destroy();
+
+  // Returns an empty allocation if either buffer has no free range big enough
+  GeometryAllocation allocate(uint32_t vertexCount, uint32_t indexCount, vk::IndexType indexType);
+  void free(GeometryAllocation &allocation);
+
+  // Call once the frame slot about to be reused has finished on the GPU, retires the ranges freed framesInFlight frames ago
+  void beginFrame();
+
+  vk::Buffer getVertexBuffer() const { return vertexBuffer; }
+  vk::Buffer getIndexBuffer() const { return indexBuffer; }
+  vk::DeviceSize getVertexByteOffset(GeometryAllocation const &allocation) const { return static_cast<vk::DeviceSize>(allocation.vertexOffset) * vertexStride; }
+  vk::DeviceSize getIndexByteOffset(GeometryAllocation const &allocation) const { return static_cast<vk::DeviceSize>(allocation.firstIndex) * getIndexSize(allocation.indexType); }
+  static uint32_t getIndexSize(vk::IndexType indexType) { return indexType == vk::IndexType::eUint16 ? 2 : 4; }
+
+  size_t getMeshCount() const { return vertexRanges.getAllocationCount(); }
+  void printStats(std::ostream &out) const;
+
+private:
+  struct RetiredAllocation
+  {
+    GeometryAllocation allocation;
+    uint64_t frame;
+  };
+
+  vk::Buffer vertexBuffer;
+  vk::Buffer indexBuffer;
+  uint32_t vertexStride = 0;
+  uint32_t framesInFlight = 1;
+  uint64_t frame = 0;
+
+  FreeListAllocator vertexRanges; // In vertices, so every offset is a whole vertex
+  FreeListAllocator indexRanges;  // In bytes, aligned to the index size
+  std::vector<RetiredAllocation> retired;
+};
@@ -3,13 +3,30 @@
 
 // TODO: Check which exception throws are actually necessary given Vulkan-Hpp also checks for exceptions
 
+HelloTriangleApplication::HelloTriangleApplication(ApplicationSettings const &_settings)
+  : settings(_settings)
+  , framesInFlight(std::min(std::max(_settings.framesInFlight, 1U), MaxFramesInFlight))
+{
+}
+
 void HelloTriangleApplication::run()
 {
-  initWindow();
-  setupRenderables(); // Simple function to initialise vertices array
-  initVulkan();
-  mainLoop();
-  cleanup();
+  if (settings.headless)
+  {
+    // Whichever thread renders is worker 0 of the job system
+    jobSystem.init(settings.jobThreads);
+    setupRenderables(); // Simple function to initialise vertices array
+    initVulkan();
+    headlessLoop();
+    reportProfile();
+    cleanup();
+  }
+  else
+  {
+    initWindow();
+    setupRenderables();
+    mainLoop(); // Starts the render thread, which does everything else
+  }
 }
 
 void HelloTriangleApplication::setupRenderables()
@@ -20,18 +37,197 @@ void HelloTriangleApplication::setupRenderables()
     {{ 0.5f,  0.5f}, {0.0f, 1.0f, 0.0f}},
     {{-0.5f,  0.5f}, {0.0f, 0.0f, 1.0f}}
   };*/
-  // Square Vertices
-  vertices = {
-    {{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},
-    {{ 0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},
-    {{ 0.5f,  0.5f}, {0.0f, 0.0f, 1.0f}},
-    {{-0.5f,  0.5f}, {1.0f, 1.0f, 1.0f}}
-  };
+  if (!settings.meshPath.empty())
+  {
+    setupMesh();
+    return;
+  }
 
-  // Square Indices
-  indices = {
-    0, 1, 2, 2, 3, 0
-  };
+  // Grid of squares covering the same area as the single square, which is what a quad count of 1 gives.
+  // Indices are generated as 32 bit, chooseIndexLayout() packs them down to 16 bits where it can.
+  const uint32_t MaxQuads = 1 << 20;
+  uint32_t quadCount = std::min(std::max(settings.quadCount, 1U), MaxQuads);
+  uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(quadCount))));
+  float cellSize = 1.0f / gridSize;
+  float inset = gridSize > 1 ? cellSize * 0.1f : 0.0f;
+
+  vertices.clear();
+  indices.clear();
+  vertices.reserve(quadCount * 4);
+  indices.reserve(quadCount * 6);
+
+  for (uint32_t quad = 0; quad < quadCount; quad++)
+  {
+    float left = -0.5f + (quad % gridSize) * cellSize + inset;
+    float top = -0.5f + (quad / gridSize) * cellSize + inset;
+    float right = left + cellSize - 2.0f * inset;
+    float bottom = top + cellSize - 2.0f * inset;
+
+    uint32_t first = static_cast<uint32_t>(vertices.size());
+    vertices.push_back(Vertex::create({ left,  top },    { 1.0f, 0.0f, 0.0f }));
+    vertices.push_back(Vertex::create({ right, top },    { 0.0f, 1.0f, 0.0f }));
+    vertices.push_back(Vertex::create({ right, bottom }, { 0.0f, 0.0f, 1.0f }));
+    vertices.push_back(Vertex::create({ left,  bottom }, { 1.0f, 1.0f, 1.0f }));
+
+    for (uint32_t index : { 0, 1, 2, 2, 3, 0 })
+    {
+      indices.push_back(first + index);
+    }
+  }
+
+  vertexCount = static_cast<uint32_t>(vertices.size());
+  indexCount = static_cast<uint32_t>(indices.size());
+  drawFirstIndex = 0;
+  drawIndexCount = indexCount;
+  indicesPerPiece = 6;
+  chooseIndexLayout(indices.data());
+  setupDrawsAndInstances();
+}
+
+void HelloTriangleApplication::setupMesh()
+{
+  meshFile.open(settings.meshPath);
+
+  MeshFileHeader const &header = meshFile.getHeader();
+  if (header.vertexStride != sizeof(Vertex))
+  {
+    meshFile.close();
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Mesh file has a different vertex layout: " + settings.meshPath), "HelloTriangleApplication::setupMesh");
+  }
+
+  // Nothing is read yet, the streams go from the mapping straight into the staging ring when the buffers are created
+  MeshLod const &lod = meshFile.getLods()[std::min(settings.meshLod, meshFile.getLodCount() - 1)];
+  vertexCount = header.vertexCount;
+  indexCount = header.indexCount;
+  drawFirstIndex = lod.firstIndex;
+  drawIndexCount = lod.indexCount;
+  indicesPerPiece = 3;
+
+  // 16 bit files are drawn as they are, 32 bit ones get the same treatment as the grid
+  if (settings.optimizeMesh)
+  {
+    optimizeMesh();
+    chooseIndexLayout(indices.data());
+  }
+  else if (header.indexSize == sizeof(uint16_t))
+  {
+    indexLayout = IndexLayout();
+    indexLayout.indexType = vk::IndexType::eUint16;
+    indexLayout.subMeshes.push_back({ 0, indexCount, 0 });
+    indexLayout.indexCount = indexCount;
+    reportIndexLayout();
+  }
+  else
+  {
+    chooseIndexLayout(static_cast<uint32_t const*>(meshFile.getIndexData()));
+  }
+  setupDrawsAndInstances();
+}
+
+void HelloTriangleApplication::optimizeMesh()
+{
+  // The mapping is read only, so the mesh is copied out into vertices/indices and uploaded from there
+  MeshFileHeader const &header = meshFile.getHeader();
+  vertices.resize(vertexCount);
+  memcpy(vertices.data(), meshFile.getVertexData(), static_cast<size_t>(meshFile.getVertexDataSize()));
+  indices.resize(indexCount);
+  if (header.indexSize == sizeof(uint16_t))
+  {
+    uint16_t const *source = static_cast<uint16_t const*>(meshFile.getIndexData());
+    std::copy(source, source + indexCount, indices.begin());
+  }
+  else
+  {
+    memcpy(indices.data(), meshFile.getIndexData(), static_cast<size_t>(meshFile.getIndexDataSize()));
+  }
+  std::vector<MeshLod> lods(meshFile.getLods(), meshFile.getLods() + meshFile.getLodCount());
+  meshFile.close();
+
+  // Triangles only move within their own LOD, an LOD overlapping an earlier one is left alone. The vertex
+  // fetch order then follows every LOD, the drawn one is what gets reported.
+  runStatistics.vertexCacheBefore = analyzeVertexCache(indices.data() + drawFirstIndex, drawIndexCount, vertexCount);
+
+  std::sort(lods.begin(), lods.end(), [](MeshLod const &a, MeshLod const &b) { return a.firstIndex < b.firstIndex; });
+  uint32_t optimizedUpTo = 0;
+  for (MeshLod const &lod : lods)
+  {
+    if (lod.firstIndex < optimizedUpTo) continue;
+    optimizeVertexCache(indices.data() + lod.firstIndex, lod.indexCount, vertexCount);
+    optimizedUpTo = lod.firstIndex + lod.indexCount;
+  }
+
+  vertexCount = optimizeVertexFetch(vertices.data(), sizeof(Vertex), vertexCount, indices.data(), indices.size());
+  vertices.resize(vertexCount);
+  runStatistics.vertexCacheAfter = analyzeVertexCache(indices.data() + drawFirstIndex, drawIndexCount, vertexCount);
+
+  VertexCacheStats const &before = runStatistics.vertexCacheBefore;
+  VertexCacheStats const &after = runStatistics.vertexCacheAfter;
+  std::cout << "Vertex cache: ACMR " << before.acmr << " -> " << after.acmr
+            << ", ATVR " << before.atvr << " -> " << after.atvr
+            << " (" << before.verticesTransformed << " -> " << after.verticesTransformed << " vertex shader invocations)" << std::endl;
+}
+
+void HelloTriangleApplication::chooseIndexLayout(uint32_t const *source)
+{
+  indexLayout = IndexLayoutBuilder::choose(source, indexCount);
+  reportIndexLayout();
+}
+
+void HelloTriangleApplication::reportIndexLayout()
+{
+  // Every instance reads the drawn range again, so that's what each frame saves in index fetches
+  uint64_t bytesSavedPerFrame = static_cast<uint64_t>(drawIndexCount) * (4 - indexLayout.getIndexSize()) * std::max(settings.instanceCount, 1U);
+
+  runStatistics.indexBits = indexLayout.getIndexSize() * 8;
+  runStatistics.subMeshCount = static_cast<uint32_t>(indexLayout.subMeshes.size());
+  runStatistics.indexBytes = indexLayout.getSize();
+  runStatistics.indexBytesSaved = indexLayout.getSizeSaved();
+  runStatistics.indexBytesSavedPerFrame = bytesSavedPerFrame;
+
+  double kilobytes = indexLayout.getSize() / 1024.0;
+  std::cout << "Indices: " << indexLayout.getIndexSize() * 8 << " bit, " << indexLayout.subMeshes.size() << " sub-mesh(es), "
+            << kilobytes << " KB (" << indexLayout.getSizeSaved() / 1024.0 << " KB smaller than 32 bit, "
+            << bytesSavedPerFrame / 1024.0 << " KB less read per frame)" << std::endl;
+}
+
+void HelloTriangleApplication::setupDrawsAndInstances()
+{
+  // Draws split the range on whole pieces
+  uint32_t pieceCount = std::max(drawIndexCount / indicesPerPiece, 1U);
+  drawCount = std::min(std::max(settings.drawCount, 1U), pieceCount);
+
+  runStatistics.vertexCount = vertexCount;
+  runStatistics.vertexBytes = static_cast<uint64_t>(vertexCount) * MeshVertexLayout.stride;
+  runStatistics.indexCount = indexCount;
+  runStatistics.drawCount = drawCount;
+
+  // Every draw is repeated for each instance, laid out by updateInstanceBuffer()
+  instanceCount = std::max(settings.instanceCount, 1U);
+  instances.resize(instanceCount);
+  runStatistics.instanceCount = instanceCount;
+
+  transformKernels = &getTransformKernels(std::min(detectSimdLevel(), settings.maxSimdLevel));
+  std::cout << "Transform kernels: " << getSimdLevelName(transformKernels->level) << std::endl;
+
+  // Shrink the mesh into a grid of cells, each copy spins about its own centre at its own rate. Only the models
+  // are updated each frame, the bounds are left empty as the CPU never culls instances.
+  uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(instanceCount))));
+  float cellSize = 1.0f / gridSize;
+  instanceTransforms.resize(instanceCount);
+  for (uint32_t i = 0; i < instanceCount; i++)
+  {
+    instanceTransforms.positionX[i] = -0.5f + ((i % gridSize) + 0.5f) * cellSize;
+    instanceTransforms.positionY[i] = -0.5f + ((i / gridSize) + 0.5f) * cellSize;
+    instanceTransforms.positionZ[i] = 0.0f;
+    instanceTransforms.scaleX[i] = cellSize;
+    instanceTransforms.scaleY[i] = cellSize;
+    instanceTransforms.scaleZ[i] = 1.0f;
+    instanceTransforms.spin[i] = 0.5f + (i % 7) * 0.25f;
+  }
+  runStatistics.framesInFlight = framesInFlight;
+
+  // Direct draws are recorded on the CPU, which never sees what the GPU culled
+  cullingEnabled = settings.gpuCulling && settings.indirectDraws;
 }
 
 void HelloTriangleApplication::initWindow()
@@ -45,6 +241,7 @@ void HelloTriangleApplication::initWindow()
     glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
     window = glfwCreateWindow(WindowWidth, WindowHeight, "Leonard", nullptr, nullptr);
+    windowExtent = vk::Extent2D(WindowWidth, WindowHeight);
     glfwSetWindowUserPointer(window, this);
     glfwSetWindowSizeCallback(window, HelloTriangleApplication::glfwOnWindowResized);
   }
@@ -54,27 +251,61 @@ void HelloTriangleApplication::initWindow()
   }
 }
 
+void HelloTriangleApplication::cleanupWindow()
+{
+  if (window) glfwDestroyWindow(window);
+  window = nullptr;
+  glfwTerminate();
+}
+
 void HelloTriangleApplication::initVulkan()
 {
   createInstance();
   setupDebugCallback();
-  createSurface();
+  if (!settings.headless) createSurface();
   pickPhysicalDevice();
   createLogicalDevice();
-  createSwapChain();
+  memoryAllocator.init(physicalDevice, device);
+  descriptorAllocator.init(device, framesInFlight);
+  createPipelineCache();
+  createProfiler();
+  if (settings.headless)
+  {
+    createOffscreenTargets();
+  }
+  else
+  {
+    createSwapChain();
+  }
   createImageViews();
   createRenderPass();
   createDescriptorSetLayout();
+  createPipelineLayout();
   createGraphicsPipeline();
+  if (cullingEnabled) createCullingPipeline();
   createFramebuffers();
   createCommandPool();
-  createVertexBuffer();
-  createIndexBuffer();
+  createUploadQueue();
+  createGeometryPool();
+  uploadVertices();
+  uploadIndices();
+  createDrawCommands();
+  if (cullingEnabled) createCullingBuffers();
+  meshFile.close(); // Both streams are in the staging ring already
+  geometryUploadTicket = uploadQueue.flush();
   createUniformBuffer();
-  createDescriptorPool();
+  createInstanceBuffer();
   createDescriptorSet();
   createCommandBuffers();
-  createSemaphores();
+  createFrameContexts();
+
+  // The geometry copies have been running alongside everything above, they just need to land before the first frame
+  uploadQueue.wait(geometryUploadTicket);
+
+#if defined(_DEBUG)
+  memoryAllocator.printStats(std::cout);
+  geometryPool.printStats(std::cout);
+#endif // defined(_DEBUG)
 }
 
 bool HelloTriangleApplication::checkValidationLayerSupport()
@@ -109,13 +340,17 @@ std::vector<const char*> HelloTriangleApplication::getRequiredExtensions()
 {
   std::vector<const char*> extensions;
 
-  uint32_t glfwExtensionCount = 0;
-  const char **glfwExtensions;
-  glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-  for (uint32_t i = 0; i < glfwExtensionCount; i++)
+  // Headless doesn't need any of the surface extensions GLFW asks for
+  if (!settings.headless)
   {
-    extensions.push_back(glfwExtensions[i]);
+    uint32_t glfwExtensionCount = 0;
+    const char **glfwExtensions;
+    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+
+    for (uint32_t i = 0; i < glfwExtensionCount; i++)
+    {
+      extensions.push_back(glfwExtensions[i]);
+    }
   }
 
   if (enableValidationLayers)
@@ -133,8 +368,11 @@ void HelloTriangleApplication::listAvailableExtensions()
 
   // Get glfw required extensions
   uint32_t glfwExtensionCount = 0;
-  const char **glfwExtensions;
-  glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+  const char **glfwExtensions = nullptr;
+  if (!settings.headless)
+  {
+    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+  }
 
   // List extensions
   std::cout << "Available Extensions:" << std::endl;
@@ -273,8 +511,9 @@ bool HelloTriangleApplication::isDeviceSuitable(vk::PhysicalDevice device)
 
   bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-  bool swapChainAdequate = false;
-  if (extensionsSupported)
+  // Headless has no surface to check against, a graphics queue is enough
+  bool swapChainAdequate = settings.headless;
+  if (extensionsSupported && !settings.headless)
   {
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
     swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
@@ -306,7 +545,11 @@ bool HelloTriangleApplication::checkDeviceExtensionSupport(vk::PhysicalDevice de
     throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to enumerate device extension properties!"), e);
   }
 
-  std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+  std::set<std::string> requiredExtensions(drawDeviceExtensions.begin(), drawDeviceExtensions.end());
+  if (!settings.headless)
+  {
+    requiredExtensions.insert(deviceExtensions.begin(), deviceExtensions.end());
+  }
 
   for (const auto &extensions : availableExtensions)
   {
@@ -375,9 +618,8 @@ vk::Extent2D HelloTriangleApplication::chooseSwapExtent(const vk::SurfaceCapabil
   }
   else
   {
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    vk::Extent2D actualExtent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+    // GLFW can only be asked on the window thread, so go by the last size it posted
+    vk::Extent2D actualExtent = windowExtent;
 
     actualExtent.width = std::max(capabilities.minImageExtent.width, std::min(capabilities.maxImageExtent.width, actualExtent.width));
     actualExtent.height = std::max(capabilities.minImageExtent.height, std::min(capabilities.maxImageExtent.height, actualExtent.height));
@@ -398,6 +640,19 @@ HelloTriangleApplication::QueueFamilyIndices HelloTriangleApplication::findQueue
     if (queueFamily.queueCount > 0 && queueFamily.queueFlags & vk::QueueFlagBits::eGraphics)
     {
       indices.graphicsFamily = i;
+
+      // Nothing gets presented in headless mode, so the graphics queue doubles as the "present" queue
+      if (settings.headless)
+      {
+        indices.presentFamily = i;
+        break;
+      }
+    }
+
+    if (settings.headless)
+    {
+      i++;
+      continue;
     }
 
     vk::Bool32 presentSupport;
@@ -416,10 +671,35 @@ HelloTriangleApplication::QueueFamilyIndices HelloTriangleApplication::findQueue
     i++;
   }
 
+  // Prefer a transfer only family (usually a DMA engine) so uploads don't compete with rendering
+  for (uint32_t j = 0; j < queueFamilies.size(); j++)
+  {
+    vk::QueueFlags flags = queueFamilies[j].queueFlags;
+    if (queueFamilies[j].queueCount > 0 
+     && (flags & vk::QueueFlagBits::eTransfer)
+     && !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)))
+    {
+      indices.transferFamily = static_cast<int>(j);
+      break;
+    }
+  }
+  if (indices.transferFamily < 0)
+  {
+    indices.transferFamily = indices.graphicsFamily;
+  }
+
   return indices;
 }
 
 uint32_t HelloTriangleApplication::findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties)
+{
+  uint32_t memoryTypeIndex;
+  if (tryFindMemoryType(typeFilter, properties, memoryTypeIndex)) return memoryTypeIndex;
+
+  throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to find suitable memory type!"), "findMemoryType");
+}
+
+bool HelloTriangleApplication::tryFindMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties, uint32_t &memoryTypeIndex)
 {
   vk::PhysicalDeviceMemoryProperties memProperties;
   memProperties = physicalDevice.getMemoryProperties();
@@ -429,11 +709,11 @@ uint32_t HelloTriangleApplication::findMemoryType(uint32_t typeFilter, vk::Memor
     if ((typeFilter & (1 << i))
     && ((memProperties.memoryTypes[i].propertyFlags & properties) == properties))
     {
-      return i;
+      memoryTypeIndex = i;
+      return true;
     }
   }
-
-  throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to find suitable memory type!"), "findMemoryType");
+  return false;
 }
 
 void HelloTriangleApplication::createLogicalDevice()
@@ -441,7 +721,7 @@ void HelloTriangleApplication::createLogicalDevice()
   QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
   std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
-  std::set<int> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily };
+  std::set<int> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily, indices.transferFamily };
 
   float queuePriority = 1.f;
   for (int queueFamily : uniqueQueueFamilies)
@@ -453,14 +733,40 @@ void HelloTriangleApplication::createLogicalDevice()
     queueCreateInfos.push_back(queueCreateInfo);
   }
 
+  // Multi draw indirect and the draw count extension are used when there, draws fall back on one command per call
+  vk::PhysicalDeviceFeatures supportedFeatures = physicalDevice.getFeatures();
   vk::PhysicalDeviceFeatures deviceFeatures;
+  deviceFeatures.setMultiDrawIndirect(supportedFeatures.multiDrawIndirect);
+  multiDrawIndirectSupported = supportedFeatures.multiDrawIndirect == VK_TRUE;
+  maxDrawIndirectCount = multiDrawIndirectSupported ? std::max(physicalDevice.getProperties().limits.maxDrawIndirectCount, 1U) : 1;
+
+  // Culled commands point firstInstance at their list of visible instances, which indirect draws only allow with this
+  if (cullingEnabled && !supportedFeatures.drawIndirectFirstInstance)
+  {
+    std::cout << "GPU culling needs drawIndirectFirstInstance, culling is off" << std::endl;
+    cullingEnabled = false;
+  }
+  deviceFeatures.setDrawIndirectFirstInstance(cullingEnabled ? VK_TRUE : VK_FALSE);
+
+  std::vector<const char*> enabledExtensions = drawDeviceExtensions;
+  if (!settings.headless)
+  {
+    enabledExtensions.insert(enabledExtensions.end(), deviceExtensions.begin(), deviceExtensions.end());
+  }
+
+  drawIndirectCountSupported = false;
+  for (auto const &extension : physicalDevice.enumerateDeviceExtensionProperties())
+  {
+    if (strcmp(extension.extensionName, VK_AMD_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0) drawIndirectCountSupported = true;
+  }
+  if (drawIndirectCountSupported) enabledExtensions.push_back(VK_AMD_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
   
   vk::DeviceCreateInfo createInfo;
   createInfo.setPQueueCreateInfos(queueCreateInfos.data())
             .setQueueCreateInfoCount(static_cast<uint32_t>(queueCreateInfos.size()))
             .setPEnabledFeatures(&deviceFeatures)
-            .setEnabledExtensionCount(static_cast<uint32_t>(deviceExtensions.size()))
-            .setPpEnabledExtensionNames(deviceExtensions.data());
+            .setEnabledExtensionCount(static_cast<uint32_t>(enabledExtensions.size()))
+            .setPpEnabledExtensionNames(enabledExtensions.data());
 
   if (enableValidationLayers)
   {
@@ -482,8 +788,13 @@ void HelloTriangleApplication::createLogicalDevice()
     throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create logical device!"), e);
   }
 
+  if (drawIndirectCountSupported) LoadDrawIndirectCountFuncs(device);
+
   graphicsQueue = device.getQueue(indices.graphicsFamily, 0);
   presentQueue = device.getQueue(indices.presentFamily, 0);
+  transferQueue = device.getQueue(indices.transferFamily, 0);
+  graphicsQueueFamily = static_cast<uint32_t>(indices.graphicsFamily);
+  transferQueueFamily = static_cast<uint32_t>(indices.transferFamily);
 }
 
 void HelloTriangleApplication::createSurface()
@@ -496,13 +807,22 @@ void HelloTriangleApplication::createSurface()
   }
 }
 
-void HelloTriangleApplication::createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties, vk::Buffer & buffer, vk::DeviceMemory & bufferMemory)
+void HelloTriangleApplication::createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties, vk::Buffer & buffer, MemoryAllocation & bufferAllocation, vk::MemoryPropertyFlags preferredProperties)
 {
   vk::BufferCreateInfo bufferInfo = {};
   bufferInfo.setSize(size)
             .setUsage(usage)
             .setSharingMode(vk::SharingMode::eExclusive);
 
+  // Uploads land from the transfer queue, share those buffers rather than transferring ownership on every upload
+  uint32_t queueFamilyIndices[] = { graphicsQueueFamily, transferQueueFamily };
+  if ((usage & vk::BufferUsageFlagBits::eTransferDst) && graphicsQueueFamily != transferQueueFamily)
+  {
+    bufferInfo.setSharingMode(vk::SharingMode::eConcurrent)
+              .setQueueFamilyIndexCount(2)
+              .setPQueueFamilyIndices(queueFamilyIndices);
+  }
+
   try
   {
     buffer = device.createBuffer(bufferInfo);
@@ -516,13 +836,16 @@ void HelloTriangleApplication::createBuffer(vk::DeviceSize size, vk::BufferUsage
   vk::MemoryRequirements memRequirements;
   memRequirements = device.getBufferMemoryRequirements(buffer);
 
-  vk::MemoryAllocateInfo allocInfo = {};
-  allocInfo.setAllocationSize(memRequirements.size)
-           .setMemoryTypeIndex(findMemoryType(memRequirements.memoryTypeBits, properties));
+  // Preferred properties are only a hint, fall back on whatever has the required ones
+  uint32_t memoryTypeIndex;
+  if (!preferredProperties || !tryFindMemoryType(memRequirements.memoryTypeBits, properties | preferredProperties, memoryTypeIndex))
+  {
+    memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+  }
 
   try
   {
-    bufferMemory = device.allocateMemory(allocInfo);
+    bufferAllocation = memoryAllocator.allocate(memRequirements, memoryTypeIndex, true);
   }
   catch (std::system_error const &e)
   {
@@ -530,48 +853,7 @@ void HelloTriangleApplication::createBuffer(vk::DeviceSize size, vk::BufferUsage
     throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to allocate vertex buffer memory!"), e);
   }
 
-  device.bindBufferMemory(buffer, bufferMemory, 0);
-}
-
-void HelloTriangleApplication::copyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size)
-{
-  vk::CommandBufferAllocateInfo allocInfo = {};
-  allocInfo.setLevel(vk::CommandBufferLevel::ePrimary)
-           .setCommandPool(commandPool)
-           .setCommandBufferCount(1);
-
-  vk::CommandBuffer commandBuffer;
-  device.allocateCommandBuffers(&allocInfo, &commandBuffer);
-
-  vk::CommandBufferBeginInfo beginInfo = {};
-  beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-
-  commandBuffer.begin(beginInfo);
-  
-  vk::BufferCopy copyRegion = {};
-  copyRegion.setSrcOffset(0)
-            .setDstOffset(0)
-            .setSize(size);
-  commandBuffer.copyBuffer(srcBuffer, dstBuffer, 1, &copyRegion);
-
-  commandBuffer.end();
-
-  vk::SubmitInfo submitInfo = {};
-  submitInfo.setCommandBufferCount(1)
-            .setPCommandBuffers(&commandBuffer);
-
-  try 
-  { 
-    graphicsQueue.submit(1, &submitInfo, nullptr); 
-    graphicsQueue.waitIdle(); 
-  }
-  catch (std::system_error const &e) 
-  { 
-    cleanup(); 
-    throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to submit copy buffer command to graphics queue!"), e); 
-  }
-
-  device.freeCommandBuffers(commandPool, 1, &commandBuffer);
+  device.bindBufferMemory(buffer, bufferAllocation.memory, bufferAllocation.offset);
 }
 
 void HelloTriangleApplication::createSwapChain()
@@ -618,8 +900,10 @@ void HelloTriangleApplication::createSwapChain()
             .setCompositeAlpha(vk::CompositeAlphaFlagBitsKHR::eOpaque)
             .setPresentMode(presentMode)
             .setClipped(true)
-            .setOldSwapchain(nullptr);
+            .setOldSwapchain(swapChain);
 
+  // Handing over the old swap chain (if any) lets the driver reuse its resources on resize
+  vk::SwapchainKHR oldSwapChain = swapChain;
   try
   {
     swapChain = device.createSwapchainKHR(createInfo);
@@ -629,6 +913,7 @@ void HelloTriangleApplication::createSwapChain()
     cleanup();
     throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create swap chain!"), e);
   }
+  if (oldSwapChain) device.destroySwapchainKHR(oldSwapChain);
 
   try { swapChainImages = device.getSwapchainImagesKHR(swapChain); }
   catch (std::system_error const &e) 
@@ -640,6 +925,109 @@ void HelloTriangleApplication::createSwapChain()
   swapChainExtent = extent;
 }
 
+void HelloTriangleApplication::createOffscreenTargets()
+{
+  // One offscreen image per frame in flight, these take the place of the swap chain images so the
+  // image views, framebuffers and command buffers are built exactly as they would be with a window
+  swapChainImageFormat = vk::Format::eR8G8B8A8Unorm;
+  swapChainExtent = vk::Extent2D(WindowWidth, WindowHeight);
+
+  swapChainImages.resize(framesInFlight);
+  offscreenImageAllocations.resize(framesInFlight);
+
+  for (uint32_t i = 0; i < framesInFlight; i++)
+  {
+    vk::ImageCreateInfo imageInfo;
+    imageInfo.setImageType(vk::ImageType::e2D)
+             .setFormat(swapChainImageFormat)
+             .setExtent({ swapChainExtent.width, swapChainExtent.height, 1 })
+             .setMipLevels(1)
+             .setArrayLayers(1)
+             .setSamples(vk::SampleCountFlagBits::e1)
+             .setTiling(vk::ImageTiling::eOptimal)
+             .setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc)
+             .setSharingMode(vk::SharingMode::eExclusive)
+             .setInitialLayout(vk::ImageLayout::eUndefined);
+
+    try
+    {
+      swapChainImages[i] = device.createImage(imageInfo);
+    }
+    catch (std::system_error const &e)
+    {
+      cleanup();
+      throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create offscreen image!"), e);
+    }
+
+    vk::MemoryRequirements memRequirements = device.getImageMemoryRequirements(swapChainImages[i]);
+
+    try
+    {
+      offscreenImageAllocations[i] = memoryAllocator.allocate(memRequirements, findMemoryType(memRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal), false);
+    }
+    catch (std::system_error const &e)
+    {
+      cleanup();
+      throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to allocate offscreen image memory!"), e);
+    }
+
+    device.bindImageMemory(swapChainImages[i], offscreenImageAllocations[i].memory, offscreenImageAllocations[i].offset);
+  }
+
+  if (settings.readbackMode == ReadbackMode::Disabled) return;
+
+  if (settings.readbackMode == ReadbackMode::Hash) frameHashes.assign(settings.frameCount, 0);
+
+  uint32_t slotCount = framesInFlight + ExtraReadbackSlots;
+  try
+  {
+    frameReadback.init( device, graphicsQueue, jobSystem, swapChainExtent, slotCount
+                      , physicalDevice.getProperties().limits.nonCoherentAtomSize
+                      , [this](ReadbackFrame const &frame) { consumeReadbackFrame(frame); });
+  }
+  catch (std::system_error const &e)
+  {
+    cleanup();
+    throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create readback fences!"), e);
+  }
+
+  readbackBuffers.resize(slotCount);
+  readbackBufferAllocations.resize(slotCount);
+  vk::PhysicalDeviceMemoryProperties memProperties = physicalDevice.getMemoryProperties();
+  for (uint32_t i = 0; i < slotCount; i++)
+  {
+    // Only the CPU reads these, and it reads every byte, so cached memory is worth having when there is some.
+    // Host visible allocations stay mapped, so the consumer reads straight out of readbackBufferAllocations[i].mapped
+    createBuffer( frameReadback.getFrameSize()
+                , vk::BufferUsageFlagBits::eTransferDst
+                , vk::MemoryPropertyFlagBits::eHostVisible
+                , readbackBuffers[i], readbackBufferAllocations[i]
+                , vk::MemoryPropertyFlagBits::eHostCached);
+
+    vk::MemoryPropertyFlags flags = memProperties.memoryTypes[readbackBufferAllocations[i].memoryTypeIndex].propertyFlags;
+    frameReadback.setSlotStorage(i, readbackBuffers[i], readbackBufferAllocations[i], static_cast<bool>(flags & vk::MemoryPropertyFlagBits::eHostCoherent));
+  }
+}
+
+void HelloTriangleApplication::cleanupOffscreenTargets()
+{
+  if (device) frameReadback.destroy();
+  for (size_t i = 0; i < readbackBuffers.size(); i++)
+  {
+    if (readbackBuffers[i]) device.destroyBuffer(readbackBuffers[i]);
+    memoryAllocator.free(readbackBufferAllocations[i]);
+  }
+  for (size_t i = 0; i < offscreenImageAllocations.size(); i++)
+  {
+    if (swapChainImages[i]) device.destroyImage(swapChainImages[i]);
+    memoryAllocator.free(offscreenImageAllocations[i]);
+  }
+  readbackBuffers.clear();
+  readbackBufferAllocations.clear();
+  offscreenImageAllocations.clear();
+  swapChainImages.clear();
+}
+
 void HelloTriangleApplication::createImageViews()
 {
   swapChainImageViews.resize(swapChainImages.size());
@@ -678,37 +1066,100 @@ void HelloTriangleApplication::createImageViews()
 
 void HelloTriangleApplication::createDescriptorSetLayout()
 {
-  vk::DescriptorSetLayoutBinding uboLayoutBinding = {};
-  uboLayoutBinding.setBinding(0)
-                  .setDescriptorType(vk::DescriptorType::eUniformBuffer)
-                  .setDescriptorCount(1)
-                  .setStageFlags(vk::ShaderStageFlagBits::eVertex)
-                  .setPImmutableSamplers(nullptr);
+  // Binding 0 is this frame's objects, binding 1 the object each draw command draws, binding 2 this frame's camera,
+  // binding 3 this frame's instances and binding 4 the instances each command draws
+  vk::DescriptorSetLayoutBinding layoutBindings[5];
+  layoutBindings[0].setBinding(0)
+                   .setDescriptorType(vk::DescriptorType::eStorageBufferDynamic)
+                   .setDescriptorCount(1)
+                   .setStageFlags(vk::ShaderStageFlagBits::eVertex)
+                   .setPImmutableSamplers(nullptr);
+  layoutBindings[1].setBinding(1)
+                   .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                   .setDescriptorCount(1)
+                   .setStageFlags(vk::ShaderStageFlagBits::eVertex)
+                   .setPImmutableSamplers(nullptr);
+  layoutBindings[2].setBinding(2)
+                   .setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
+                   .setDescriptorCount(1)
+                   .setStageFlags(vk::ShaderStageFlagBits::eVertex)
+                   .setPImmutableSamplers(nullptr);
+  layoutBindings[3].setBinding(3)
+                   .setDescriptorType(vk::DescriptorType::eStorageBufferDynamic)
+                   .setDescriptorCount(1)
+                   .setStageFlags(vk::ShaderStageFlagBits::eVertex)
+                   .setPImmutableSamplers(nullptr);
+  layoutBindings[4].setBinding(4)
+                   .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                   .setDescriptorCount(1)
+                   .setStageFlags(vk::ShaderStageFlagBits::eVertex)
+                   .setPImmutableSamplers(nullptr);
 
   vk::DescriptorSetLayoutCreateInfo layoutInfo = {};
-  layoutInfo.setBindingCount(1)
-    .setPBindings(&uboLayoutBinding);
+  layoutInfo.setBindingCount(5)
+    .setPBindings(layoutBindings);
 
   try
   {
-    descriptorSetLayout = device.createDescriptorSetLayout(layoutInfo);
+    descriptorSetLayout = descriptorAllocator.getLayout(layoutInfo);
   }
   catch (std::system_error const &e)
   {
     cleanup();
     throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create descriptor set layout!"), e);
   }
+  catch (UnrecoverableRuntimeException const &)
+  {
+    cleanup();
+    throw;
+  }
+
+  if (!cullingEnabled) return;
+
+  // Objects and instances as above, then bounds, every command and its object, the visible commands, their
+  // objects and their count, and how many of each command's instances are visible and which. See cull.comp.
+  vk::DescriptorSetLayoutBinding cullingBindings[CullingBindingCount];
+  for (uint32_t binding = 0; binding < CullingBindingCount; binding++)
+  {
+    cullingBindings[binding].setBinding(binding)
+                            .setDescriptorType(binding < 2 ? vk::DescriptorType::eStorageBufferDynamic : vk::DescriptorType::eStorageBuffer)
+                            .setDescriptorCount(1)
+                            .setStageFlags(vk::ShaderStageFlagBits::eCompute)
+                            .setPImmutableSamplers(nullptr);
+  }
+
+  vk::DescriptorSetLayoutCreateInfo cullingLayoutInfo = {};
+  cullingLayoutInfo.setBindingCount(CullingBindingCount)
+    .setPBindings(cullingBindings);
+
+  try
+  {
+    cullingDescriptorSetLayout = descriptorAllocator.getLayout(cullingLayoutInfo);
+  }
+  catch (std::system_error const &e)
+  {
+    cleanup();
+    throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create culling descriptor set layout!"), e);
+  }
+  catch (UnrecoverableRuntimeException const &)
+  {
+    cleanup();
+    throw;
+  }
 }
 
 void HelloTriangleApplication::createGraphicsPipeline()
 {
   vk::ShaderModule vertShaderModule;
   vk::ShaderModule fragShaderModule;
-  auto vertShaderCode = readBinaryFile("shaders/triangle.vert.spv");
-  auto fragShaderCode = readBinaryFile("shaders/triangle.frag.spv");
+  // Mapped rather than read, SPIR-V needs 4 byte alignment and mappings are page aligned
+  MappedFile vertShaderCode;
+  MappedFile fragShaderCode;
+  vertShaderCode.open("shaders/triangle.vert.spv");
+  fragShaderCode.open("shaders/triangle.frag.spv");
 #if defined(_DEBUG)
-  std::cout << "Vert shader code size: " << vertShaderCode.size() << std::endl;
-  std::cout << "Frag shader code size: " << fragShaderCode.size() << std::endl;
+  std::cout << "Vert shader code size: " << vertShaderCode.getSize() << std::endl;
+  std::cout << "Frag shader code size: " << fragShaderCode.getSize() << std::endl;
 #endif // defined(_DEBUG)
 
   vertShaderModule = createShaderModule(vertShaderCode);
@@ -726,8 +1177,9 @@ void HelloTriangleApplication::createGraphicsPipeline()
 
   vk::PipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragshaderStageInfo };
 
-  auto bindingDescription = Vertex::getBindingDescription();
-  auto attributeDescriptions = Vertex::getAttributeDescriptions();
+  // Instances come out of a storage buffer rather than a vertex binding, culling picks which ones each command draws
+  vk::VertexInputBindingDescription bindingDescription = MeshVertexLayout.getBindingDescription(Vertex::Binding);
+  auto attributeDescriptions = MeshVertexLayout.getAttributeDescriptions(Vertex::Binding);
 
   vk::PipelineVertexInputStateCreateInfo vertexInputInfo;
   vertexInputInfo.setVertexBindingDescriptionCount(1)
@@ -739,23 +1191,12 @@ void HelloTriangleApplication::createGraphicsPipeline()
   inputAssembly.setTopology(vk::PrimitiveTopology::eTriangleList)
                .setPrimitiveRestartEnable(false);
 
-  vk::Viewport viewport;
-  viewport.setX(0.f)
-          .setY(0.f)
-          .setWidth(static_cast<float>(swapChainExtent.width))
-          .setHeight(static_cast<float>(swapChainExtent.height))
-          .setMinDepth(0.f)
-          .setMaxDepth(1.f);
-
-  vk::Rect2D scissor;
-  scissor.setOffset({ 0,0 })
-         .setExtent(swapChainExtent);
-
+  // Viewport and scissor are dynamic so the pipeline doesn't depend on the swap chain extent
   vk::PipelineViewportStateCreateInfo viewportState;
   viewportState.setViewportCount(1)
-               .setPViewports(&viewport)
+               .setPViewports(nullptr)
                .setScissorCount(1)
-               .setPScissors(&scissor);
+               .setPScissors(nullptr);
 
   vk::PipelineRasterizationStateCreateInfo rasterizer;
   rasterizer.setDepthClampEnable(false)
@@ -807,30 +1248,13 @@ void HelloTriangleApplication::createGraphicsPipeline()
   std::vector<vk::DynamicState> dynamicStates =
   {
     vk::DynamicState::eViewport,
-    vk::DynamicState::eLineWidth
+    vk::DynamicState::eScissor
   };
 
   vk::PipelineDynamicStateCreateInfo dynamicState;
   dynamicState.setDynamicStateCount(static_cast<uint32_t>(dynamicStates.size()))
     .setPDynamicStates(dynamicStates.data());
 
-  
-  vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
-  pipelineLayoutInfo.setSetLayoutCount(1)
-                    .setPSetLayouts(&descriptorSetLayout)
-                    .setPushConstantRangeCount(0)
-                    .setPPushConstantRanges(0);
-  
-  try
-  {
-    pipelineLayout = device.createPipelineLayout(pipelineLayoutInfo);
-  }
-  catch (std::system_error const &e)
-  {
-    cleanup();
-    throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create pipeline layout!"), e);
-  }
-
   vk::GraphicsPipelineCreateInfo pipelineInfo;
   pipelineInfo.setStageCount(2)
               .setPStages(shaderStages)
@@ -841,7 +1265,7 @@ void HelloTriangleApplication::createGraphicsPipeline()
               .setPMultisampleState(&multisampling)
               .setPDepthStencilState(nullptr)
               .setPColorBlendState(&colorBlending)
-              .setPDynamicState(nullptr)
+              .setPDynamicState(&dynamicState)
               .setLayout(pipelineLayout)
               .setRenderPass(renderPass)
               .setSubpass(0)
@@ -850,7 +1274,9 @@ void HelloTriangleApplication::createGraphicsPipeline()
 
   try
   {
-    graphicsPipeline = device.createGraphicsPipeline(nullptr, pipelineInfo);
+    pipelineCache.beginPipelineBuild();
+    graphicsPipeline = device.createGraphicsPipeline(pipelineCache.get(), pipelineInfo);
+    pipelineCache.endPipelineBuild();
   }
   catch (std::system_error const &e)
   {
@@ -862,60 +1288,216 @@ void HelloTriangleApplication::createGraphicsPipeline()
   device.destroyShaderModule(fragShaderModule);
 }
 
-void HelloTriangleApplication::createRenderPass()
+void HelloTriangleApplication::createCullingPipeline()
 {
-  vk::AttachmentDescription colorAttachment;
-  colorAttachment.setFormat(swapChainImageFormat)
-                 .setSamples(vk::SampleCountFlagBits::e1)
-                 .setLoadOp(vk::AttachmentLoadOp::eClear)
-                 .setStoreOp(vk::AttachmentStoreOp::eStore)
-                 .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
-                 .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
-                 .setInitialLayout(vk::ImageLayout::eUndefined)
-                 .setFinalLayout(vk::ImageLayout::ePresentSrcKHR);
-
-  vk::AttachmentReference colorAttachmentRef;
-  colorAttachmentRef.setAttachment(0) // corresponds to layout(location = 0) in fragment shader
-                    .setLayout(vk::ImageLayout::eColorAttachmentOptimal);
-
-  vk::SubpassDescription subpass;
-  subpass.setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
-         .setColorAttachmentCount(1)
-         .setPColorAttachments(&colorAttachmentRef);
-
-  vk::SubpassDependency dependency;
-  dependency.setSrcSubpass(VK_SUBPASS_EXTERNAL)
-            .setDstSubpass(0)
-            .setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
-            .setSrcAccessMask(vk::AccessFlags())
-            .setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
-            .setDstAccessMask(vk::AccessFlagBits::eColorAttachmentRead
-                            | vk::AccessFlagBits::eColorAttachmentWrite);
+  if (!cullPushConstants.fits(physicalDevice.getProperties().limits))
+  {
+    cleanup();
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Culling push constants don't fit in maxPushConstantsSize!"), "createCullingPipeline");
+  }
+  vk::PushConstantRange pushConstantRange = cullPushConstants.getRange();
 
-  vk::RenderPassCreateInfo renderPassInfo;
-  renderPassInfo.setAttachmentCount(1)
-                .setPAttachments(&colorAttachment)
-                .setSubpassCount(1)
-                .setPSubpasses(&subpass)
-                .setDependencyCount(1)
-                .setPDependencies(&dependency);
+  vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
+  pipelineLayoutInfo.setSetLayoutCount(1)
+                    .setPSetLayouts(&cullingDescriptorSetLayout)
+                    .setPushConstantRangeCount(1)
+                    .setPPushConstantRanges(&pushConstantRange);
 
   try
   {
-    renderPass = device.createRenderPass(renderPassInfo);
+    cullingPipelineLayout = device.createPipelineLayout(pipelineLayoutInfo);
   }
   catch (std::system_error const &e)
   {
     cleanup();
-    throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create render pass!"), e);
+    throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create culling pipeline layout!"), e);
+  }
+
+  MappedFile shaderCode;
+  shaderCode.open("shaders/cull.comp.spv");
+  vk::ShaderModule shaderModule = createShaderModule(shaderCode);
+
+  vk::PipelineShaderStageCreateInfo shaderStageInfo;
+  shaderStageInfo.setStage(vk::ShaderStageFlagBits::eCompute)
+                 .setModule(shaderModule)
+                 .setPName("main");
+
+  vk::ComputePipelineCreateInfo pipelineInfo;
+  pipelineInfo.setStage(shaderStageInfo)
+              .setLayout(cullingPipelineLayout)
+              .setBasePipelineHandle(nullptr)
+              .setBasePipelineIndex(-1);
+
+  try
+  {
+    pipelineCache.beginPipelineBuild();
+    cullingPipeline = device.createComputePipeline(pipelineCache.get(), pipelineInfo);
+    pipelineCache.endPipelineBuild();
+  }
+  catch (std::system_error const &e)
+  {
+    cleanup();
+    throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create culling pipeline!"), e);
+  }
+
+  device.destroyShaderModule(shaderModule);
+}
+
+void HelloTriangleApplication::createPipelineLayout()
+{
+  // Per-draw parameters go through push constants, so draws share the one descriptor set and nothing else is
+  // written between them
+  if (!drawPushConstants.fits(physicalDevice.getProperties().limits))
+  {
+    cleanup();
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Draw push constants don't fit in maxPushConstantsSize!"), "createPipelineLayout");
+  }
+  vk::PushConstantRange pushConstantRange = drawPushConstants.getRange();
+
+  vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
+  pipelineLayoutInfo.setSetLayoutCount(1)
+                    .setPSetLayouts(&descriptorSetLayout)
+                    .setPushConstantRangeCount(1)
+                    .setPPushConstantRanges(&pushConstantRange);
+  
+  try
+  {
+    pipelineLayout = device.createPipelineLayout(pipelineLayoutInfo);
+  }
+  catch (std::system_error const &e)
+  {
+    cleanup();
+    throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create pipeline layout!"), e);
+  }
+}
+
+void HelloTriangleApplication::createPipelineCache()
+{
+  try
+  {
+    pipelineCache.init(physicalDevice, device, settings.pipelineCachePath);
+  }
+  catch (std::system_error const &e)
+  {
+    cleanup();
+    throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create pipeline cache!"), e);
+  }
+}
+
+void HelloTriangleApplication::createProfiler()
+{
+  profiler.init(physicalDevice, device, graphicsQueueFamily);
+
+  profileScopes.frame = profiler.addCpuScope("Frame");
+  profileScopes.waitForFrame = profiler.addCpuScope("Wait For Frame");
+  profileScopes.acquire = profiler.addCpuScope("Acquire");
+  profileScopes.updateUniforms = profiler.addCpuScope("Update Uniforms");
+  profileScopes.updateInstances = profiler.addCpuScope("Update Instances");
+  profileScopes.readback = profiler.addCpuScope("Readback");
+  profileScopes.record = profiler.addCpuScope("Record");
+  profileScopes.submit = profiler.addCpuScope("Submit");
+  profileScopes.present = profiler.addCpuScope("Present");
+  profileScopes.gpuFrame = profiler.addGpuScope("GPU Frame");
+  profileScopes.gpuCulling = profiler.addGpuScope("GPU Culling");
+  profileScopes.gpuRenderPass = profiler.addGpuScope("GPU Render Pass");
+}
+
+void HelloTriangleApplication::reportProfile()
+{
+  profiler.printStats(std::cout);
+
+  runStatistics.cpuFrame = profiler.getStats(profileScopes.frame);
+  runStatistics.waitForFrame = profiler.getStats(profileScopes.waitForFrame);
+  runStatistics.gpuFrame = profiler.getStats(profileScopes.gpuFrame);
+  runStatistics.deviceAllocations = memoryAllocator.getDeviceAllocationCount();
+  runStatistics.subAllocations = memoryAllocator.getTotalSubAllocationCount();
+
+  descriptorAllocator.printStats(std::cout);
+  DescriptorAllocatorStats descriptorStats = descriptorAllocator.getStats();
+  runStatistics.descriptorPools = descriptorStats.poolCount;
+  runStatistics.descriptorSets = descriptorStats.persistentSets + descriptorStats.frameSets;
+  runStatistics.descriptorPoolExhaustions = descriptorStats.poolExhaustions;
+
+  if (cullingEnabled)
+  {
+    std::cout << "GPU culling kept " << runStatistics.visibleDrawCommands << " of " << drawCommands.size() << " draw commands per frame" << std::endl;
+  }
+
+  if (!settings.traceOutputPath.empty())
+  {
+    if (profiler.exportChromeTrace(settings.traceOutputPath))
+    {
+      std::cout << "Wrote trace to " << settings.traceOutputPath << std::endl;
+    }
+    else
+    {
+      std::cerr << "Failed to write trace to " << settings.traceOutputPath << std::endl;
+    }
+  }
+}
+
+void HelloTriangleApplication::createRenderPass()
+{
+  vk::AttachmentDescription colorAttachment;
+  colorAttachment.setFormat(swapChainImageFormat)
+                 .setSamples(vk::SampleCountFlagBits::e1)
+                 .setLoadOp(vk::AttachmentLoadOp::eClear)
+                 .setStoreOp(vk::AttachmentStoreOp::eStore)
+                 .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+                 .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+                 .setInitialLayout(vk::ImageLayout::eUndefined)
+                 .setFinalLayout(settings.headless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR);
+
+  vk::AttachmentReference colorAttachmentRef;
+  colorAttachmentRef.setAttachment(0) // corresponds to layout(location = 0) in fragment shader
+                    .setLayout(vk::ImageLayout::eColorAttachmentOptimal);
+
+  vk::SubpassDescription subpass;
+  subpass.setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+         .setColorAttachmentCount(1)
+         .setPColorAttachments(&colorAttachmentRef);
+
+  vk::SubpassDependency dependencies[2];
+  dependencies[0].setSrcSubpass(VK_SUBPASS_EXTERNAL)
+                 .setDstSubpass(0)
+                 .setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+                 .setSrcAccessMask(vk::AccessFlags())
+                 .setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+                 .setDstAccessMask(vk::AccessFlagBits::eColorAttachmentRead
+                                 | vk::AccessFlagBits::eColorAttachmentWrite);
+
+  // Headless copies the attachment out straight after the render pass
+  dependencies[1].setSrcSubpass(0)
+                 .setDstSubpass(VK_SUBPASS_EXTERNAL)
+                 .setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+                 .setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+                 .setDstStageMask(vk::PipelineStageFlagBits::eTransfer)
+                 .setDstAccessMask(vk::AccessFlagBits::eTransferRead);
+
+  vk::RenderPassCreateInfo renderPassInfo;
+  renderPassInfo.setAttachmentCount(1)
+                .setPAttachments(&colorAttachment)
+                .setSubpassCount(1)
+                .setPSubpasses(&subpass)
+                .setDependencyCount(settings.headless ? 2 : 1)
+                .setPDependencies(dependencies);
+
+  try
+  {
+    renderPass = device.createRenderPass(renderPassInfo);
+  }
+  catch (std::system_error const &e)
+  {
+    cleanup();
+    throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create render pass!"), e);
   }
 }
 
-vk::ShaderModule HelloTriangleApplication::createShaderModule(const std::vector<char>& code)
+vk::ShaderModule HelloTriangleApplication::createShaderModule(MappedFile const &code)
 {
   vk::ShaderModuleCreateInfo createInfo;
-  createInfo.setCodeSize(code.size())
-            .setPCode(reinterpret_cast<const uint32_t*>(code.data()));
+  createInfo.setCodeSize(code.getSize())
+            .setPCode(static_cast<const uint32_t*>(code.getData()));
   vk::ShaderModule shaderModule;
   try
   {
@@ -964,8 +1546,10 @@ void HelloTriangleApplication::createCommandPool()
 {
   QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
 
+  // Primaries are reset and re-recorded every frame
   vk::CommandPoolCreateInfo poolInfo;
-  poolInfo.setQueueFamilyIndex(queueFamilyIndices.graphicsFamily);
+  poolInfo.setQueueFamilyIndex(queueFamilyIndices.graphicsFamily)
+          .setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
 
   try
   {
@@ -976,130 +1560,391 @@ void HelloTriangleApplication::createCommandPool()
     cleanup();
     throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create command pool!"), e);
   }
+
+  try { commandRecorder.init(device, queueFamilyIndices.graphicsFamily, framesInFlight, jobSystem); }
+  catch (std::system_error const &e) { cleanup(); throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create recording command pools!"), e); }
 }
 
-void HelloTriangleApplication::createVertexBuffer()
+void HelloTriangleApplication::createUploadQueue()
 {
-  vk::DeviceSize bufferSize = sizeof(Vertex) * vertices.size();
-
-  vk::Buffer stagingBuffer;
-  vk::DeviceMemory stagingBufferMemory;
-  createBuffer( bufferSize
+  createBuffer( StagingRingSize
               , vk::BufferUsageFlagBits::eTransferSrc
               , vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
-              , stagingBuffer, stagingBufferMemory);
+              , stagingRingBuffer, stagingRingAllocation);
 
-  void *data;
-  data = device.mapMemory(stagingBufferMemory, 0, bufferSize);
-  memcpy(data, vertices.data(), static_cast<size_t>(bufferSize));
-  device.unmapMemory(stagingBufferMemory);
+  try
+  {
+    uploadQueue.init(device, transferQueue, transferQueueFamily, stagingRingBuffer, stagingRingAllocation.mapped, StagingRingSize);
+  }
+  catch (std::system_error const &e)
+  {
+    cleanup();
+    throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create upload queue!"), e);
+  }
+}
 
-  createBuffer( bufferSize
+void HelloTriangleApplication::createGeometryPool()
+{
+  // Sized for more than the one mesh, grown to fit it if it's bigger than that
+  vk::DeviceSize vertexBufferSize = std::max(GeometryPoolVertexBytes, sizeof(Vertex) * static_cast<vk::DeviceSize>(vertexCount));
+  vk::DeviceSize indexBufferSize = std::max(GeometryPoolIndexBytes, indexLayout.getSize());
+
+  createBuffer( vertexBufferSize
               , vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer
               , vk::MemoryPropertyFlagBits::eDeviceLocal
-              , vertexBuffer, vertexBufferMemory); 
+              , vertexBuffer, vertexBufferAllocation); 
+  createBuffer( indexBufferSize
+              , vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer
+              , vk::MemoryPropertyFlagBits::eDeviceLocal
+              , indexBuffer, indexBufferAllocation);
 
-  copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+  geometryPool.init(vertexBuffer, vertexBufferSize, sizeof(Vertex), indexBuffer, indexBufferSize, framesInFlight);
+  meshGeometry = geometryPool.allocate(vertexCount, indexCount, indexLayout.indexType);
+  if (!meshGeometry)
+  {
+    cleanup();
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Mesh doesn't fit the geometry pool!"), "HelloTriangleApplication::createGeometryPool");
+  }
+}
+
+void HelloTriangleApplication::uploadVertices()
+{
+  vk::DeviceSize size = sizeof(Vertex) * static_cast<vk::DeviceSize>(vertexCount);
+  void const *data = meshFile.isOpen() ? meshFile.getVertexData() : vertices.data();
 
-  device.destroyBuffer(stagingBuffer);
-  device.freeMemory(stagingBufferMemory);
+  try { uploadQueue.upload(vertexBuffer, geometryPool.getVertexByteOffset(meshGeometry), data, size); }
+  catch (std::system_error const &e) { cleanup(); throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to upload vertex buffer!"), e); }
 }
 
-void HelloTriangleApplication::createIndexBuffer()
+void HelloTriangleApplication::uploadIndices()
 {
-  vk::DeviceSize bufferSize = sizeof(uint16_t) * indices.size();
+  vk::DeviceSize size = indexLayout.getSize();
+  vk::DeviceSize offset = geometryPool.getIndexByteOffset(meshGeometry);
+  uint32_t indexSize = indexLayout.getIndexSize();
 
-  vk::Buffer stagingBuffer;
-  vk::DeviceMemory stagingBufferMemory;
-  createBuffer( bufferSize
-              , vk::BufferUsageFlagBits::eTransferSrc
-              , vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
-              , stagingBuffer, stagingBufferMemory);
+  try
+  {
+    if (meshFile.isOpen() && meshFile.getHeader().indexSize == indexSize)
+    {
+      uploadQueue.upload(indexBuffer, offset, meshFile.getIndexData(), size);
+    }
+    else
+    {
+      // 32 bit source indices are converted on their way into the staging ring, half a ring at a time
+      uint32_t const *source = meshFile.isOpen() ? static_cast<uint32_t const*>(meshFile.getIndexData()) : indices.data();
+      uint32_t chunkIndices = static_cast<uint32_t>(uploadQueue.getRingSize() / 2 / indexSize);
+      for (uint32_t first = 0; first < indexCount; first += chunkIndices)
+      {
+        uint32_t count = std::min(chunkIndices, indexCount - first);
+        void *staging = uploadQueue.beginUpload(indexBuffer, offset + static_cast<vk::DeviceSize>(first) * indexSize, static_cast<vk::DeviceSize>(count) * indexSize);
+        IndexLayoutBuilder::write(indexLayout, source, first, count, staging);
+      }
+    }
+  }
+  catch (std::system_error const &e) { cleanup(); throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to upload index buffer!"), e); }
+}
 
-  void *data;
-  data = device.mapMemory(stagingBufferMemory, 0, bufferSize);
-  memcpy(data, indices.data(), static_cast<size_t>(bufferSize));
-  device.unmapMemory(stagingBufferMemory);
+void HelloTriangleApplication::createDrawCommands()
+{
+  // Draws cover whole pieces, and one crossing into another sub-mesh carries on there with that sub-mesh's
+  // base vertex, so each draw becomes a command per sub-mesh it touches. Built once, the scene doesn't change.
+  drawCommands.clear();
+  drawObjects.clear();
+  drawBounds.clear();
+
+  // Culling bounds come from the vertices each command reads, wherever the mesh is right now
+  Vertex const *vertexData = meshFile.isOpen() ? static_cast<Vertex const*>(meshFile.getVertexData()) : vertices.data();
+  void const *indexData = meshFile.isOpen() ? meshFile.getIndexData() : indices.data();
+  uint32_t indexSize = meshFile.isOpen() ? meshFile.getHeader().indexSize : sizeof(uint32_t);
+
+  uint32_t pieceCount = drawIndexCount / indicesPerPiece;
+  uint32_t piecesPerDraw = (pieceCount + drawCount - 1) / drawCount;
+  for (uint32_t draw = 0; draw < drawCount; draw++)
+  {
+    uint32_t firstPiece = draw * piecesPerDraw;
+    if (firstPiece >= pieceCount) break;
+
+    uint32_t pieces = std::min(piecesPerDraw, pieceCount - firstPiece);
+    uint32_t first = drawFirstIndex + firstPiece * indicesPerPiece;
+    uint32_t end = first + pieces * indicesPerPiece;
+    for (SubMesh const &subMesh : indexLayout.subMeshes)
+    {
+      uint32_t begin = std::max(first, subMesh.firstIndex);
+      uint32_t finish = std::min(end, subMesh.firstIndex + subMesh.indexCount);
+      if (begin < finish)
+      {
+        int32_t vertexOffset = static_cast<int32_t>(meshGeometry.vertexOffset) + subMesh.baseVertex;
+        drawCommands.push_back(vk::DrawIndexedIndirectCommand(finish - begin, instanceCount, meshGeometry.firstIndex + begin, vertexOffset, 0));
+        drawObjects.push_back(draw);
+        if (cullingEnabled) drawBounds.push_back(computeBoundingSphere(vertexData, indexData, indexSize, begin, finish - begin));
+      }
+    }
+  }
 
-  createBuffer( bufferSize
-              , vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer
+  uint32_t commandCount = static_cast<uint32_t>(drawCommands.size());
+  createBuffer( sizeof(vk::DrawIndexedIndirectCommand) * static_cast<vk::DeviceSize>(commandCount)
+              , vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer
+              , vk::MemoryPropertyFlagBits::eDeviceLocal
+              , drawCommandBuffer, drawCommandBufferAllocation);
+  createBuffer( sizeof(uint32_t) * static_cast<vk::DeviceSize>(commandCount)
+              , vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer
+              , vk::MemoryPropertyFlagBits::eDeviceLocal
+              , drawObjectBuffer, drawObjectBufferAllocation);
+  // Culling writes a count per frame in flight and copies it back each frame, see recordCulling()
+  vk::BufferUsageFlags countUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer;
+  if (cullingEnabled) countUsage |= vk::BufferUsageFlagBits::eTransferSrc;
+  createBuffer( sizeof(uint32_t) * (cullingEnabled ? framesInFlight : 1)
+              , countUsage
               , vk::MemoryPropertyFlagBits::eDeviceLocal
-              , indexBuffer, indexBufferMemory);
+              , drawCountBuffer, drawCountBufferAllocation);
+
+  try
+  {
+    uploadQueue.upload(drawCommandBuffer, 0, drawCommands.data(), sizeof(vk::DrawIndexedIndirectCommand) * static_cast<vk::DeviceSize>(commandCount));
+    uploadQueue.upload(drawObjectBuffer, 0, drawObjects.data(), sizeof(uint32_t) * static_cast<vk::DeviceSize>(commandCount));
+    uploadQueue.upload(drawCountBuffer, 0, &commandCount, sizeof(uint32_t));
+  }
+  catch (std::system_error const &e) { cleanup(); throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to upload draw commands!"), e); }
+
+  // Unculled commands draw every instance, so their list is just 0 to instanceCount - 1, see triangle.vert
+  if (!cullingEnabled)
+  {
+    std::vector<uint32_t> instanceList(instanceCount);
+    for (uint32_t i = 0; i < instanceCount; i++) instanceList[i] = i;
 
-  copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+    createBuffer( sizeof(uint32_t) * static_cast<vk::DeviceSize>(instanceCount)
+                , vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer
+                , vk::MemoryPropertyFlagBits::eDeviceLocal
+                , instanceListBuffer, instanceListBufferAllocation);
 
-  device.destroyBuffer(stagingBuffer);
-  device.freeMemory(stagingBufferMemory);
+    try { uploadQueue.upload(instanceListBuffer, 0, instanceList.data(), sizeof(uint32_t) * static_cast<vk::DeviceSize>(instanceCount)); }
+    catch (std::system_error const &e) { cleanup(); throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to upload instance list!"), e); }
+  }
+
+  // What the CPU records each frame, see recordIndirectDraws()
+  uint32_t commandsPerCall = usesDrawIndirectCount() ? commandCount : (multiDrawIndirectSupported ? maxDrawIndirectCount : 1);
+  runStatistics.drawCommandCount = commandCount;
+  runStatistics.drawCallCount = settings.indirectDraws ? (commandCount + commandsPerCall - 1) / commandsPerCall : commandCount;
+  runStatistics.visibleDrawCommands = commandCount;
+  std::cout << commandCount << " draw commands in " << runStatistics.drawCallCount << (settings.indirectDraws ? " indirect" : " direct") << " draw call(s) per frame" << std::endl;
+}
+
+void HelloTriangleApplication::createCullingBuffers()
+{
+  // Every instance of every command gets a slot in the visible instance list, which the vertex shader reads whole
+  uint32_t commandCount = static_cast<uint32_t>(drawCommands.size());
+  vk::PhysicalDeviceLimits limits = physicalDevice.getProperties().limits;
+  vk::DeviceSize instanceListSize = sizeof(uint32_t) * static_cast<vk::DeviceSize>(commandCount) * instanceCount * framesInFlight;
+  if (instanceListSize > limits.maxStorageBufferRange)
+  {
+    cleanup();
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Visible instance lists are bigger than maxStorageBufferRange!"), "createCullingBuffers");
+  }
+
+  // Instances across x, one workgroup row per command, see recordCulling()
+  uint32_t instanceGroups = (instanceCount + CullGroupSize - 1) / CullGroupSize;
+  uint32_t commandGroups = (commandCount + CullGroupSize - 1) / CullGroupSize;
+  if (std::max(instanceGroups, commandGroups) > limits.maxComputeWorkGroupCount[0])
+  {
+    cleanup();
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Too many culling workgroups for maxComputeWorkGroupCount!"), "createCullingBuffers");
+  }
+  maxCullCommandsPerDispatch = limits.maxComputeWorkGroupCount[1];
+
+  createBuffer( sizeof(BoundingSphere) * static_cast<vk::DeviceSize>(commandCount)
+              , vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer
+              , vk::MemoryPropertyFlagBits::eDeviceLocal
+              , boundsBuffer, boundsBufferAllocation);
+  createBuffer( sizeof(vk::DrawIndexedIndirectCommand) * static_cast<vk::DeviceSize>(commandCount) * framesInFlight
+              , vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer
+              , vk::MemoryPropertyFlagBits::eDeviceLocal
+              , visibleCommandBuffer, visibleCommandBufferAllocation);
+  createBuffer( sizeof(uint32_t) * static_cast<vk::DeviceSize>(commandCount) * framesInFlight
+              , vk::BufferUsageFlagBits::eStorageBuffer
+              , vk::MemoryPropertyFlagBits::eDeviceLocal
+              , visibleObjectBuffer, visibleObjectBufferAllocation);
+  createBuffer( sizeof(uint32_t) * static_cast<vk::DeviceSize>(commandCount) * framesInFlight
+              , vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer
+              , vk::MemoryPropertyFlagBits::eDeviceLocal
+              , instanceCountBuffer, instanceCountBufferAllocation);
+  createBuffer( instanceListSize
+              , vk::BufferUsageFlagBits::eStorageBuffer
+              , vk::MemoryPropertyFlagBits::eDeviceLocal
+              , visibleInstanceBuffer, visibleInstanceBufferAllocation);
+  createBuffer( sizeof(uint32_t) * framesInFlight
+              , vk::BufferUsageFlagBits::eTransferDst
+              , vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+              , visibleCountReadbackBuffer, visibleCountReadbackAllocation);
+  visibleCountPending.assign(framesInFlight, false);
+
+  try { uploadQueue.upload(boundsBuffer, 0, drawBounds.data(), sizeof(BoundingSphere) * static_cast<vk::DeviceSize>(commandCount)); }
+  catch (std::system_error const &e) { cleanup(); throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to upload culling bounds!"), e); }
 }
 
 void HelloTriangleApplication::createUniformBuffer()
 {
-  vk::DeviceSize bufferSize = sizeof(UniformBufferObject);
-  createBuffer( bufferSize
+  // Each frame in flight reads its own region, so writing one never races a frame still on the GPU. Objects
+  // are an array the shader indexes, so draws don't need a descriptor bind each.
+  vk::PhysicalDeviceLimits limits = physicalDevice.getProperties().limits;
+  uniformRing.init( limits
+                  , sizeof(ObjectUniforms)
+                  , drawCount
+                  , framesInFlight
+                  , vk::DescriptorType::eStorageBufferDynamic);
+
+  createBuffer( uniformRing.getSize()
+              , vk::BufferUsageFlagBits::eStorageBuffer
+              , vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+              , uniformBuffer, uniformBufferAllocation);
+
+  uniformRing.setStorage(uniformBuffer, uniformBufferAllocation.mapped);
+
+  // The camera is the same for every object, so it's written once a frame rather than into every element
+  cameraRing.init(limits, sizeof(CameraUniforms), 1, framesInFlight, vk::DescriptorType::eUniformBufferDynamic);
+
+  createBuffer( cameraRing.getSize()
               , vk::BufferUsageFlagBits::eUniformBuffer
               , vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
-              , uniformBuffer, uniformBufferMemory);
+              , cameraBuffer, cameraBufferAllocation);
+
+  cameraRing.setStorage(cameraBuffer, cameraBufferAllocation.mapped);
+
+  runStatistics.uniformBytesPerFrame = sizeof(CameraUniforms) + sizeof(ObjectUniforms) * static_cast<uint64_t>(drawCount);
 }
 
-void HelloTriangleApplication::createDescriptorPool()
+void HelloTriangleApplication::createInstanceBuffer()
 {
-  vk::DescriptorPoolSize poolSize = {};
-  poolSize.setDescriptorCount(1)
-          .setType(vk::DescriptorType::eUniformBuffer);
-
-  vk::DescriptorPoolCreateInfo poolInfo = {};
-  poolInfo.setPoolSizeCount(1)
-          .setPPoolSizes(&poolSize)
-          .setMaxSets(1);
+  // Written by the CPU every frame, so like the objects it's a ring in host visible memory with a region per frame
+  // in flight, which both the vertex shader and culling index
+  instanceRing.init( physicalDevice.getProperties().limits
+                   , sizeof(InstanceData)
+                   , instanceCount
+                   , framesInFlight
+                   , vk::DescriptorType::eStorageBufferDynamic);
+
+  createBuffer( instanceRing.getSize()
+              , vk::BufferUsageFlagBits::eStorageBuffer
+              , vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+              , instanceBuffer, instanceBufferAllocation);
 
-  try
-  {
-    descriptorPool = device.createDescriptorPool(poolInfo);
-  }
-  catch (std::system_error const &e)
-  {
-    throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create descriptor pool!"), e);
-  }
+  instanceRing.setStorage(instanceBuffer, instanceBufferAllocation.mapped);
 }
 
 void HelloTriangleApplication::createDescriptorSet()
 {
-  vk::DescriptorSetLayout layouts[] = { descriptorSetLayout };
-  vk::DescriptorSetAllocateInfo allocInfo = {};
-  allocInfo.setDescriptorPool(descriptorPool)
-    .setDescriptorSetCount(1)
-    .setPSetLayouts(layouts);
-
+  // Both sets are written once and live as long as the app, dynamic offsets pick each frame's regions
   try
   {
-    descriptorSet = device.allocateDescriptorSets(allocInfo)[0];
+    descriptorSet = descriptorAllocator.allocate(descriptorSetLayout);
+    if (cullingEnabled) cullingDescriptorSet = descriptorAllocator.allocate(cullingDescriptorSetLayout);
   }
   catch (std::system_error const &e)
   {
+    cleanup();
     throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to allocate descriptor set!"), e);
   }
+  catch (UnrecoverableRuntimeException const &)
+  {
+    cleanup();
+    throw;
+  }
+
+  writeDescriptorSet();
+}
 
-  vk::DescriptorBufferInfo bufferInfo = {};
-  bufferInfo.setBuffer(uniformBuffer)
+void HelloTriangleApplication::writeDescriptorSet()
+{
+  // The objects range covers one frame's region, the dynamic offset at bind time picks which one
+  vk::DescriptorBufferInfo objectsInfo = {};
+  objectsInfo.setBuffer(uniformBuffer)
+    .setOffset(0)
+    .setRange(uniformRing.getDescriptorRange());
+
+  // Culling leaves the objects of the visible commands in the order it wrote those out
+  vk::DescriptorBufferInfo drawObjectsInfo = {};
+  drawObjectsInfo.setBuffer(cullingEnabled ? visibleObjectBuffer : drawObjectBuffer)
     .setOffset(0)
-    .setRange(sizeof(UniformBufferObject));
+    .setRange(VK_WHOLE_SIZE);
 
-  vk::WriteDescriptorSet descriptorWrite = {};
-  descriptorWrite.setDstSet(descriptorSet)
-                 .setDstBinding(0)
-                 .setDstArrayElement(0)
-                 .setDescriptorType(vk::DescriptorType::eUniformBuffer)
-                 .setDescriptorCount(1)
-                 .setPBufferInfo(&bufferInfo)
-                 .setPImageInfo(nullptr)
-                 .setPTexelBufferView(nullptr);
+  vk::DescriptorBufferInfo cameraInfo = {};
+  cameraInfo.setBuffer(cameraBuffer)
+    .setOffset(0)
+    .setRange(cameraRing.getDescriptorRange());
+
+  vk::DescriptorBufferInfo instancesInfo = {};
+  instancesInfo.setBuffer(instanceBuffer)
+    .setOffset(0)
+    .setRange(instanceRing.getDescriptorRange());
 
-  device.updateDescriptorSets(1, &descriptorWrite, 0, nullptr);
+  // Culling lists the visible instances of each command, otherwise every command draws them all
+  vk::DescriptorBufferInfo instanceListInfo = {};
+  instanceListInfo.setBuffer(cullingEnabled ? visibleInstanceBuffer : instanceListBuffer)
+    .setOffset(0)
+    .setRange(VK_WHOLE_SIZE);
+
+  vk::WriteDescriptorSet descriptorWrites[5];
+  descriptorWrites[0].setDstSet(descriptorSet)
+                     .setDstBinding(0)
+                     .setDstArrayElement(0)
+                     .setDescriptorType(uniformRing.getDescriptorType())
+                     .setDescriptorCount(1)
+                     .setPBufferInfo(&objectsInfo);
+  descriptorWrites[1].setDstSet(descriptorSet)
+                     .setDstBinding(1)
+                     .setDstArrayElement(0)
+                     .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                     .setDescriptorCount(1)
+                     .setPBufferInfo(&drawObjectsInfo);
+  descriptorWrites[2].setDstSet(descriptorSet)
+                     .setDstBinding(2)
+                     .setDstArrayElement(0)
+                     .setDescriptorType(cameraRing.getDescriptorType())
+                     .setDescriptorCount(1)
+                     .setPBufferInfo(&cameraInfo);
+  descriptorWrites[3].setDstSet(descriptorSet)
+                     .setDstBinding(3)
+                     .setDstArrayElement(0)
+                     .setDescriptorType(instanceRing.getDescriptorType())
+                     .setDescriptorCount(1)
+                     .setPBufferInfo(&instancesInfo);
+  descriptorWrites[4].setDstSet(descriptorSet)
+                     .setDstBinding(4)
+                     .setDstArrayElement(0)
+                     .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                     .setDescriptorCount(1)
+                     .setPBufferInfo(&instanceListInfo);
+
+  device.updateDescriptorSets(5, descriptorWrites, 0, nullptr);
+
+  if (!cullingEnabled) return;
+
+  // In binding order, see cull.comp. The first two are the rings, whose ranges cover a frame's region.
+  vk::Buffer cullingBuffers[CullingBindingCount] = { uniformBuffer, instanceBuffer, boundsBuffer, drawCommandBuffer, drawObjectBuffer
+                                                   , visibleCommandBuffer, visibleObjectBuffer, drawCountBuffer, instanceCountBuffer
+                                                   , visibleInstanceBuffer };
+  vk::DeviceSize ringRanges[] = { uniformRing.getDescriptorRange(), instanceRing.getDescriptorRange() };
+  vk::DescriptorBufferInfo cullingInfos[CullingBindingCount];
+  vk::WriteDescriptorSet cullingWrites[CullingBindingCount];
+  for (uint32_t binding = 0; binding < CullingBindingCount; binding++)
+  {
+    cullingInfos[binding].setBuffer(cullingBuffers[binding])
+                         .setOffset(0)
+                         .setRange(binding < 2 ? ringRanges[binding] : VK_WHOLE_SIZE);
+    cullingWrites[binding].setDstSet(cullingDescriptorSet)
+                          .setDstBinding(binding)
+                          .setDstArrayElement(0)
+                          .setDescriptorType(binding < 2 ? vk::DescriptorType::eStorageBufferDynamic : vk::DescriptorType::eStorageBuffer)
+                          .setDescriptorCount(1)
+                          .setPBufferInfo(&cullingInfos[binding]);
+  }
+
+  device.updateDescriptorSets(CullingBindingCount, cullingWrites, 0, nullptr);
 }
 
 void HelloTriangleApplication::createCommandBuffers()
 {
-  commandBuffers.resize(swapChainFramebuffers.size());
+  // One primary per frame in flight, re-recorded every frame once that frame's fence has signalled
+  commandBuffers.resize(framesInFlight);
 
   vk::CommandBufferAllocateInfo allocInfo;
   allocInfo.setCommandPool(commandPool)
@@ -1116,61 +1961,294 @@ void HelloTriangleApplication::createCommandBuffers()
     throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to allocate command buffers!"), e);
   }
 
-  for (size_t i = 0; i < commandBuffers.size(); i++)
+  // Each frame in flight gets its own range of timestamp queries
+  try { profiler.setSlotCount(static_cast<uint32_t>(commandBuffers.size())); }
+  catch (std::system_error const &e) { cleanup(); throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create profiler query pool!"), e); }
+}
+
+void HelloTriangleApplication::recordCommandBuffer(uint32_t frame, uint32_t imageIndex)
+{
+  FrameProfiler::CpuScope scope(profiler, profileScopes.record);
+
+  vk::CommandBuffer commandBuffer = commandBuffers[frame];
+  commandBuffer.reset(vk::CommandBufferResetFlags());
+
+  vk::CommandBufferBeginInfo beginInfo;
+  beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit)
+           .setPInheritanceInfo(nullptr);
+
+  commandBuffer.begin(&beginInfo);
+
+  profiler.resetGpuScopes(commandBuffer, frame);
+  profiler.beginGpuScope(commandBuffer, frame, profileScopes.gpuFrame);
+
+  vk::ClearValue clearColor(std::array<float, 4>({ 0.f, 0.f, 0.f, 1.f }));
+
+  vk::RenderPassBeginInfo renderPassInfo;
+  renderPassInfo.setRenderPass(renderPass)
+                .setFramebuffer(swapChainFramebuffers[imageIndex])
+                .setRenderArea(vk::Rect2D({ 0,0 }, swapChainExtent))
+                .setClearValueCount(1)
+                .setPClearValues(&clearColor);
+
+  if (cullingEnabled) recordCulling(commandBuffer, frame);
+
+  profiler.beginGpuScope(commandBuffer, frame, profileScopes.gpuRenderPass);
+
+  // Small scenes aren't worth waking the job system for, and indirect draws are only a handful of commands
+  uint32_t commandCount = static_cast<uint32_t>(drawCommands.size());
+  if (settings.indirectDraws)
   {
-    vk::CommandBufferBeginInfo beginInfo;
-    beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse)
-             .setPInheritanceInfo(nullptr);
+    commandBuffer.beginRenderPass(&renderPassInfo, vk::SubpassContents::eInline);
+    recordIndirectDraws(commandBuffer, frame);
+  }
+  else if (commandRecorder.getThreadCount() > 1 && commandCount >= MinDrawsForParallelRecording)
+  {
+    commandBuffer.beginRenderPass(&renderPassInfo, vk::SubpassContents::eSecondaryCommandBuffers);
 
-    commandBuffers[i].begin(&beginInfo);
+    vk::CommandBufferInheritanceInfo inheritanceInfo;
+    inheritanceInfo.setRenderPass(renderPass)
+                   .setSubpass(0)
+                   .setFramebuffer(swapChainFramebuffers[imageIndex]);
 
-    vk::ClearValue clearColor(std::array<float, 4Ui64>({ 0.f, 0.f, 0.f, 1.f }));
+    auto const &secondaryCommandBuffers = commandRecorder.recordSecondary(frame, inheritanceInfo, commandCount,
+      [this, frame](vk::CommandBuffer secondary, uint32_t firstCommand, uint32_t count) { recordDraws(secondary, frame, firstCommand, count); });
+    commandBuffer.executeCommands(secondaryCommandBuffers);
+  }
+  else
+  {
+    commandBuffer.beginRenderPass(&renderPassInfo, vk::SubpassContents::eInline);
+    recordDraws(commandBuffer, frame, 0, commandCount);
+  }
 
-    vk::RenderPassBeginInfo renderPassInfo;
-    renderPassInfo.setRenderPass(renderPass)
-                  .setFramebuffer(swapChainFramebuffers[i])
-                  .setRenderArea(vk::Rect2D({ 0,0 }, swapChainExtent))
-                  .setClearValueCount(1)
-                  .setPClearValues(&clearColor);
+  commandBuffer.endRenderPass();
+  profiler.endGpuScope(commandBuffer, frame, profileScopes.gpuRenderPass);
 
-    commandBuffers[i].beginRenderPass(&renderPassInfo, vk::SubpassContents::eInline);
+  if (settings.headless && settings.readbackMode != ReadbackMode::Disabled)
+  {
+    frameReadback.recordCopy(commandBuffer, swapChainImages[imageIndex], readbackSlot);
+  }
 
-    commandBuffers[i].bindPipeline(vk::PipelineBindPoint::eGraphics, graphicsPipeline);
+  profiler.endGpuScope(commandBuffer, frame, profileScopes.gpuFrame);
+  commandBuffer.end();
+}
 
-    vk::Buffer vertexBuffers[] = { vertexBuffer };
-    vk::DeviceSize offsets[] = { 0 };
-    commandBuffers[i].bindVertexBuffers(0, 1, vertexBuffers, offsets);
-    commandBuffers[i].bindIndexBuffer(indexBuffer, 0, vk::IndexType::eUint16);
-    commandBuffers[i].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
-    commandBuffers[i].drawIndexed(static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+void HelloTriangleApplication::bindScene(vk::CommandBuffer commandBuffer, uint32_t frame)
+{
+  // May run on several recording threads at once, so only reads shared state. Secondary command buffers
+  // inherit nothing but the render pass, so everything is bound again for each.
+  commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, graphicsPipeline);
 
-    commandBuffers[i].endRenderPass();
-    commandBuffers[i].end();
-  }  
+  vk::Viewport viewport;
+  viewport.setX(0.f)
+          .setY(0.f)
+          .setWidth(static_cast<float>(swapChainExtent.width))
+          .setHeight(static_cast<float>(swapChainExtent.height))
+          .setMinDepth(0.f)
+          .setMaxDepth(1.f);
+  commandBuffer.setViewport(0, viewport);
+  commandBuffer.setScissor(0, vk::Rect2D({ 0, 0 }, swapChainExtent));
+
+  // The whole geometry pool, meshes are picked out of it by firstIndex and vertexOffset
+  vk::DeviceSize offset = 0;
+  commandBuffer.bindVertexBuffers(0, 1, &vertexBuffer, &offset);
+  commandBuffer.bindIndexBuffer(indexBuffer, 0, meshGeometry.indexType);
+
+  // Bound once, the shader finds each draw's object through drawObjects and its instances through the instance
+  // list. Dynamic offsets go in binding order.
+  uint32_t dynamicOffsets[] = { uniformRing.getDynamicOffset(frame), cameraRing.getDynamicOffset(frame), instanceRing.getDynamicOffset(frame) };
+  commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, 1, &descriptorSet, 3, dynamicOffsets);
 }
 
-void HelloTriangleApplication::createSemaphores()
+void HelloTriangleApplication::recordDraws(vk::CommandBuffer commandBuffer, uint32_t frame, uint32_t firstCommand, uint32_t count)
+{
+  bindScene(commandBuffer, frame);
+
+  // The same commands the indirect path hands the GPU, issued one by one
+  for (uint32_t index = firstCommand; index < firstCommand + count; index++)
+  {
+    drawPushConstants.push(commandBuffer, pipelineLayout, { index });
+
+    vk::DrawIndexedIndirectCommand const &command = drawCommands[index];
+    commandBuffer.drawIndexed(command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+  }
+}
+
+void HelloTriangleApplication::recordIndirectDraws(vk::CommandBuffer commandBuffer, uint32_t frame)
+{
+  bindScene(commandBuffer, frame);
+
+  uint32_t commandCount = static_cast<uint32_t>(drawCommands.size());
+  uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+  vk::Buffer indirectBuffer = cullingEnabled ? visibleCommandBuffer : drawCommandBuffer;
+
+  // Culling left this frame's commands, their objects and their count in the frame's own regions
+  uint32_t firstFrameCommand = cullingEnabled ? commandCount * frame : 0;
+  vk::DeviceSize countOffset = cullingEnabled ? sizeof(uint32_t) * frame : 0;
+
+  // The GPU reads how many commands there are, which is what lets the culling pass shrink the list
+  if (usesDrawIndirectCount())
+  {
+    drawPushConstants.push(commandBuffer, pipelineLayout, { firstFrameCommand });
+    commandBuffer.drawIndexedIndirectCountAMD(indirectBuffer, static_cast<vk::DeviceSize>(firstFrameCommand) * stride, drawCountBuffer, countOffset, commandCount, stride);
+    return;
+  }
+
+  // Otherwise as few calls as the device allows, a single one unless there are more than maxDrawIndirectCount
+  // commands or multiDrawIndirect isn't supported
+  uint32_t commandsPerCall = multiDrawIndirectSupported ? maxDrawIndirectCount : 1;
+  for (uint32_t first = 0; first < commandCount; first += commandsPerCall)
+  {
+    drawPushConstants.push(commandBuffer, pipelineLayout, { firstFrameCommand + first });
+    commandBuffer.drawIndexedIndirect(indirectBuffer, static_cast<vk::DeviceSize>(firstFrameCommand + first) * stride, std::min(commandsPerCall, commandCount - first), stride);
+  }
+}
+
+bool HelloTriangleApplication::usesDrawIndirectCount() const
+{
+  return drawIndirectCountSupported && drawCommands.size() <= maxDrawIndirectCount;
+}
+
+void HelloTriangleApplication::recordCulling(vk::CommandBuffer commandBuffer, uint32_t frame)
+{
+  profiler.beginGpuScope(commandBuffer, frame, profileScopes.gpuCulling);
+
+  // Only this frame slot's regions are written, and the slot's fence has already freed them, so nothing waits on
+  // the previous frame's draws. Without a draw count on the GPU every command slot is drawn, so the ones after the
+  // survivors must draw nothing.
+  uint32_t commandCount = static_cast<uint32_t>(drawCommands.size());
+  vk::DeviceSize commandRegionSize = sizeof(vk::DrawIndexedIndirectCommand) * static_cast<vk::DeviceSize>(commandCount);
+  vk::DeviceSize countRegionSize = sizeof(uint32_t) * static_cast<vk::DeviceSize>(commandCount);
+  commandBuffer.fillBuffer(drawCountBuffer, sizeof(uint32_t) * frame, sizeof(uint32_t), 0);
+  commandBuffer.fillBuffer(instanceCountBuffer, countRegionSize * frame, countRegionSize, 0);
+  if (!usesDrawIndirectCount()) commandBuffer.fillBuffer(visibleCommandBuffer, commandRegionSize * frame, commandRegionSize, 0);
+
+  vk::MemoryBarrier clearBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), clearBarrier, nullptr, nullptr);
+
+  cullConstants.commandCount = commandCount;
+  cullConstants.instanceCount = instanceCount;
+  cullConstants.frame = frame;
+
+  uint32_t dynamicOffsets[] = { uniformRing.getDynamicOffset(frame), instanceRing.getDynamicOffset(frame) };
+  commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, cullingPipeline);
+  commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, cullingPipelineLayout, 0, 1, &cullingDescriptorSet, 2, dynamicOffsets);
+
+  // First every instance of every command is tested and the visible ones listed, a row of workgroups per command.
+  // Rows are limited too, so big scenes take a few dispatches.
+  cullConstants.pass = 0;
+  for (uint32_t first = 0; first < commandCount; first += maxCullCommandsPerDispatch)
+  {
+    cullConstants.firstCommand = first;
+    cullPushConstants.push(commandBuffer, cullingPipelineLayout, cullConstants);
+    commandBuffer.dispatch((instanceCount + CullGroupSize - 1) / CullGroupSize, std::min(maxCullCommandsPerDispatch, commandCount - first), 1);
+  }
+
+  vk::MemoryBarrier listBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), listBarrier, nullptr, nullptr);
+
+  // Then the commands with anything left to draw are compacted, each drawing just its listed instances
+  cullConstants.pass = 1;
+  cullConstants.firstCommand = 0;
+  cullPushConstants.push(commandBuffer, cullingPipelineLayout, cullConstants);
+  commandBuffer.dispatch((commandCount + CullGroupSize - 1) / CullGroupSize, 1, 1);
+
+  vk::MemoryBarrier cullBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead);
+  commandBuffer.pipelineBarrier( vk::PipelineStageFlagBits::eComputeShader
+                               , vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eTransfer
+                               , vk::DependencyFlags(), cullBarrier, nullptr, nullptr);
+
+  // The count comes back with the frame's fence, see collectCullingResults()
+  vk::BufferCopy countCopy(sizeof(uint32_t) * frame, sizeof(uint32_t) * frame, sizeof(uint32_t));
+  commandBuffer.copyBuffer(drawCountBuffer, visibleCountReadbackBuffer, countCopy);
+
+  vk::BufferMemoryBarrier readbackBarrier;
+  readbackBarrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+                 .setDstAccessMask(vk::AccessFlagBits::eHostRead)
+                 .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                 .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                 .setBuffer(visibleCountReadbackBuffer)
+                 .setOffset(sizeof(uint32_t) * frame)
+                 .setSize(sizeof(uint32_t));
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, vk::DependencyFlags(), nullptr, readbackBarrier, nullptr);
+  visibleCountPending[frame] = true;
+
+  profiler.endGpuScope(commandBuffer, frame, profileScopes.gpuCulling);
+}
+
+void HelloTriangleApplication::collectCullingResults(uint32_t frame)
+{
+  if (!cullingEnabled || !visibleCountPending[frame]) return;
+  visibleCountPending[frame] = false;
+
+  uint32_t visibleCount = static_cast<uint32_t const*>(visibleCountReadbackAllocation.mapped)[frame];
+  visibleCommandTotal += visibleCount;
+  visibleCountFrames++;
+  runStatistics.visibleDrawCommands = static_cast<double>(visibleCommandTotal) / visibleCountFrames;
+}
+
+void HelloTriangleApplication::createFrameContexts()
 {
   vk::SemaphoreCreateInfo semaphoreInfo;
 
-  try { imageAvailableSemaphore = device.createSemaphore(semaphoreInfo); }
-  catch (std::system_error const &e) { cleanup(); throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create imageAvailableSemaphore!"), e); }
-  try { renderFinishedSemaphore = device.createSemaphore(semaphoreInfo); }
-  catch (std::system_error const &e) { cleanup();  throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create renderFinishedSemaphore!"), e); }
+  // Fences start signalled so the first wait on each frame slot returns immediately
+  vk::FenceCreateInfo fenceInfo;
+  fenceInfo.setFlags(vk::FenceCreateFlagBits::eSignaled);
+
+  frameContexts.resize(framesInFlight);
+  for (auto &frame : frameContexts)
+  {
+    try { frame.imageAvailableSemaphore = device.createSemaphore(semaphoreInfo); }
+    catch (std::system_error const &e) { cleanup(); throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create imageAvailableSemaphore!"), e); }
+    try { frame.renderFinishedSemaphore = device.createSemaphore(semaphoreInfo); }
+    catch (std::system_error const &e) { cleanup(); throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create renderFinishedSemaphore!"), e); }
+    try { frame.inFlightFence = device.createFence(fenceInfo); }
+    catch (std::system_error const &e) { cleanup(); throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to create inFlightFence!"), e); }
+  }
+
+  imagesInFlight.assign(swapChainImages.size(), vk::Fence());
+  currentFrame = 0;
+}
+
+void HelloTriangleApplication::cleanupFrameContexts()
+{
+  for (auto &frame : frameContexts)
+  {
+    if (frame.imageAvailableSemaphore) device.destroySemaphore(frame.imageAvailableSemaphore);
+    if (frame.renderFinishedSemaphore) device.destroySemaphore(frame.renderFinishedSemaphore);
+    if (frame.inFlightFence)           device.destroyFence(frame.inFlightFence);
+  }
+  frameContexts.clear();
+  imagesInFlight.clear();
 }
 
 void HelloTriangleApplication::recreateSwapChain()
 {
   device.waitIdle();
 
+  vk::Format oldFormat = swapChainImageFormat;
+
   cleanupSwapChain();
 
   createSwapChain();
   createImageViews();
-  createRenderPass();
-  createGraphicsPipeline();
+
+  // The pipeline only cares about the extent through dynamic state, so it and the render pass
+  // only need rebuilding if the surface format changed under us
+  if (swapChainImageFormat != oldFormat)
+  {
+    device.destroyPipeline(graphicsPipeline);
+    device.destroyRenderPass(renderPass);
+    createRenderPass();
+    createGraphicsPipeline();
+  }
+
+  // Command buffers are recorded per frame against whichever framebuffer was acquired, so nothing else
+  // depends on the swap chain images
   createFramebuffers();
-  createCommandBuffers();
+
+  // The new images haven't been used by any frame yet
+  imagesInFlight.assign(swapChainImages.size(), vk::Fence());
 }
 
 void HelloTriangleApplication::cleanupSwapChain()
@@ -1179,56 +2257,198 @@ void HelloTriangleApplication::cleanupSwapChain()
   {
     if (swapChainFramebuffers[i]) device.destroyFramebuffer(swapChainFramebuffers[i]);
   }
-  device.freeCommandBuffers(commandPool, commandBuffers);
-  if (graphicsPipeline) device.destroyPipeline(graphicsPipeline);
-  if (pipelineLayout) device.destroyPipelineLayout(pipelineLayout);
-  if (renderPass) device.destroyRenderPass(renderPass);
   for (size_t i = 0; i < swapChainImageViews.size(); i++)
   {
     if (swapChainImageViews[i]) device.destroyImageView(swapChainImageViews[i]);
   }
-  if (swapChain) device.destroySwapchainKHR(swapChain);
+  swapChainFramebuffers.clear();
+  swapChainImageViews.clear();
 }
 
 void HelloTriangleApplication::mainLoop()
 {
-  while (!glfwWindowShouldClose(window))
+  startTime = std::chrono::high_resolution_clock::now();
+  renderThread = std::thread(&HelloTriangleApplication::renderLoop, this);
+
+  // Never blocks on the GPU, so the window stays responsive however long a frame takes
+  while (!glfwWindowShouldClose(window) && !renderThreadDone.load(std::memory_order_acquire))
   {
-    glfwPollEvents();
+    glfwWaitEventsTimeout(SnapshotInterval);
+
+    if (resizePending)
+    {
+      RenderMessage resize = { RenderMessage::Type::Resize, 0.f, pendingExtent };
+      resizePending = !renderMessages.push(resize);
+    }
 
-    updateUniformBuffer();
-    drawFrame();
+    // A dropped snapshot is superseded by the next one anyway
+    auto currentTime = std::chrono::high_resolution_clock::now();
+    RenderMessage snapshot = { RenderMessage::Type::Snapshot, std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count(), vk::Extent2D() };
+    renderMessages.push(snapshot);
   }
 
-  device.waitIdle();
+  RenderMessage quit = { RenderMessage::Type::Quit, 0.f, vk::Extent2D() };
+  while (!renderMessages.push(quit) && !renderThreadDone.load(std::memory_order_acquire))
+  {
+    std::this_thread::yield();
+  }
+  renderThread.join();
+
+  cleanupWindow();
+  if (renderError) std::rethrow_exception(renderError);
 }
 
-void HelloTriangleApplication::updateUniformBuffer()
+void HelloTriangleApplication::renderLoop()
 {
-  static auto startTime = std::chrono::high_resolution_clock::now();
+  // Errors are handed back to the window thread, which owns the window and rethrows them
+  try
+  {
+    jobSystem.init(settings.jobThreads);
+    initVulkan();
 
-  auto currentTime = std::chrono::high_resolution_clock::now();
-  float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+    while (!quitRendering)
+    {
+      processRenderMessages();
+      if (quitRendering) break;
+
+      FrameProfiler::CpuScope frameScope(profiler, profileScopes.frame);
+      drawFrame();
+    }
+
+    device.waitIdle();
+    reportProfile();
+    cleanup();
+  }
+  catch (...)
+  {
+    renderError = std::current_exception();
+  }
+
+  renderThreadDone.store(true, std::memory_order_release);
+  glfwPostEmptyEvent();
+}
+
+void HelloTriangleApplication::processRenderMessages()
+{
+  // Only the newest size matters, however many resizes piled up since the last frame
+  bool resized = false;
+  RenderMessage message;
+  while (renderMessages.pop(message))
+  {
+    switch (message.type)
+    {
+    case RenderMessage::Type::Snapshot:
+      snapshotTime = message.time;
+      break;
+    case RenderMessage::Type::Resize:
+      windowExtent = message.extent;
+      resized = true;
+      break;
+    case RenderMessage::Type::Quit:
+      quitRendering = true;
+      break;
+    }
+  }
 
-  UniformBufferObject ubo = {};
-  ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-  ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-  ubo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / static_cast<float>(swapChainExtent.height), 0.1f, 10.0f);
+  if (resized && !quitRendering) recreateSwapChain();
+}
+
+void HelloTriangleApplication::updateUniformBuffer(uint32_t region)
+{
+  FrameProfiler::CpuScope scope(profiler, profileScopes.updateUniforms);
+
+  float time;
+  if (settings.fixedTimeStep > 0.f)
+  {
+    time = static_cast<float>(frameNumber * static_cast<double>(settings.fixedTimeStep));
+  }
+  else if (!settings.headless)
+  {
+    time = snapshotTime;
+  }
+  else
+  {
+    auto currentTime = std::chrono::high_resolution_clock::now();
+    time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+  }
+  frameNumber++;
+  animationTime = time;
+
+  glm::mat4 view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+  glm::mat4 proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / static_cast<float>(swapChainExtent.height), 0.1f, 10.0f);
   // UnInvert Y coords
-  ubo.proj[1][1] *= -1;
+  proj[1][1] *= -1;
+
+  CameraUniforms camera = {};
+  camera.viewProj = proj * view;
+  cameraRing.write(region, 0, camera);
+
+  // Every object shares the camera, so one world space frustum does for all of them
+  cullConstants.frustum = Frustum::fromMatrix(camera.viewProj);
+
+  // Every draw is its own object with its own element, the ring stays mapped so this is just stores
+  ObjectUniforms objectUniforms = ObjectUniforms::fromModel(glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+  JobSystem::Counter counter;
+  jobSystem.parallelFor(drawCount, ObjectsPerJob, [this, region, &objectUniforms](uint32_t first, uint32_t count)
+  {
+    for (uint32_t object = first; object < first + count; object++)
+    {
+      uniformRing.write(region, object, objectUniforms);
+    }
+  }, &counter);
+  jobSystem.wait(counter);
+}
+
+void HelloTriangleApplication::updateInstanceBuffer(uint32_t region)
+{
+  FrameProfiler::CpuScope scope(profiler, profileScopes.updateInstances);
+
+  // A single instance is left alone, so the default scene looks the same as it did before instancing
+  if (instanceCount == 1)
+  {
+    instances[0] = InstanceData::fromModel(glm::mat4(1.0f));
+  }
+  else
+  {
+    // Models go straight into the instances, which are nothing but a model's top three rows each
+    static_assert(sizeof(InstanceData) == 3 * sizeof(glm::vec4), "InstanceData is more than a model's rows");
+
+    JobSystem::Counter counter;
+    jobSystem.parallelFor(instanceCount, ObjectsPerJob, [this](uint32_t first, uint32_t count)
+    {
+      transformKernels->updateModels(instanceTransforms, animationTime, first, count, instances[0].modelRows);
+    }, &counter);
+    jobSystem.wait(counter);
+  }
 
-  void *data;
-  data = device.mapMemory(uniformBufferMemory, 0, sizeof(ubo));
-  memcpy(data, &ubo, sizeof(ubo));
-  device.unmapMemory(uniformBufferMemory);
+  memcpy(instanceRing.getElement(region, 0), instances.data(), sizeof(InstanceData) * instanceCount);
 }
 
 void HelloTriangleApplication::drawFrame()
 {
+  FrameContext &frame = frameContexts[currentFrame];
+
+  // Only wait for the frame slot we're about to reuse, the other frames in flight keep running
+  {
+    FrameProfiler::CpuScope scope(profiler, profileScopes.waitForFrame);
+    try { device.waitForFences(frame.inFlightFence, VK_TRUE, std::numeric_limits<uint64_t>::max()); }
+    catch (std::system_error const &e) { cleanup(); throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to wait for frame fence!"), e); }
+  }
+
+  // Everything owned by this frame slot is free again: its timestamps, command buffers and uniform/instance regions
+  profiler.collectGpuResults(currentFrame);
+  collectCullingResults(currentFrame);
+  commandRecorder.beginFrame(currentFrame);
+  descriptorAllocator.resetFrame(currentFrame);
+  geometryPool.beginFrame();
+  updateUniformBuffer(currentFrame);
+  updateInstanceBuffer(currentFrame);
+
   uint32_t imageIndex;
   try
   {
-    auto imageIndexResult = device.acquireNextImageKHR(swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphore, nullptr);
+    FrameProfiler::CpuScope scope(profiler, profileScopes.acquire);
+    auto imageIndexResult = device.acquireNextImageKHR(swapChain, std::numeric_limits<uint64_t>::max(), frame.imageAvailableSemaphore, nullptr);
     imageIndex = imageIndexResult.value;
   }
   catch (std::system_error const &e)
@@ -1245,8 +2465,19 @@ void HelloTriangleApplication::drawFrame()
     }
   }  
 
-  vk::Semaphore waitSemaphores[] = { imageAvailableSemaphore };
-  vk::Semaphore signalSemaphores[] = { renderFinishedSemaphore };
+  // The swap chain can hand images back out of order, so make sure an older frame isn't still using this one
+  if (imagesInFlight[imageIndex] && imagesInFlight[imageIndex] != frame.inFlightFence)
+  {
+    FrameProfiler::CpuScope scope(profiler, profileScopes.waitForFrame);
+    try { device.waitForFences(imagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max()); }
+    catch (std::system_error const &e) { cleanup(); throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to wait for swap chain image fence!"), e); }
+  }
+  imagesInFlight[imageIndex] = frame.inFlightFence;
+
+  recordCommandBuffer(currentFrame, imageIndex);
+
+  vk::Semaphore waitSemaphores[] = { frame.imageAvailableSemaphore };
+  vk::Semaphore signalSemaphores[] = { frame.renderFinishedSemaphore };
 
   vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
   vk::SubmitInfo submitInfo;
@@ -1254,12 +2485,19 @@ void HelloTriangleApplication::drawFrame()
             .setPWaitSemaphores(waitSemaphores)
             .setPWaitDstStageMask(waitStages)
             .setCommandBufferCount(1)
-            .setPCommandBuffers(&commandBuffers[imageIndex])
+            .setPCommandBuffers(&commandBuffers[currentFrame])
             .setSignalSemaphoreCount(1)
             .setPSignalSemaphores(signalSemaphores);
 
-  try { graphicsQueue.submit(submitInfo, nullptr); }
-  catch (std::system_error const &e) { cleanup(); throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to submit to graphics queue!"), e); }
+  // Only reset once we know we're going to submit, otherwise the next wait on this slot would never return
+  device.resetFences(frame.inFlightFence);
+
+  {
+    FrameProfiler::CpuScope scope(profiler, profileScopes.submit);
+    try { graphicsQueue.submit(submitInfo, frame.inFlightFence); }
+    catch (std::system_error const &e) { cleanup(); throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to submit to graphics queue!"), e); }
+  }
+  profiler.markSubmitted(currentFrame);
 
   vk::SwapchainKHR swapChains[] = { swapChain };
   vk::PresentInfoKHR presentInfo;
@@ -1272,6 +2510,7 @@ void HelloTriangleApplication::drawFrame()
 
   try
   {
+    FrameProfiler::CpuScope scope(profiler, profileScopes.present);
     presentQueue.presentKHR(presentInfo);
   }
   catch (std::system_error const &e)
@@ -1286,29 +2525,207 @@ void HelloTriangleApplication::drawFrame()
       throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to present swap chain image!"), e);
     }
   }
-  presentQueue.waitIdle();
+
+  currentFrame = (currentFrame + 1) % framesInFlight;
+}
+
+void HelloTriangleApplication::headlessLoop()
+{
+  startTime = std::chrono::high_resolution_clock::now();
+
+  for (uint32_t frame = 0; frame < settings.frameCount; frame++)
+  {
+    FrameProfiler::CpuScope frameScope(profiler, profileScopes.frame);
+    drawHeadlessFrame();
+  }
+
+  device.waitIdle();
+
+  auto endTime = std::chrono::high_resolution_clock::now();
+  float seconds = std::chrono::duration<float, std::chrono::seconds::period>(endTime - startTime).count();
+  runStatistics.frames = settings.frameCount;
+  runStatistics.seconds = seconds;
+
+  std::cout << "Rendered " << settings.frameCount << " headless frames in " << seconds << "s ("
+            << (seconds > 0.f ? settings.frameCount / seconds : 0.f) << " fps)" << std::endl;
+
+  // Frames still being consumed count towards the readback's time, not the render's
+  if (settings.readbackMode != ReadbackMode::Disabled)
+  {
+    frameReadback.flush();
+    endTime = std::chrono::high_resolution_clock::now();
+    reportReadback(std::chrono::duration<double>(endTime - startTime).count());
+  }
+}
+
+void HelloTriangleApplication::drawHeadlessFrame()
+{
+  FrameContext &frame = frameContexts[currentFrame];
+
+  // Each frame slot owns its own offscreen image, so there's no acquire step and no per-image tracking
+  uint32_t imageIndex = currentFrame;
+
+  {
+    FrameProfiler::CpuScope scope(profiler, profileScopes.waitForFrame);
+    try { device.waitForFences(frame.inFlightFence, VK_TRUE, std::numeric_limits<uint64_t>::max()); }
+    catch (std::system_error const &e) { cleanup(); throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to wait for frame fence!"), e); }
+  }
+
+  // The frame slot's image is free again, but the readback slot it copies into may still be with the consumer
+  if (settings.readbackMode != ReadbackMode::Disabled)
+  {
+    FrameProfiler::CpuScope scope(profiler, profileScopes.readback);
+    readbackSlot = frameReadback.acquireSlot();
+  }
+
+  profiler.collectGpuResults(currentFrame);
+  collectCullingResults(currentFrame);
+  commandRecorder.beginFrame(currentFrame);
+  descriptorAllocator.resetFrame(currentFrame);
+  geometryPool.beginFrame();
+  updateUniformBuffer(currentFrame);
+  updateInstanceBuffer(currentFrame);
+  recordCommandBuffer(currentFrame, imageIndex);
+
+  vk::SubmitInfo submitInfo;
+  submitInfo.setWaitSemaphoreCount(0)
+            .setCommandBufferCount(1)
+            .setPCommandBuffers(&commandBuffers[currentFrame])
+            .setSignalSemaphoreCount(0);
+
+  device.resetFences(frame.inFlightFence);
+
+  {
+    FrameProfiler::CpuScope scope(profiler, profileScopes.submit);
+    try { graphicsQueue.submit(submitInfo, frame.inFlightFence); }
+    catch (std::system_error const &e) { cleanup(); throw UnrecoverableVulkanException(CreateBasicExceptionMessage("Failed to submit to graphics queue!"), e); }
+  }
+  profiler.markSubmitted(currentFrame);
+  if (settings.readbackMode != ReadbackMode::Disabled) frameReadback.submitted(readbackSlot);
+
+  currentFrame = (currentFrame + 1) % framesInFlight;
+}
+
+void HelloTriangleApplication::consumeReadbackFrame(ReadbackFrame const &frame)
+{
+  if (settings.readbackMode == ReadbackMode::Hash)
+  {
+    frameHashes[frame.frameNumber] = hashReadbackFrame(frame);
+  }
+  else
+  {
+    char name[32];
+    snprintf(name, sizeof(name), "frame_%06llu.ppm", static_cast<unsigned long long>(frame.frameNumber));
+    std::string directory = settings.readbackOutputPath.empty() ? "." : settings.readbackOutputPath;
+    writeReadbackPpm(frame, directory + "/" + name);
+  }
+}
+
+void HelloTriangleApplication::reportReadback(double seconds)
+{
+  runStatistics.readbackFrames = frameReadback.getFramesConsumed();
+  runStatistics.readbackBytes = frameReadback.getBytesConsumed();
+  runStatistics.readbackSeconds = seconds;
+  runStatistics.readbackStalls = frameReadback.getStalls();
+
+  double megabytes = runStatistics.readbackBytes / (1024.0 * 1024.0);
+  std::cout << "Read back " << runStatistics.readbackFrames << " frames (" << megabytes << " MB) in " << seconds << "s ("
+            << (seconds > 0.0 ? runStatistics.readbackFrames / seconds : 0.0) << " fps, "
+            << (seconds > 0.0 ? megabytes / seconds : 0.0) << " MB/s, "
+            << runStatistics.readbackStalls << " stalls)" << std::endl;
+
+  if (settings.readbackMode != ReadbackMode::Hash) return;
+
+  // One checksum over the lot, so two runs can be compared at a glance
+  uint64_t combined = 14695981039346656037ULL;
+  for (uint64_t hash : frameHashes)
+  {
+    combined ^= hash;
+    combined *= 1099511628211ULL;
+  }
+  std::cout << "Frame hash: " << std::hex << std::setw(16) << std::setfill('0') << combined << std::dec << std::setfill(' ') << std::endl;
+
+  if (settings.readbackOutputPath.empty()) return;
+
+  std::ofstream file(settings.readbackOutputPath, std::ios::trunc);
+  if (!file.is_open())
+  {
+    std::cerr << "Failed to write frame hashes to " << settings.readbackOutputPath << std::endl;
+    return;
+  }
+  file << std::hex << std::setfill('0');
+  for (size_t i = 0; i < frameHashes.size(); i++)
+  {
+    file << std::dec << i << " " << std::hex << std::setw(16) << frameHashes[i] << "\n";
+  }
+  std::cout << "Wrote frame hashes to " << settings.readbackOutputPath << std::endl;
 }
 
 void HelloTriangleApplication::cleanup()
 {
   cleanupSwapChain();
+  cleanupFrameContexts();
+
+  if (graphicsPipeline)         device.destroyPipeline(graphicsPipeline);
+  if (pipelineLayout)           device.destroyPipelineLayout(pipelineLayout);
+  if (cullingPipeline)          device.destroyPipeline(cullingPipeline);
+  if (cullingPipelineLayout)    device.destroyPipelineLayout(cullingPipelineLayout);
+  if (renderPass)               device.destroyRenderPass(renderPass);
+  if (swapChain)                device.destroySwapchainKHR(swapChain);
+  if (settings.headless)        cleanupOffscreenTargets();
 
-  if (imageAvailableSemaphore)  device.destroySemaphore(imageAvailableSemaphore);
-  if (renderFinishedSemaphore)  device.destroySemaphore(renderFinishedSemaphore);
   if (commandPool)              device.destroyCommandPool(commandPool);  
+  if (device)                   commandRecorder.destroy();
+  uploadQueue.destroy();
+  if (device) profiler.destroy();
+  if (device && pipelineCache.get())
+  {
+    pipelineCache.printStats(std::cout);
+    pipelineCache.save();
+    pipelineCache.destroy();
+  }
+  if (stagingRingBuffer)        device.destroyBuffer(stagingRingBuffer);
+  geometryPool.destroy();
   if (vertexBuffer)             device.destroyBuffer(vertexBuffer);
-  if (vertexBufferMemory)       device.freeMemory(vertexBufferMemory);
   if (indexBuffer)              device.destroyBuffer(indexBuffer);
-  if (indexBufferMemory)        device.freeMemory(indexBufferMemory);
+  if (drawCommandBuffer)        device.destroyBuffer(drawCommandBuffer);
+  if (drawObjectBuffer)         device.destroyBuffer(drawObjectBuffer);
+  if (drawCountBuffer)          device.destroyBuffer(drawCountBuffer);
+  if (boundsBuffer)             device.destroyBuffer(boundsBuffer);
+  if (visibleCommandBuffer)     device.destroyBuffer(visibleCommandBuffer);
+  if (visibleObjectBuffer)      device.destroyBuffer(visibleObjectBuffer);
+  if (instanceCountBuffer)      device.destroyBuffer(instanceCountBuffer);
+  if (visibleInstanceBuffer)    device.destroyBuffer(visibleInstanceBuffer);
+  if (instanceListBuffer)       device.destroyBuffer(instanceListBuffer);
+  if (visibleCountReadbackBuffer) device.destroyBuffer(visibleCountReadbackBuffer);
   if (uniformBuffer)            device.destroyBuffer(uniformBuffer);
-  if (uniformBufferMemory)      device.freeMemory(uniformBufferMemory);
-  if (descriptorSetLayout)      device.destroyDescriptorSetLayout(descriptorSetLayout);
-  if (descriptorPool)           device.destroyDescriptorPool(descriptorPool);
+  if (cameraBuffer)             device.destroyBuffer(cameraBuffer);
+  if (instanceBuffer)           device.destroyBuffer(instanceBuffer);
+  if (device)
+  {
+    memoryAllocator.free(stagingRingAllocation);
+    memoryAllocator.free(vertexBufferAllocation);
+    memoryAllocator.free(indexBufferAllocation);
+    memoryAllocator.free(drawCommandBufferAllocation);
+    memoryAllocator.free(drawObjectBufferAllocation);
+    memoryAllocator.free(drawCountBufferAllocation);
+    memoryAllocator.free(boundsBufferAllocation);
+    memoryAllocator.free(visibleCommandBufferAllocation);
+    memoryAllocator.free(visibleObjectBufferAllocation);
+    memoryAllocator.free(instanceCountBufferAllocation);
+    memoryAllocator.free(visibleInstanceBufferAllocation);
+    memoryAllocator.free(instanceListBufferAllocation);
+    memoryAllocator.free(visibleCountReadbackAllocation);
+    memoryAllocator.free(uniformBufferAllocation);
+    memoryAllocator.free(cameraBufferAllocation);
+    memoryAllocator.free(instanceBufferAllocation);
+    memoryAllocator.destroy();
+  }
+  if (device)                   descriptorAllocator.destroy();
   if (device)                   device.destroy();
   if (callback)                 removeDebugCallback();
   if (surface)                  instance.destroySurfaceKHR(surface);
   if (instance)                 instance.destroy();
 
-  glfwDestroyWindow(window);
-  glfwTerminate();
+  jobSystem.destroy();
 }
@@ -10,7 +10,28 @@
 
 #include "UnrecoverableException.hpp"
 
+#include "ApplicationSettings.hpp"
+#include "DeviceMemoryAllocator.hpp"
+#include "DescriptorAllocator.hpp"
+#include "UploadQueue.hpp"
+#include "PipelineCache.hpp"
+#include "FrameProfiler.hpp"
+#include "UniformRing.hpp"
+#include "PushConstants.hpp"
+#include "JobSystem.hpp"
+#include "CommandRecorder.hpp"
+#include "SpscQueue.hpp"
+#include "FrameReadback.hpp"
+#include "MappedFile.hpp"
+#include "MeshFile.hpp"
+#include "IndexLayout.hpp"
+#include "GeometryPool.hpp"
+#include "MeshOptimizer.hpp"
+#include "FrustumCulling.hpp"
+#include "TransformBatch.hpp"
+#include "Benchmark.hpp"
 #include "Vertex.hpp"
+#include "InstanceData.hpp"
 #include "UniformBufferObject.hpp"
 
 #include <iostream>
@@ -21,27 +42,14 @@
 #include <set>
 #include <algorithm>
 #include <fstream>
+#include <iomanip>
+#include <cstdio>
+#include <cstring>
 #include <chrono>
-
-static std::vector<char> readBinaryFile(const std::string &filename)
-{
-  std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-  if (!file.is_open())
-  {
-    throw std::runtime_error("Failed to open file!");
-  }
-
-  size_t fileSize = static_cast<size_t>(file.tellg());
-  std::vector<char> buffer(fileSize);
-
-  file.seekg(0);
-  file.read(buffer.data(), fileSize);
-
-  file.close();
-
-  return buffer;
-}
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <exception>
 
 class HelloTriangleApplication
 {
@@ -49,6 +57,7 @@ class HelloTriangleApplication
   {
     int graphicsFamily = -1;
     int presentFamily = -1;
+    int transferFamily = -1; // Falls back to graphicsFamily when there's no dedicated transfer family
 
     bool isComplete()
     {
@@ -63,11 +72,42 @@ class HelloTriangleApplication
     std::vector<vk::PresentModeKHR> presentModes;
   };
 
+  // Everything a single frame in flight needs to own
+  struct FrameContext
+  {
+    vk::Semaphore imageAvailableSemaphore;
+    vk::Semaphore renderFinishedSemaphore;
+    vk::Fence inFlightFence;
+  };
+
+  // What the window thread tells the render thread
+  struct RenderMessage
+  {
+    enum class Type
+    {
+      Snapshot, // Simulation state to draw from now on
+      Resize,   // Window resized, the swap chain needs rebuilding
+      Quit
+    };
+
+    Type type;
+    float time;          // Snapshot, seconds since the loop started
+    vk::Extent2D extent; // Resize
+  };
+
 public:
+  static const uint32_t MaxFramesInFlight = 3;
+
+  HelloTriangleApplication(ApplicationSettings const &_settings = ApplicationSettings());
+
   void run();
 
+  // Valid once run() has returned
+  RunStatistics const &getRunStatistics() const { return runStatistics; }
+
 private:
   void initWindow();
+  void cleanupWindow();
 
   void initVulkan();
   bool checkValidationLayerSupport();
@@ -80,10 +120,10 @@ private:
   bool isDeviceSuitable(vk::PhysicalDevice device);
   QueueFamilyIndices findQueueFamilies(vk::PhysicalDevice device);
   uint32_t findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties);
+  bool tryFindMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties, uint32_t &memoryTypeIndex);
   void createLogicalDevice();
   void createSurface();
-  void createBuffer(vk::DeviceSize size, vk::BufferUsageFlags, vk::MemoryPropertyFlags, vk::Buffer &buffer, vk::DeviceMemory &bufferMemory);
-  void copyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size);
+  void createBuffer(vk::DeviceSize size, vk::BufferUsageFlags, vk::MemoryPropertyFlags, vk::Buffer &buffer, MemoryAllocation &bufferAllocation, vk::MemoryPropertyFlags preferredProperties = vk::MemoryPropertyFlags());
   bool checkDeviceExtensionSupport(vk::PhysicalDevice device);
   SwapChainSupportDetails querySwapChainSupport(vk::PhysicalDevice device);
   vk::SurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<vk::SurfaceFormatKHR> &availableFormats);
@@ -92,32 +132,81 @@ private:
   void createSwapChain();
   void createImageViews();
   void createDescriptorSetLayout();
+  void createPipelineCache();
+  void createProfiler();
+  void reportProfile();
+  void createPipelineLayout();
   void createGraphicsPipeline();
-  vk::ShaderModule createShaderModule(const std::vector<char> &code);
+  void createCullingPipeline();
+  vk::ShaderModule createShaderModule(MappedFile const &code);
   void createRenderPass();
   void createFramebuffers();
   void createCommandPool();
-  void createVertexBuffer();
-  void createIndexBuffer();
+  void createUploadQueue();
+  void createGeometryPool();
+  void uploadVertices();
+  void uploadIndices();
+  void createDrawCommands();
+  void createCullingBuffers();
   void createUniformBuffer();
-  void createDescriptorPool();
+  void createInstanceBuffer();
   void createDescriptorSet();
+  void writeDescriptorSet();
   void createCommandBuffers();
-  void createSemaphores();
+  void recordCommandBuffer(uint32_t frame, uint32_t imageIndex);
+  void bindScene(vk::CommandBuffer commandBuffer, uint32_t frame);
+  void recordDraws(vk::CommandBuffer commandBuffer, uint32_t frame, uint32_t firstCommand, uint32_t count);
+  void recordIndirectDraws(vk::CommandBuffer commandBuffer, uint32_t frame);
+  bool usesDrawIndirectCount() const;
+  void recordCulling(vk::CommandBuffer commandBuffer, uint32_t frame);
+  void collectCullingResults(uint32_t frame);
+  void createFrameContexts();
+  void cleanupFrameContexts();
   void recreateSwapChain();
   void cleanupSwapChain();
 
+  void createOffscreenTargets();
+  void cleanupOffscreenTargets();
+
   void setupRenderables();
+  void setupMesh();
+  void optimizeMesh();
+  void chooseIndexLayout(uint32_t const *source);
+  void reportIndexLayout();
+  void setupDrawsAndInstances();
 
   void mainLoop();
-  void updateUniformBuffer();
+  void renderLoop();
+  void processRenderMessages();
+  void updateUniformBuffer(uint32_t region);
+  void updateInstanceBuffer(uint32_t region);
   void drawFrame();
 
+  void headlessLoop();
+  void drawHeadlessFrame();
+  void consumeReadbackFrame(ReadbackFrame const &frame);
+  void reportReadback(double seconds);
+
   void cleanup();
 
+  ApplicationSettings settings;
+
   // GLFW stuff
   const uint32_t WindowWidth = 800, WindowHeight = 600;
-  GLFWwindow *window;
+  GLFWwindow *window = nullptr;
+
+  // The window thread only polls events and posts messages, everything Vulkan happens on the render thread.
+  // Snapshots are posted at least this often, and dropped rather than waited on if the render thread falls behind.
+  const double SnapshotInterval = 1.0 / 240.0;
+  std::thread renderThread;
+  SpscQueue<RenderMessage, 256> renderMessages;
+  std::atomic<bool> renderThreadDone{ false };
+  std::exception_ptr renderError;
+  bool quitRendering = false;     // Render thread
+  float snapshotTime = 0.f;       // Render thread, from the latest snapshot
+  vk::Extent2D windowExtent;      // Render thread after start up, last size posted by the window thread
+  bool resizePending = false;     // Window thread, a resize the queue had no room for yet
+  vk::Extent2D pendingExtent;     // Window thread
 
   // Vulkan stuff
   vk::Instance instance;
@@ -127,6 +216,9 @@ private:
   vk::Queue graphicsQueue;
   vk::SurfaceKHR surface;
   vk::Queue presentQueue;
+  vk::Queue transferQueue;
+  uint32_t graphicsQueueFamily;
+  uint32_t transferQueueFamily;
   vk::SwapchainKHR swapChain;
   std::vector<vk::Image> swapChainImages;
   vk::Format swapChainImageFormat;
@@ -137,23 +229,165 @@ private:
   vk::RenderPass renderPass;
   vk::Pipeline graphicsPipeline;
   std::vector<vk::Framebuffer> swapChainFramebuffers;
-  vk::DescriptorPool descriptorPool;
   vk::DescriptorSet descriptorSet;
   vk::CommandPool commandPool;
-  std::vector<vk::CommandBuffer> commandBuffers;
-  vk::Semaphore imageAvailableSemaphore;
-  vk::Semaphore renderFinishedSemaphore;
+  std::vector<vk::CommandBuffer> commandBuffers; // Primary per frame in flight
+
+  // Below this many draws everything is recorded inline on the calling thread
+  static const uint32_t MinDrawsForParallelRecording = 128;
+  CommandRecorder commandRecorder;
+
+  // Per-object work is split into jobs of this many objects, anything smaller is done inline
+  static const uint32_t ObjectsPerJob = 1024;
+  JobSystem jobSystem;
+
+  DeviceMemoryAllocator memoryAllocator;
+  DescriptorAllocator descriptorAllocator; // Owns every descriptor set layout and pool
+  PipelineCache pipelineCache;
+
+  // Profiling
+  FrameProfiler profiler;
+  struct ProfileScopes
+  {
+    FrameProfiler::ScopeId frame;
+    FrameProfiler::ScopeId waitForFrame;
+    FrameProfiler::ScopeId acquire;
+    FrameProfiler::ScopeId updateUniforms;
+    FrameProfiler::ScopeId updateInstances;
+    FrameProfiler::ScopeId readback;
+    FrameProfiler::ScopeId record;
+    FrameProfiler::ScopeId submit;
+    FrameProfiler::ScopeId present;
+    FrameProfiler::ScopeId gpuFrame;
+    FrameProfiler::ScopeId gpuCulling;
+    FrameProfiler::ScopeId gpuRenderPass;
+  } profileScopes;
+  RunStatistics runStatistics;
+
+  // Animation time, see ApplicationSettings::fixedTimeStep
+  std::chrono::high_resolution_clock::time_point startTime;
+  uint64_t frameNumber = 0;
+  float animationTime = 0.f; // Seconds, as of the last updateUniformBuffer()
+
+  // Uploads
+  static const vk::DeviceSize StagingRingSize = 16 * 1024 * 1024;
+  UploadQueue uploadQueue;
+  vk::Buffer stagingRingBuffer;
+  MemoryAllocation stagingRingAllocation;
+  UploadQueue::Ticket geometryUploadTicket = 0;
+
+  // Frames in flight
+  uint32_t framesInFlight;
+  uint32_t currentFrame = 0;
+  std::vector<FrameContext> frameContexts;
+  std::vector<vk::Fence> imagesInFlight; // Fence of the frame last submitted for each swap chain image, if any
 
+  // Headless stuff, the offscreen images stand in for swapChainImages
+  std::vector<MemoryAllocation> offscreenImageAllocations;
+
+  // Readback ring, a couple of slots more than there are frames in flight give the consumer some slack
+  static const uint32_t ExtraReadbackSlots = 2;
+  FrameReadback frameReadback;
+  std::vector<vk::Buffer> readbackBuffers; // One per readback slot
+  std::vector<MemoryAllocation> readbackBufferAllocations;
+  uint32_t readbackSlot = 0; // Slot the frame being recorded copies into
+  std::vector<uint64_t> frameHashes; // ReadbackMode::Hash, indexed by frame number
+
+  // Geometry pool buffers, every mesh lives in a range of these
+  static constexpr vk::DeviceSize GeometryPoolVertexBytes = 32 * 1024 * 1024;
+  static constexpr vk::DeviceSize GeometryPoolIndexBytes = 16 * 1024 * 1024;
+  GeometryPool geometryPool;
+  GeometryAllocation meshGeometry;
   vk::Buffer vertexBuffer;
-  vk::DeviceMemory vertexBufferMemory;
+  MemoryAllocation vertexBufferAllocation;
   vk::Buffer indexBuffer;
-  vk::DeviceMemory indexBufferMemory;
+  MemoryAllocation indexBufferAllocation;
   vk::Buffer uniformBuffer;
-  vk::DeviceMemory uniformBufferMemory;
+  MemoryAllocation uniformBufferAllocation;
+  UniformRing uniformRing; // One region per frame in flight, one element per draw
+  vk::Buffer cameraBuffer;
+  MemoryAllocation cameraBufferAllocation;
+  UniformRing cameraRing; // One CameraUniforms per frame in flight
+  UniformRing instanceRing; // One region of instanceCount InstanceData per frame in flight
+  vk::Buffer instanceBuffer;
+  MemoryAllocation instanceBufferAllocation;
 
-  // Stuff to render
+  // Stuff to render, either the generated grid in vertices/indices or a mesh file mapped until it's uploaded
   std::vector<Vertex> vertices;
-  std::vector<uint16_t> indices;
+  std::vector<uint32_t> indices;
+  MeshFile meshFile;
+  IndexLayout indexLayout; // How the index buffer is stored and drawn
+  uint32_t vertexCount = 0;
+  uint32_t indexCount = 0;
+  uint32_t drawFirstIndex = 0; // The range drawn, a LOD of the mesh file
+  uint32_t drawIndexCount = 0;
+  uint32_t indicesPerPiece = 6; // Draws split the range on whole pieces: squares of the grid, a mesh's triangles
+  uint32_t drawCount = 1;
+
+  // Draw commands, one per draw and sub-mesh it crosses, with the object (uniform ring element) each one draws.
+  // The GPU reads them from drawCommandBuffer, the direct path from drawCommands.
+  struct DrawConstants
+  {
+    uint32_t firstCommand; // Added to gl_DrawIDARB, see triangle.vert. Starts at the frame's region with culling.
+  };
+  PushConstantBlock<DrawConstants> drawPushConstants = { vk::ShaderStageFlagBits::eVertex, 0 };
+  std::vector<vk::DrawIndexedIndirectCommand> drawCommands;
+  std::vector<uint32_t> drawObjects;
+  vk::Buffer drawCommandBuffer;
+  MemoryAllocation drawCommandBufferAllocation;
+  vk::Buffer drawObjectBuffer;
+  MemoryAllocation drawObjectBufferAllocation;
+  vk::Buffer drawCountBuffer; // Just the command count, read by drawIndexedIndirectCountAMD. One per frame in flight with culling.
+  MemoryAllocation drawCountBufferAllocation;
+  bool multiDrawIndirectSupported = false;
+  bool drawIndirectCountSupported = false;
+  uint32_t maxDrawIndirectCount = 1;
+
+  // GPU culling, see recordCulling(). The compute passes list the visible instances of each command, then write
+  // the commands with any left and the objects they draw, and count them in drawCountBuffer, which the render pass
+  // then draws from. Like UniformRing every output has a region per frame in flight, so one frame's culling never
+  // waits on the previous frame's draws.
+  struct CullConstants
+  {
+    Frustum frustum; // World space, from the latest updateUniformBuffer()
+    uint32_t commandCount;
+    uint32_t instanceCount;
+    uint32_t frame; // Picks the region of each output
+    uint32_t pass; // 0 tests instances, 1 compacts commands
+    uint32_t firstCommand; // Of the instance pass's dispatch
+  };
+  PushConstantBlock<CullConstants> cullPushConstants = { vk::ShaderStageFlagBits::eCompute, 0 };
+  static const uint32_t CullGroupSize = 64; // local_size_x in cull.comp
+  static const uint32_t CullingBindingCount = 10;
+  uint32_t maxCullCommandsPerDispatch = 1; // maxComputeWorkGroupCount[1]
+  bool cullingEnabled = false;
+  CullConstants cullConstants = {};
+  std::vector<BoundingSphere> drawBounds; // Object space, one per draw command, tested against each instance
+  vk::DescriptorSetLayout cullingDescriptorSetLayout;
+  vk::PipelineLayout cullingPipelineLayout;
+  vk::Pipeline cullingPipeline;
+  vk::DescriptorSet cullingDescriptorSet;
+  vk::Buffer boundsBuffer;
+  MemoryAllocation boundsBufferAllocation;
+  vk::Buffer visibleCommandBuffer; // commandCount per frame in flight, as are the objects
+  MemoryAllocation visibleCommandBufferAllocation;
+  vk::Buffer visibleObjectBuffer;
+  MemoryAllocation visibleObjectBufferAllocation;
+  vk::Buffer instanceCountBuffer; // Visible instances of each command, commandCount per frame in flight
+  MemoryAllocation instanceCountBufferAllocation;
+  vk::Buffer visibleInstanceBuffer; // instanceCount slots per command, per frame in flight. Read by triangle.vert.
+  MemoryAllocation visibleInstanceBufferAllocation;
+  vk::Buffer visibleCountReadbackBuffer; // A count per frame in flight, copied back for the statistics
+  MemoryAllocation visibleCountReadbackAllocation;
+  std::vector<bool> visibleCountPending;
+  uint64_t visibleCommandTotal = 0;
+  uint64_t visibleCountFrames = 0;
+  uint32_t instanceCount = 1;
+  std::vector<InstanceData> instances; // Rewritten every frame, then copied into the instance ring
+  vk::Buffer instanceListBuffer; // 0 to instanceCount - 1, the instances every command draws without culling
+  MemoryAllocation instanceListBufferAllocation;
+  TransformBatch instanceTransforms; // Where each instance sits and how fast it spins, instances are built from it
+  TransformKernels const *transformKernels = nullptr;
 
   const std::vector<const char*> validationLayers = 
   {
@@ -164,6 +398,11 @@ private:
   {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME
   };
+  // Needed headless too, the vertex shader uses gl_DrawIDARB
+  const std::vector<const char*> drawDeviceExtensions =
+  {
+    VK_KHR_SHADER_DRAW_PARAMETERS_EXTENSION_NAME
+  };
 #ifdef NDEBUG
   const bool enableValidationLayers = false;
 #else
@@ -203,8 +442,10 @@ private:
   {
     if (width == 0 || height == 0) return;
 
+    // Called from inside glfwWaitEventsTimeout() on the window thread, the render thread picks it up
     HelloTriangleApplication *app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
-    app->recreateSwapChain();
+    app->resizePending = true;
+    app->pendingExtent = vk::Extent2D(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
   }
 
   // Graphics card stuff
@@ -0,0 +1,92 @@
+#include "IndexLayout.hpp"
+
+#include <algorithm>
+
+IndexLayout IndexLayoutBuilder::choose(uint32_t const *indices, uint32_t indexCount)
+{
+  IndexLayout layout;
+  layout.indexCount = indexCount;
+
+  uint32_t maxIndex = 0;
+  for (uint32_t i = 0; i < indexCount; i++) maxIndex = std::max(maxIndex, indices[i]);
+
+  if (maxIndex <= 0xFFFF)
+  {
+    layout.indexType = vk::IndexType::eUint16;
+    layout.subMeshes.push_back({ 0, indexCount, 0 });
+    return layout;
+  }
+
+  // Cut on whole triangles wherever the next one would stretch the sub-mesh's vertex span past 16 bits
+  std::vector<SubMesh> subMeshes;
+  uint32_t first = 0;
+  uint32_t low = ~0U;
+  uint32_t high = 0;
+  bool splittable = indexCount % 3 == 0; // Stray indices after the last triangle aren't tracked by the walk
+  for (uint32_t triangle = 0; triangle + 3 <= indexCount; triangle += 3)
+  {
+    uint32_t triangleLow = std::min({ indices[triangle], indices[triangle + 1], indices[triangle + 2] });
+    uint32_t triangleHigh = std::max({ indices[triangle], indices[triangle + 1], indices[triangle + 2] });
+
+    // No sub-mesh can hold a triangle which spans more than 16 bits on its own
+    if (triangleHigh - triangleLow > 0xFFFF)
+    {
+      splittable = false;
+      break;
+    }
+
+    uint32_t newLow = std::min(low, triangleLow);
+    uint32_t newHigh = std::max(high, triangleHigh);
+    if (triangle > first && newHigh - newLow > 0xFFFF)
+    {
+      subMeshes.push_back({ first, triangle - first, static_cast<int32_t>(low) });
+      if (subMeshes.size() > MaxSubMeshes) break;
+
+      first = triangle;
+      newLow = triangleLow;
+      newHigh = triangleHigh;
+    }
+    low = newLow;
+    high = newHigh;
+  }
+  subMeshes.push_back({ first, indexCount - first, static_cast<int32_t>(low) });
+
+  // A single sub-mesh means the used vertices fit 16 bits once rebased, which costs nothing extra
+  uint64_t bytesSaved = static_cast<uint64_t>(indexCount) * 2;
+  bool cheaper = splittable
+              && subMeshes.size() <= MaxSubMeshes
+              && (subMeshes.size() == 1 || bytesSaved / (subMeshes.size() - 1) >= MinBytesSavedPerSubMesh);
+
+  if (cheaper)
+  {
+    layout.indexType = vk::IndexType::eUint16;
+    layout.subMeshes = std::move(subMeshes);
+  }
+  else
+  {
+    layout.indexType = vk::IndexType::eUint32;
+    layout.subMeshes.push_back({ 0, indexCount, 0 });
+  }
+  return layout;
+}
+
+void IndexLayoutBuilder::write(IndexLayout const &layout, uint32_t const *indices, uint32_t first, uint32_t count, void *destination)
+{
+  if (layout.indexType == vk::IndexType::eUint32)
+  {
+    std::copy(indices + first, indices + first + count, static_cast<uint32_t*>(destination));
+    return;
+  }
+
+  uint16_t *out = static_cast<uint16_t*>(destination);
+  uint32_t end = first + count;
+  for (SubMesh const &subMesh : layout.subMeshes)
+  {
+    uint32_t begin = std::max(first, subMesh.firstIndex);
+    uint32_t finish = std::min(end, subMesh.firstIndex + subMesh.indexCount);
+    for (uint32_t i = begin; i < finish; i++)
+    {
+      *out++ = static_cast<uint16_t>(indices[i] - static_cast<uint32_t>(subMesh.baseVertex));
+    }
+  }
+}
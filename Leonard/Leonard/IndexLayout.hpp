@@ -0,0 +1,42 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// A range of the index buffer drawn with its own base vertex, so 16 bit indices can address any vertex
+struct SubMesh
+{
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  int32_t baseVertex;
+};
+
+// How a mesh's indices are stored on the GPU
+struct IndexLayout
+{
+  vk::IndexType indexType = vk::IndexType::eUint16;
+  std::vector<SubMesh> subMeshes; // Cover every index in order, just the one unless 16 bit indices were split
+  uint64_t indexCount = 0;
+
+  uint32_t getIndexSize() const { return indexType == vk::IndexType::eUint16 ? 2 : 4; }
+  uint64_t getSize() const { return indexCount * getIndexSize(); }
+  uint64_t getSizeSaved() const { return indexCount * 4 - getSize(); } // Against plain 32 bit indices
+};
+
+// Picks 16 bit indices when every index fits. Otherwise the triangles are walked in order and cut into sub-meshes
+// whose vertices span at most 65536, which is used as long as each extra sub-mesh (an extra draw call wherever a
+// draw crosses into it) saves at least MinBytesSavedPerSubMesh of index data. Anything else, including a mesh with
+// a single triangle spanning more than 65536 vertices, gets 32 bit indices.
+class IndexLayoutBuilder
+{
+public:
+  static const uint64_t MinBytesSavedPerSubMesh = 64 * 1024;
+  static const uint32_t MaxSubMeshes = 64;
+
+  static IndexLayout choose(uint32_t const *indices, uint32_t indexCount);
+
+  // Converts indices [first, first + count) to the layout's format at destination, 16 bit ones relative to their
+  // sub-mesh's base vertex. Works on any range so a big buffer can be streamed through a smaller staging ring.
+  static void write(IndexLayout const &layout, uint32_t const *indices, uint32_t first, uint32_t count, void *destination);
+};
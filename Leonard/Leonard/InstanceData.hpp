@@ -0,0 +1,17 @@
+#pragma once
+#include <glm/glm.hpp>
+
+// Per instance data, read from a storage buffer through a list of the instances each command draws, see
+// triangle.vert. Like ObjectUniforms only the model's top three rows are sent, the shaders read them as a mat3x4.
+struct InstanceData
+{
+  glm::vec4 modelRows[3];
+
+  static InstanceData fromModel(glm::mat4 const &model)
+  {
+    InstanceData instance;
+    for (int row = 0; row < 3; row++) instance.modelRows[row] = glm::vec4(model[0][row], model[1][row], model[2][row], model[3][row]);
+    return instance;
+  }
+};
+static_assert(sizeof(InstanceData) == 48, "InstanceData must be three vec4 rows");
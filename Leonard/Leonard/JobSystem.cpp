@@ -0,0 +1,226 @@
+#include "JobSystem.hpp"
+#include "UnrecoverableException.hpp"
+
+#include <algorithm>
+
+// Which system the current thread works for, and as which worker
+static thread_local JobSystem const *currentSystem = nullptr;
+static thread_local uint32_t currentWorker = JobSystem::ExternalThread;
+
+// Spins before a worker goes to sleep, most gaps between jobs within a frame are shorter than a wake up
+static const uint32_t IdleSpins = 256;
+
+void JobSystem::init(uint32_t threadCount)
+{
+  if (threadCount == 0) threadCount = std::thread::hardware_concurrency();
+  threadCount = std::min(std::max(threadCount, 1U), MaxThreads);
+
+  quit = false;
+  queuedJobs = 0;
+  sleepingWorkers = 0;
+
+  for (uint32_t i = 0; i < threadCount; i++)
+  {
+    workers.push_back(std::make_unique<Worker>());
+  }
+
+  currentSystem = this;
+  currentWorker = 0;
+
+  for (uint32_t i = 1; i < threadCount; i++)
+  {
+    workers[i]->thread = std::thread(&JobSystem::workerLoop, this, i);
+  }
+}
+
+void JobSystem::destroy()
+{
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    quit = true;
+  }
+  sleepCondition.notify_all();
+
+  for (auto &worker : workers)
+  {
+    if (worker->thread.joinable()) worker->thread.join();
+  }
+  workers.clear();
+  externalJobs.clear();
+  externalJobCount = 0;
+
+  if (currentSystem == this)
+  {
+    currentSystem = nullptr;
+    currentWorker = ExternalThread;
+  }
+}
+
+uint32_t JobSystem::getThreadIndex() const
+{
+  return currentSystem == this ? currentWorker : ExternalThread;
+}
+
+void JobSystem::run(std::function<void()> function, Counter *counter)
+{
+  if (counter) counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+  // Counted before it's visible, so a thief can never take queuedJobs below zero
+  queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+
+  uint32_t workerIndex = getThreadIndex();
+  if (workerIndex != ExternalThread)
+  {
+    Worker &worker = *workers[workerIndex];
+    Job &job = worker.jobs[worker.nextJob % MaxJobsPerThread];
+
+    // Every slot still in use (or the deque is full), just do it now rather than fail
+    if (job.busy.load(std::memory_order_acquire))
+    {
+      queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+      function();
+      if (counter) counter->pending.fetch_sub(1, std::memory_order_release);
+      return;
+    }
+
+    worker.nextJob++;
+    job.function = std::move(function);
+    job.counter = counter;
+    job.busy.store(true, std::memory_order_relaxed);
+    if (!worker.deque.push(&job))
+    {
+      queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+      execute(job);
+      return;
+    }
+  }
+  else
+  {
+    std::lock_guard<std::mutex> lock(externalMutex);
+    externalJobs.push_back({ std::move(function), counter });
+    externalJobCount.fetch_add(1, std::memory_order_release);
+  }
+
+  wakeWorker();
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t batchSize, std::function<void(uint32_t, uint32_t)> function, Counter *counter)
+{
+  batchSize = std::max(batchSize, 1U);
+  auto shared = std::make_shared<std::function<void(uint32_t, uint32_t)>>(std::move(function));
+
+  for (uint32_t first = 0; first < count; first += batchSize)
+  {
+    uint32_t batchCount = std::min(batchSize, count - first);
+    run([shared, first, batchCount] { (*shared)(first, batchCount); }, counter);
+  }
+}
+
+void JobSystem::wait(Counter &counter)
+{
+  uint32_t workerIndex = getThreadIndex();
+  while (!counter.isDone())
+  {
+    if (!runOneJob(workerIndex)) std::this_thread::yield();
+  }
+}
+
+void JobSystem::workerLoop(uint32_t workerIndex)
+{
+  currentSystem = this;
+  currentWorker = workerIndex;
+
+  uint32_t idle = 0;
+  while (!quit.load(std::memory_order_relaxed))
+  {
+    if (runOneJob(workerIndex))
+    {
+      idle = 0;
+      continue;
+    }
+
+    if (++idle < IdleSpins)
+    {
+      std::this_thread::yield();
+      continue;
+    }
+
+    // Nothing anywhere, sleep until a job is queued. sleepingWorkers is bumped before queuedJobs is checked
+    // and run() bumps queuedJobs before checking sleepingWorkers, so a wake up can't slip between the two.
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+    sleepCondition.wait(lock, [this] { return quit.load() || queuedJobs.load(std::memory_order_seq_cst) > 0; });
+    sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+    idle = 0;
+  }
+}
+
+bool JobSystem::runOneJob(uint32_t workerIndex)
+{
+  // Own work first (newest, still warm in cache), then anything from outside, then steal the oldest from others
+  if (workerIndex != ExternalThread)
+  {
+    if (Job *job = workers[workerIndex]->deque.pop())
+    {
+      queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+      execute(*job);
+      return true;
+    }
+  }
+
+  if (externalJobCount.load(std::memory_order_acquire) > 0)
+  {
+    ExternalJob job;
+    bool found = false;
+    {
+      std::lock_guard<std::mutex> lock(externalMutex);
+      if (!externalJobs.empty())
+      {
+        job = std::move(externalJobs.front());
+        externalJobs.pop_front();
+        externalJobCount.fetch_sub(1, std::memory_order_relaxed);
+        found = true;
+      }
+    }
+    if (found)
+    {
+      queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+      job.function();
+      if (job.counter) job.counter->pending.fetch_sub(1, std::memory_order_release);
+      return true;
+    }
+  }
+
+  if (workerIndex == ExternalThread) return false;
+
+  uint32_t workerCount = static_cast<uint32_t>(workers.size());
+  for (uint32_t i = 1; i < workerCount; i++)
+  {
+    uint32_t victim = (workerIndex + i) % workerCount;
+    if (Job *job = workers[victim]->deque.steal())
+    {
+      queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+      execute(*job);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void JobSystem::execute(Job &job)
+{
+  Counter *counter = job.counter;
+  job.function();
+  job.function = nullptr;
+  job.busy.store(false, std::memory_order_release);
+  if (counter) counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::wakeWorker()
+{
+  if (sleepingWorkers.load(std::memory_order_seq_cst) == 0) return;
+
+  std::lock_guard<std::mutex> lock(sleepMutex);
+  sleepCondition.notify_one();
+}
@@ -0,0 +1,153 @@
+#pragma once
+#include <atomic>
+#include <array>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cstdint>
+
+// Fixed capacity Chase-Lev deque. The owning thread pushes and pops at the bottom, any other thread may steal
+// from the top.
+template<typename T, size_t Capacity>
+class WorkStealingDeque
+{
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+  bool push(T *item)
+  {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= static_cast<int64_t>(Capacity)) return false;
+
+    items[b & (Capacity - 1)].store(item, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+  }
+
+  T *pop()
+  {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b)
+    {
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    T *item = items[b & (Capacity - 1)].load(std::memory_order_relaxed);
+    if (t == b)
+    {
+      // Last item, race any thieves for it
+      if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) item = nullptr;
+      bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  T *steal()
+  {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) return nullptr;
+
+    T *item = items[t & (Capacity - 1)].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+    return item;
+  }
+
+private:
+  std::array<std::atomic<T*>, Capacity> items;
+  std::atomic<int64_t> top{ 0 };
+  std::atomic<int64_t> bottom{ 0 };
+};
+
+// Work stealing job scheduler. The thread calling init() becomes worker 0 and only runs jobs while it waits on a
+// counter, the rest are background threads which sleep when there's nothing to do. Jobs spawned from a worker go
+// on that worker's own deque, jobs from any other thread go through a shared queue. Threads outside the system
+// only ever run jobs from that shared queue, so a job spawned by a worker always runs on a worker and can use
+// getThreadIndex() to pick per-thread resources.
+class JobSystem
+{
+public:
+  // Counts jobs which haven't finished yet, a job can only be waited on through the counter it was spawned with
+  class Counter
+  {
+  public:
+    bool isDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+  private:
+    friend class JobSystem;
+    std::atomic<uint32_t> pending{ 0 };
+  };
+
+  static constexpr uint32_t MaxThreads = 64;
+  static const uint32_t ExternalThread = ~0U;
+  static const size_t MaxJobsPerThread = 4096; // Jobs a thread can have queued, any more run immediately
+
+  // threadCount of 0 picks one per hardware thread
+  void init(uint32_t threadCount = 0);
+  void destroy();
+
+  void run(std::function<void()> function, Counter *counter = nullptr);
+
+  // Splits [0, count) into batches of at most batchSize and runs function(first, batchCount) for each as a job
+  void parallelFor(uint32_t count, uint32_t batchSize, std::function<void(uint32_t, uint32_t)> function, Counter *counter);
+
+  // Runs other jobs until the counter reaches zero
+  void wait(Counter &counter);
+
+  uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+  // Index of the calling worker (0 is the thread which called init()), ExternalThread for anyone else
+  uint32_t getThreadIndex() const;
+
+private:
+  struct Job
+  {
+    std::function<void()> function;
+    Counter *counter = nullptr;
+    std::atomic<bool> busy{ false }; // Queued or running, the slot can't be reused yet
+  };
+
+  struct ExternalJob
+  {
+    std::function<void()> function;
+    Counter *counter = nullptr;
+  };
+
+  struct Worker
+  {
+    WorkStealingDeque<Job, MaxJobsPerThread> deque;
+    std::array<Job, MaxJobsPerThread> jobs; // Slots are handed out round robin
+    size_t nextJob = 0;
+    std::thread thread; // Not started for worker 0
+  };
+
+  void workerLoop(uint32_t workerIndex);
+  bool runOneJob(uint32_t workerIndex);
+  void execute(Job &job);
+  void wakeWorker();
+
+  std::vector<std::unique_ptr<Worker>> workers;
+
+  // Jobs spawned from threads which aren't workers
+  std::mutex externalMutex;
+  std::deque<ExternalJob> externalJobs;
+  std::atomic<uint32_t> externalJobCount{ 0 };
+
+  // Sleeping workers are woken when queuedJobs goes above zero
+  std::mutex sleepMutex;
+  std::condition_variable sleepCondition;
+  std::atomic<int32_t> queuedJobs{ 0 };
+  std::atomic<uint32_t> sleepingWorkers{ 0 };
+  std::atomic<bool> quit{ false };
+};
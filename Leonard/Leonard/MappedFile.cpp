@@ -0,0 +1,101 @@
+#include "MappedFile.hpp"
+#include "UnrecoverableException.hpp"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+void MappedFile::open(std::string const &path)
+{
+  close();
+
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to open " + path), "MappedFile::open");
+  }
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+  {
+    CloseHandle(file);
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to map empty file " + path), "MappedFile::open");
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  void *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+  if (!view)
+  {
+    if (mapping) CloseHandle(mapping);
+    CloseHandle(file);
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to map " + path), "MappedFile::open");
+  }
+
+  fileHandle = file;
+  mappingHandle = mapping;
+  data = view;
+  size = static_cast<size_t>(fileSize.QuadPart);
+}
+
+void MappedFile::close()
+{
+  if (data) UnmapViewOfFile(data);
+  if (mappingHandle) CloseHandle(mappingHandle);
+  if (fileHandle) CloseHandle(fileHandle);
+  data = nullptr;
+  mappingHandle = nullptr;
+  fileHandle = nullptr;
+  size = 0;
+}
+
+#else
+
+void MappedFile::open(std::string const &path)
+{
+  close();
+
+  int file = ::open(path.c_str(), O_RDONLY);
+  if (file < 0)
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to open " + path), "MappedFile::open");
+  }
+
+  struct stat fileStat;
+  if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+  {
+    ::close(file);
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to map empty file " + path), "MappedFile::open");
+  }
+
+  // The mapping keeps the file alive, the descriptor isn't needed past this point
+  void *view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+  ::close(file);
+  if (view == MAP_FAILED)
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to map " + path), "MappedFile::open");
+  }
+
+  // Everything mapped is read front to back exactly once
+  madvise(view, static_cast<size_t>(fileStat.st_size), MADV_SEQUENTIAL);
+
+  data = view;
+  size = static_cast<size_t>(fileStat.st_size);
+}
+
+void MappedFile::close()
+{
+  if (data) munmap(data, size);
+  data = nullptr;
+  size = 0;
+}
+
+#endif
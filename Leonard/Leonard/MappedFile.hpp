@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read only view of a whole file mapped into memory, pages are read in by the OS as they're touched
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  MappedFile(MappedFile const &) = delete;
+  MappedFile &operator=(MappedFile const &) = delete;
+  ~MappedFile() { close(); }
+
+  // Throws UnrecoverableRuntimeException if the file can't be opened or mapped
+  void open(std::string const &path);
+  void close();
+
+  bool isOpen() const { return data != nullptr; }
+  void const *getData() const { return data; }
+  size_t getSize() const { return size; }
+
+private:
+  void *data = nullptr;
+  size_t size = 0;
+#if defined(_WIN32)
+  void *fileHandle = nullptr;
+  void *mappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,236 @@
+// Offline tool turning Wavefront OBJ files into .lmesh files the renderer can map straight into its upload ring.
+//
+//   MeshConverter input.obj output.lmesh [--benchmark] [--no-optimize]
+//
+// Meshes are reordered for the vertex cache and vertex fetch unless --no-optimize is given.
+// --benchmark times loading the OBJ text against loading the converted file.
+#include "MeshFile.hpp"
+#include "MeshOptimizer.hpp"
+#include "Vertex.hpp"
+#include "UnrecoverableException.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+// Full precision while the mesh is loaded and processed, packed into Vertex when it's written
+struct ObjVertex
+{
+  glm::vec2 pos;
+  glm::vec3 color;
+};
+
+// Positions (x and y, the renderer is 2D), optional vertex colours ("v x y z r g b") and faces, polygons are
+// turned into fans. Everything else in the file is skipped.
+static void loadObj(std::string const &path, std::vector<ObjVertex> &vertices, std::vector<uint32_t> &indices)
+{
+  std::ifstream file(path);
+  if (!file.is_open())
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to open " + path), "loadObj");
+  }
+
+  vertices.clear();
+  indices.clear();
+
+  std::string line;
+  std::vector<uint32_t> face;
+  while (std::getline(file, line))
+  {
+    std::istringstream stream(line);
+    std::string type;
+    stream >> type;
+
+    if (type == "v")
+    {
+      float x = 0.f, y = 0.f, z = 0.f;
+      float r = 1.f, g = 1.f, b = 1.f;
+      stream >> x >> y >> z;
+      if (!(stream >> r >> g >> b))
+      {
+        r = g = b = 1.f;
+      }
+      vertices.push_back({{ x, y }, { r, g, b }});
+    }
+    else if (type == "f")
+    {
+      // "f 1 2 3", "f 1/1 2/2 3/3", "f 1//1 ..." and negative (relative) indices
+      face.clear();
+      std::string corner;
+      while (stream >> corner)
+      {
+        long index = std::strtol(corner.c_str(), nullptr, 10);
+        long resolved = index < 0 ? static_cast<long>(vertices.size()) + index : index - 1;
+        if (resolved < 0 || resolved >= static_cast<long>(vertices.size()))
+        {
+          throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Face index out of range in " + path), "loadObj");
+        }
+        face.push_back(static_cast<uint32_t>(resolved));
+      }
+
+      for (size_t i = 2; i < face.size(); i++)
+      {
+        indices.push_back(face[0]);
+        indices.push_back(face[i - 1]);
+        indices.push_back(face[i]);
+      }
+    }
+  }
+}
+
+// Scales and centres the mesh onto the square the renderer's default scene covers, keeping its aspect ratio
+static void fitToUnitSquare(std::vector<ObjVertex> &vertices)
+{
+  if (vertices.empty()) return;
+
+  glm::vec2 low = vertices[0].pos;
+  glm::vec2 high = vertices[0].pos;
+  for (ObjVertex const &vertex : vertices)
+  {
+    low = glm::min(low, vertex.pos);
+    high = glm::max(high, vertex.pos);
+  }
+
+  glm::vec2 centre = (low + high) * 0.5f;
+  float extent = std::max(high.x - low.x, high.y - low.y);
+  float scale = extent > 0.f ? 1.f / extent : 1.f;
+  for (ObjVertex &vertex : vertices)
+  {
+    vertex.pos = (vertex.pos - centre) * scale;
+  }
+}
+
+static void optimizeMesh(std::vector<ObjVertex> &vertices, std::vector<uint32_t> &indices)
+{
+  uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+  VertexCacheStats before = analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+
+  optimizeVertexCache(indices.data(), indices.size(), vertexCount);
+  vertexCount = optimizeVertexFetch(vertices.data(), sizeof(ObjVertex), vertexCount, indices.data(), indices.size());
+  vertices.resize(vertexCount);
+
+  VertexCacheStats after = analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+  std::cout << "Vertex cache: ACMR " << before.acmr << " -> " << after.acmr
+            << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+}
+
+static void writeMesh(std::string const &path, std::vector<ObjVertex> const &objVertices, std::vector<uint32_t> const &indices)
+{
+  std::vector<Vertex> vertices;
+  vertices.reserve(objVertices.size());
+  for (ObjVertex const &vertex : objVertices) vertices.push_back(Vertex::create(vertex.pos, vertex.color));
+
+  // 16 bit indices whenever they fit, they're half the size to upload and read
+  if (vertices.size() <= 65536)
+  {
+    std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+    writeMeshFile( path
+                 , vertices.data(), sizeof(Vertex), static_cast<uint32_t>(vertices.size())
+                 , shortIndices.data(), sizeof(uint16_t), static_cast<uint32_t>(shortIndices.size())
+                 , {});
+  }
+  else
+  {
+    writeMeshFile( path
+                 , vertices.data(), sizeof(Vertex), static_cast<uint32_t>(vertices.size())
+                 , indices.data(), sizeof(uint32_t), static_cast<uint32_t>(indices.size())
+                 , {});
+  }
+}
+
+static double millisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Best of several runs, so both formats are timed with the file already in the page cache
+static void benchmark(std::string const &objPath, std::string const &meshPath)
+{
+  const int Repeats = 10;
+  double bestObj = 0.0;
+  double bestMesh = 0.0;
+  uint64_t checksum = 0;
+  uint64_t meshBytes = 0;
+
+  for (int repeat = 0; repeat < Repeats; repeat++)
+  {
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<ObjVertex> vertices;
+    std::vector<uint32_t> indices;
+    loadObj(objPath, vertices, indices);
+    double objMs = millisecondsSince(start);
+    checksum += vertices.size() + indices.size();
+
+    // Touch every byte the renderer would copy, otherwise the mapping alone costs next to nothing
+    start = std::chrono::high_resolution_clock::now();
+    MeshFile mesh;
+    mesh.open(meshPath);
+    unsigned char const *streams[] = { static_cast<unsigned char const*>(mesh.getVertexData()), static_cast<unsigned char const*>(mesh.getIndexData()) };
+    uint64_t sizes[] = { mesh.getVertexDataSize(), mesh.getIndexDataSize() };
+    for (int stream = 0; stream < 2; stream++)
+    {
+      for (uint64_t i = 0; i < sizes[stream]; i += 64) checksum += streams[stream][i];
+    }
+    meshBytes = sizes[0] + sizes[1];
+    mesh.close();
+    double meshMs = millisecondsSince(start);
+
+    if (repeat == 0 || objMs < bestObj) bestObj = objMs;
+    if (repeat == 0 || meshMs < bestMesh) bestMesh = meshMs;
+  }
+
+  std::ifstream objFile(objPath, std::ios::ate | std::ios::binary);
+  double objMegabytes = static_cast<double>(objFile.tellg()) / (1024.0 * 1024.0);
+  double meshMegabytes = meshBytes / (1024.0 * 1024.0);
+
+  std::cout << "OBJ:   " << bestObj << " ms (" << (bestObj > 0.0 ? objMegabytes * 1000.0 / bestObj : 0.0) << " MB/s)\n"
+            << "lmesh: " << bestMesh << " ms (" << (bestMesh > 0.0 ? meshMegabytes * 1000.0 / bestMesh : 0.0) << " MB/s)\n"
+            << "Speed up: " << (bestMesh > 0.0 ? bestObj / bestMesh : 0.0) << "x"
+            << " (checksum " << checksum << ")" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 3)
+  {
+    std::cerr << "Usage: MeshConverter input.obj output.lmesh [--benchmark] [--no-optimize]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  bool runBenchmark = false;
+  bool optimize = true;
+  for (int i = 3; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--benchmark") == 0) runBenchmark = true;
+    else if (strcmp(argv[i], "--no-optimize") == 0) optimize = false;
+  }
+
+  try
+  {
+    std::vector<ObjVertex> vertices;
+    std::vector<uint32_t> indices;
+    loadObj(argv[1], vertices, indices);
+    fitToUnitSquare(vertices);
+    if (optimize) optimizeMesh(vertices, indices);
+    writeMesh(argv[2], vertices, indices);
+    std::cout << "Wrote " << vertices.size() << " vertices and " << indices.size() << " indices to " << argv[2] << std::endl;
+
+    if (runBenchmark)
+    {
+      benchmark(argv[1], argv[2]);
+    }
+  }
+  catch (UnrecoverableRuntimeException const &e)
+  {
+    std::cerr << e.what() << ": " << e.message() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+#include "MeshFile.hpp"
+#include "UnrecoverableException.hpp"
+
+#include <fstream>
+#include <algorithm>
+
+static uint64_t alignStream(uint64_t offset)
+{
+  return (offset + MeshFile::StreamAlignment - 1) & ~(MeshFile::StreamAlignment - 1);
+}
+
+// Written so that a corrupt offset or size can't wrap around
+static bool fitsInFile(uint64_t offset, uint64_t size, uint64_t fileSize)
+{
+  return offset <= fileSize && size <= fileSize - offset;
+}
+
+// Every index has to name a vertex in the file, or the optimiser, the bounds and the GPU would read past them
+template <typename Index>
+static bool indicesInRange(void const *data, uint32_t indexCount, uint32_t vertexCount)
+{
+  Index const *indices = static_cast<Index const*>(data);
+  Index maxIndex = 0;
+  for (uint32_t i = 0; i < indexCount; i++) maxIndex = std::max(maxIndex, indices[i]);
+  return maxIndex < vertexCount;
+}
+
+void MeshFile::open(std::string const &path)
+{
+  file.open(path);
+
+  // Every range is checked against the file size up front, after this the accessors trust the header
+  uint64_t fileSize = file.getSize();
+  header = static_cast<MeshFileHeader const*>(file.getData());
+  bool valid = fileSize >= sizeof(MeshFileHeader)
+            && header->magic == Magic
+            && header->version == Version
+            && (header->indexSize == 2 || header->indexSize == 4)
+            && header->vertexStride > 0
+            && header->vertexCount > 0
+            && header->indexCount > 0
+            && header->lodCount > 0
+            && header->vertexOffset % StreamAlignment == 0
+            && header->indexOffset % StreamAlignment == 0
+            && header->lodOffset % StreamAlignment == 0
+            && fitsInFile(header->vertexOffset, getVertexDataSize(), fileSize)
+            && fitsInFile(header->indexOffset, getIndexDataSize(), fileSize)
+            && fitsInFile(header->lodOffset, static_cast<uint64_t>(header->lodCount) * sizeof(MeshLod), fileSize);
+
+  for (uint32_t i = 0; valid && i < header->lodCount; i++)
+  {
+    MeshLod const &lod = getLods()[i];
+    valid = static_cast<uint64_t>(lod.firstIndex) + lod.indexCount <= header->indexCount;
+  }
+
+  if (valid)
+  {
+    valid = header->indexSize == 2 ? indicesInRange<uint16_t>(getIndexData(), header->indexCount, header->vertexCount)
+                                   : indicesInRange<uint32_t>(getIndexData(), header->indexCount, header->vertexCount);
+  }
+
+  if (!valid)
+  {
+    close();
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Not a valid mesh file: " + path), "MeshFile::open");
+  }
+}
+
+void MeshFile::close()
+{
+  file.close();
+  header = nullptr;
+}
+
+void writeMeshFile( std::string const &path
+                  , void const *vertices, uint32_t vertexStride, uint32_t vertexCount
+                  , void const *indices, uint32_t indexSize, uint32_t indexCount
+                  , std::vector<MeshLod> const &lods)
+{
+  std::vector<MeshLod> lodTable = lods;
+  if (lodTable.empty()) lodTable.push_back({ 0, indexCount, 0.f, 0 });
+
+  MeshFileHeader header = {};
+  header.magic = MeshFile::Magic;
+  header.version = MeshFile::Version;
+  header.vertexStride = vertexStride;
+  header.indexSize = indexSize;
+  header.vertexCount = vertexCount;
+  header.indexCount = indexCount;
+  header.lodCount = static_cast<uint32_t>(lodTable.size());
+  header.vertexOffset = alignStream(sizeof(MeshFileHeader));
+  header.indexOffset = alignStream(header.vertexOffset + static_cast<uint64_t>(vertexStride) * vertexCount);
+  header.lodOffset = alignStream(header.indexOffset + static_cast<uint64_t>(indexSize) * indexCount);
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to open " + path), "writeMeshFile");
+  }
+
+  // Padding up to each stream's offset is zeroed
+  auto writeAt = [&file](uint64_t offset, void const *data, uint64_t size)
+  {
+    static const char zeros[MeshFile::StreamAlignment] = {};
+    uint64_t position = static_cast<uint64_t>(file.tellp());
+    file.write(zeros, static_cast<std::streamsize>(offset - position));
+    file.write(static_cast<char const*>(data), static_cast<std::streamsize>(size));
+  };
+
+  writeAt(0, &header, sizeof(header));
+  writeAt(header.vertexOffset, vertices, static_cast<uint64_t>(vertexStride) * vertexCount);
+  writeAt(header.indexOffset, indices, static_cast<uint64_t>(indexSize) * indexCount);
+  writeAt(header.lodOffset, lodTable.data(), lodTable.size() * sizeof(MeshLod));
+
+  if (!file.good())
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to write " + path), "writeMeshFile");
+  }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "MappedFile.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On disk layout of a .lmesh file, little endian. The header is followed by the vertex stream, the index stream
+// and the LOD table, each starting on a StreamAlignment boundary, so the streams can be copied straight out of
+// the mapped file.
+struct MeshFileHeader
+{
+  uint32_t magic;        // MeshFile::Magic
+  uint32_t version;      // MeshFile::Version
+  uint32_t vertexStride; // Bytes per vertex, has to match the renderer's Vertex
+  uint32_t indexSize;    // 2 or 4 bytes
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint32_t lodCount;
+  uint32_t reserved;
+  uint64_t vertexOffset; // Bytes from the start of the file
+  uint64_t indexOffset;
+  uint64_t lodOffset;
+};
+static_assert(sizeof(MeshFileHeader) == 56, "MeshFileHeader is written to disk as is");
+
+// A range of the index stream, LOD 0 being the most detailed
+struct MeshLod
+{
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  float maxError; // Worst deviation from LOD 0 in model units
+  uint32_t reserved;
+};
+static_assert(sizeof(MeshLod) == 16, "MeshLod is written to disk as is");
+
+// Memory mapped .lmesh file, see MeshFileHeader. Nothing is copied on open(), it only validates the header and
+// reads through the index stream once to check every index is below vertexCount.
+class MeshFile
+{
+public:
+  static const uint32_t Magic = 0x48534D4C; // "LMSH"
+  static const uint32_t Version = 2; // 2 packed Vertex down to 8 bytes
+  static const uint64_t StreamAlignment = 16;
+
+  // Throws UnrecoverableRuntimeException if the file is missing, truncated, not a mesh file or has out of range indices
+  void open(std::string const &path);
+  void close();
+  bool isOpen() const { return file.isOpen(); }
+
+  MeshFileHeader const &getHeader() const { return *header; }
+  void const *getVertexData() const { return bytes() + header->vertexOffset; }
+  uint64_t getVertexDataSize() const { return static_cast<uint64_t>(header->vertexStride) * header->vertexCount; }
+  void const *getIndexData() const { return bytes() + header->indexOffset; }
+  uint64_t getIndexDataSize() const { return static_cast<uint64_t>(header->indexSize) * header->indexCount; }
+  MeshLod const *getLods() const { return reinterpret_cast<MeshLod const*>(bytes() + header->lodOffset); }
+  uint32_t getLodCount() const { return header->lodCount; }
+
+private:
+  char const *bytes() const { return static_cast<char const*>(file.getData()); }
+
+  MappedFile file;
+  MeshFileHeader const *header = nullptr;
+};
+
+// Writes a .lmesh file. Without any LODs a single one covering every index is written.
+void writeMeshFile( std::string const &path
+                  , void const *vertices, uint32_t vertexStride, uint32_t vertexCount
+                  , void const *indices, uint32_t indexSize, uint32_t indexCount
+                  , std::vector<MeshLod> const &lods);
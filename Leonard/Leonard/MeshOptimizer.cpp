@@ -0,0 +1,154 @@
+#include "MeshOptimizer.hpp"
+
+#include <vector>
+#include <cstring>
+
+// A vertex is in the cache while fewer than cacheSize misses have happened since its own, which is how a FIFO
+// behaves. Both functions below count time in misses like this.
+static bool inCache(uint32_t time, uint32_t stamp, uint32_t cacheSize)
+{
+  return time - stamp <= cacheSize;
+}
+
+VertexCacheStats analyzeVertexCache(uint32_t const *indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize)
+{
+  VertexCacheStats stats;
+  std::vector<uint32_t> stamps(vertexCount, 0);
+  std::vector<char> used(vertexCount, 0);
+  uint32_t time = cacheSize + 1;
+  uint32_t usedCount = 0;
+
+  for (size_t i = 0; i < indexCount; i++)
+  {
+    uint32_t vertex = indices[i];
+    if (!inCache(time, stamps[vertex], cacheSize))
+    {
+      stamps[vertex] = time++;
+      stats.verticesTransformed++;
+    }
+    if (!used[vertex])
+    {
+      used[vertex] = 1;
+      usedCount++;
+    }
+  }
+
+  size_t triangleCount = indexCount / 3;
+  stats.acmr = triangleCount > 0 ? static_cast<float>(stats.verticesTransformed) / triangleCount : 0.f;
+  stats.atvr = usedCount > 0 ? static_cast<float>(stats.verticesTransformed) / usedCount : 0.f;
+  return stats;
+}
+
+void optimizeVertexCache(uint32_t *indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize)
+{
+  const uint32_t NoVertex = ~0U;
+  size_t triangleCount = indexCount / 3;
+  if (triangleCount == 0) return;
+
+  // Triangles using each vertex, as one flat list with offsets
+  std::vector<uint32_t> liveTriangles(vertexCount, 0);
+  for (size_t i = 0; i < triangleCount * 3; i++) liveTriangles[indices[i]]++;
+
+  std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+  for (uint32_t vertex = 0; vertex < vertexCount; vertex++)
+  {
+    adjacencyOffsets[vertex + 1] = adjacencyOffsets[vertex] + liveTriangles[vertex];
+  }
+
+  std::vector<uint32_t> adjacency(triangleCount * 3);
+  std::vector<uint32_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+  for (size_t i = 0; i < triangleCount * 3; i++)
+  {
+    adjacency[adjacencyFill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+
+  std::vector<uint32_t> stamps(vertexCount, 0);
+  std::vector<char> emitted(triangleCount, 0);
+  std::vector<uint32_t> deadEnd;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> output;
+  deadEnd.reserve(triangleCount * 3);
+  output.reserve(triangleCount * 3);
+
+  uint32_t time = cacheSize + 1;
+  uint32_t cursor = 0;
+  uint32_t fanning = indices[0];
+
+  while (fanning != NoVertex)
+  {
+    // Emit every triangle left around the fanning vertex
+    candidates.clear();
+    for (uint32_t a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a++)
+    {
+      uint32_t triangle = adjacency[a];
+      if (emitted[triangle]) continue;
+
+      for (uint32_t corner = 0; corner < 3; corner++)
+      {
+        uint32_t vertex = indices[triangle * 3 + corner];
+        output.push_back(vertex);
+        deadEnd.push_back(vertex);
+        candidates.push_back(vertex);
+        liveTriangles[vertex]--;
+        if (!inCache(time, stamps[vertex], cacheSize)) stamps[vertex] = time++;
+      }
+      emitted[triangle] = 1;
+    }
+
+    // Next fan around the candidate which stays in the cache through its own fan and has been there longest,
+    // any candidate with triangles left beats nothing
+    fanning = NoVertex;
+    int64_t bestPriority = -1;
+    for (uint32_t vertex : candidates)
+    {
+      if (liveTriangles[vertex] == 0) continue;
+
+      int64_t age = static_cast<int64_t>(time) - stamps[vertex];
+      int64_t priority = age + 2 * static_cast<int64_t>(liveTriangles[vertex]) <= cacheSize ? age : 0;
+      if (priority > bestPriority)
+      {
+        bestPriority = priority;
+        fanning = vertex;
+      }
+    }
+
+    // Dead end, go back through recently used vertices, then on to the next vertex in index order
+    while (fanning == NoVertex && !deadEnd.empty())
+    {
+      uint32_t vertex = deadEnd.back();
+      deadEnd.pop_back();
+      if (liveTriangles[vertex] > 0) fanning = vertex;
+    }
+    while (fanning == NoVertex && cursor < vertexCount)
+    {
+      if (liveTriangles[cursor] > 0) fanning = cursor;
+      cursor++;
+    }
+  }
+
+  memcpy(indices, output.data(), output.size() * sizeof(uint32_t));
+}
+
+uint32_t optimizeVertexFetch(void *vertices, uint32_t vertexStride, uint32_t vertexCount, uint32_t *indices, size_t indexCount)
+{
+  const uint32_t Unused = ~0U;
+  std::vector<uint32_t> remap(vertexCount, Unused);
+  uint32_t nextVertex = 0;
+
+  for (size_t i = 0; i < indexCount; i++)
+  {
+    uint32_t &newIndex = remap[indices[i]];
+    if (newIndex == Unused) newIndex = nextVertex++;
+    indices[i] = newIndex;
+  }
+
+  char *bytes = static_cast<char*>(vertices);
+  std::vector<char> original(bytes, bytes + static_cast<size_t>(vertexStride) * vertexCount);
+  for (uint32_t vertex = 0; vertex < vertexCount; vertex++)
+  {
+    if (remap[vertex] == Unused) continue;
+    memcpy(bytes + static_cast<size_t>(remap[vertex]) * vertexStride, original.data() + static_cast<size_t>(vertex) * vertexStride, vertexStride);
+  }
+
+  return nextVertex;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// How well an index order uses the post-transform vertex cache, from a FIFO cache simulation
+struct VertexCacheStats
+{
+  uint32_t verticesTransformed = 0; // Cache misses, each one a vertex shader invocation
+  float acmr = 0.f; // Average cache miss ratio, transformed vertices per triangle. 0.5 is ideal, 3 is no reuse at all
+  float atvr = 0.f; // Average transform to vertex ratio, transformed vertices per vertex used. 1 is ideal
+};
+
+// Most GPUs behave at least as well as a 16 entry FIFO
+static const uint32_t VertexCacheSize = 16;
+
+VertexCacheStats analyzeVertexCache(uint32_t const *indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize = VertexCacheSize);
+
+// Reorders triangles in place for the post-transform cache, using Tipsify (Sander et al. 2007): fan around a
+// vertex, then move on to whichever vertex just used is still in the cache and has the most triangles left,
+// falling back to recently used vertices at a dead end. Linear in the number of indices.
+void optimizeVertexCache(uint32_t *indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize = VertexCacheSize);
+
+// Reorders vertices into the order the indices first use them, so vertex fetches walk memory forwards, and
+// rewrites the indices to match. Unused vertices are dropped, the new vertex count is returned.
+uint32_t optimizeVertexFetch(void *vertices, uint32_t vertexStride, uint32_t vertexCount, uint32_t *indices, size_t indexCount);
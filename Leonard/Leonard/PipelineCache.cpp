@@ -0,0 +1,162 @@
+#include "PipelineCache.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+
+void PipelineCache::init(vk::PhysicalDevice physicalDevice, vk::Device _device, std::string const &_path)
+{
+  device = _device;
+  path = _path;
+  deviceProperties = physicalDevice.getProperties();
+
+  std::vector<char> initialData = loadAndValidate(deviceProperties);
+  warm = !initialData.empty();
+
+  vk::PipelineCacheCreateInfo createInfo;
+  createInfo.setInitialDataSize(initialData.size())
+            .setPInitialData(initialData.empty() ? nullptr : initialData.data());
+
+  cache = device.createPipelineCache(createInfo);
+}
+
+void PipelineCache::save()
+{
+  if (!cache) return;
+
+  std::vector<uint8_t> data = device.getPipelineCacheData(cache);
+  if (data.empty()) return;
+
+  FileHeader header = {};
+  header.magic = FileMagic;
+  header.vendorID = deviceProperties.vendorID;
+  header.deviceID = deviceProperties.deviceID;
+  header.driverVersion = deviceProperties.driverVersion;
+  memcpy(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+  header.dataSize = data.size();
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+  {
+    std::cerr << "Failed to write pipeline cache to " << path << std::endl;
+    return;
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+void PipelineCache::destroy()
+{
+  if (cache) device.destroyPipelineCache(cache);
+  cache = nullptr;
+}
+
+void PipelineCache::beginPipelineBuild()
+{
+  sizeBeforeBuild = getDataSize();
+  buildStart = std::chrono::high_resolution_clock::now();
+}
+
+void PipelineCache::endPipelineBuild()
+{
+  double milliseconds = std::chrono::duration<double, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - buildStart).count();
+
+  if (getDataSize() > sizeBeforeBuild)
+  {
+    misses++;
+    missMilliseconds += milliseconds;
+  }
+  else
+  {
+    hits++;
+    hitMilliseconds += milliseconds;
+  }
+}
+
+void PipelineCache::printStats(std::ostream &out) const
+{
+  out << "Pipeline cache: " << (warm ? "warm" : "cold") << (coldReason.empty() ? "" : " (" + coldReason + ")")
+      << ", " << hits << " hits (" << (hits ? hitMilliseconds / hits : 0.0) << " ms avg)"
+      << ", " << misses << " misses (" << (misses ? missMilliseconds / misses : 0.0) << " ms avg)" << std::endl;
+}
+
+std::vector<char> PipelineCache::loadAndValidate(vk::PhysicalDeviceProperties const &properties)
+{
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if (!file.is_open())
+  {
+    coldReason = "no cache file";
+    return {};
+  }
+
+  size_t fileSize = static_cast<size_t>(file.tellg());
+  file.seekg(0);
+
+  FileHeader header = {};
+  if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+  {
+    coldReason = "truncated header";
+    return {};
+  }
+
+  if (header.magic != FileMagic || header.dataSize != fileSize - sizeof(header))
+  {
+    coldReason = "not a pipeline cache";
+    return {};
+  }
+
+  if (header.vendorID != properties.vendorID 
+   || header.deviceID != properties.deviceID 
+   || header.driverVersion != properties.driverVersion
+   || memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+  {
+    coldReason = "written by a different device or driver";
+    return {};
+  }
+
+  std::vector<char> data(static_cast<size_t>(header.dataSize));
+  if (!file.read(data.data(), data.size()))
+  {
+    coldReason = "truncated data";
+    return {};
+  }
+
+  // The driver's own header (VkPipelineCacheHeaderVersionOne) should agree with ours
+  struct DriverHeader
+  {
+    uint32_t headerSize;
+    uint32_t headerVersion;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+  } driverHeader = {};
+
+  if (data.size() < sizeof(driverHeader))
+  {
+    coldReason = "truncated driver header";
+    return {};
+  }
+  memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+
+  if (driverHeader.headerVersion != static_cast<uint32_t>(vk::PipelineCacheHeaderVersion::eOne)
+   || driverHeader.vendorID != properties.vendorID
+   || driverHeader.deviceID != properties.deviceID
+   || memcmp(driverHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+  {
+    coldReason = "driver header mismatch";
+    return {};
+  }
+
+  return data;
+}
+
+size_t PipelineCache::getDataSize() const
+{
+  // Thrown the same way vulkan.hpp's own calls fail, so pipeline creation's handlers clean up
+  size_t size = 0;
+  vk::Result result = device.getPipelineCacheData(cache, &size, nullptr);
+  if (result != vk::Result::eSuccess) throw std::system_error(vk::make_error_code(result), "vk::Device::getPipelineCacheData");
+  return size;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <chrono>
+
+// vk::PipelineCache which persists to disk between runs. The file is only trusted if it was written by the
+// same device and driver, anything else is thrown away and the cache starts cold.
+class PipelineCache
+{
+public:
+  void init(vk::PhysicalDevice physicalDevice, vk::Device _device, std::string const &_path);
+  void save();
+  void destroy();
+
+  vk::PipelineCache get() const { return cache; }
+  bool isWarm() const { return warm; }
+
+  // Wrap pipeline creation with these to find out whether the build was served from the cache
+  void beginPipelineBuild();
+  void endPipelineBuild();
+
+  void printStats(std::ostream &out) const;
+
+private:
+  // Written in front of the driver's data
+  struct FileHeader
+  {
+    uint32_t magic;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+  };
+
+  static const uint32_t FileMagic = 0x4650434C; // "LCPF"
+
+  std::vector<char> loadAndValidate(vk::PhysicalDeviceProperties const &properties);
+  size_t getDataSize() const;
+
+  vk::Device device;
+  vk::PipelineCache cache;
+  std::string path;
+  vk::PhysicalDeviceProperties deviceProperties;
+  bool warm = false;
+  std::string coldReason;
+
+  // Build timing, a build which doesn't grow the cache data was a hit
+  std::chrono::high_resolution_clock::time_point buildStart;
+  size_t sizeBeforeBuild = 0;
+  uint32_t hits = 0;
+  uint32_t misses = 0;
+  double hitMilliseconds = 0.0;
+  double missMilliseconds = 0.0;
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <type_traits>
+
+// Every device has at least this much push constant space, anything bigger depends on maxPushConstantsSize
+static const uint32_t GuaranteedPushConstantBytes = 128;
+
+// A push constant block of type T and the stages which read it. The pipeline layout gets its range from
+// getRange() and recording goes through push(), so the size, offset and stages can't drift apart between the
+// two. T has to match the shader's push_constant block member for member.
+template <typename T>
+struct PushConstantBlock
+{
+  static_assert(std::is_trivially_copyable<T>::value, "Push constants are copied in as raw bytes");
+  static_assert(sizeof(T) % 4 == 0, "Push constant sizes must be a multiple of 4");
+  static_assert(sizeof(T) <= GuaranteedPushConstantBytes, "Push constants are only guaranteed 128 bytes");
+
+  vk::ShaderStageFlags stages;
+  uint32_t offset;
+
+  vk::PushConstantRange getRange() const
+  {
+    return vk::PushConstantRange(stages, offset, static_cast<uint32_t>(sizeof(T)));
+  }
+
+  // Offsets past the guaranteed space are fine as long as the device has room for them
+  bool fits(vk::PhysicalDeviceLimits const &limits) const
+  {
+    return offset % 4 == 0 && offset + sizeof(T) <= limits.maxPushConstantsSize;
+  }
+
+  // Recorded straight into the command buffer, no descriptor or buffer write involved
+  void push(vk::CommandBuffer commandBuffer, vk::PipelineLayout layout, T const &value) const
+  {
+    commandBuffer.pushConstants(layout, stages, offset, static_cast<uint32_t>(sizeof(T)), &value);
+  }
+};
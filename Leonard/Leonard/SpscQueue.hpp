@@ -0,0 +1,42 @@
+#pragma once
+#include <atomic>
+#include <array>
+#include <cstddef>
+
+// Fixed capacity lock-free queue for exactly one producer thread and one consumer thread. Neither side ever
+// blocks, push() fails when the queue is full and pop() when it's empty.
+template<typename T, size_t Capacity>
+class SpscQueue
+{
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+  // Producer only
+  bool push(T const &item)
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+
+    items[t & (Capacity - 1)] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only
+  bool pop(T &item)
+  {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) return false;
+
+    item = items[h & (Capacity - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  std::array<T, Capacity> items;
+
+  // Kept on separate cache lines so the two threads don't fight over one
+  alignas(64) std::atomic<size_t> head{ 0 };
+  alignas(64) std::atomic<size_t> tail{ 0 };
+};
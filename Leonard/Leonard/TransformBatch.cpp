@@ -0,0 +1,95 @@
+#include "TransformBatch.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if LEONARD_X86
+// TransformBatchSse2.cpp and TransformBatchAvx2.cpp. The AVX2 functions turn it on for themselves with
+// LEONARD_TARGET_AVX2, no file is built with different flags.
+TransformKernels const &getSse2TransformKernels();
+TransformKernels const &getAvx2TransformKernels();
+#endif
+
+void TransformBatch::resize(uint32_t count)
+{
+  for (std::vector<float> *field : { &positionX, &positionY, &positionZ, &spin, &boundsX, &boundsY, &boundsZ, &boundsRadius
+                                   , &worldX, &worldY, &worldZ, &worldRadius })
+  {
+    field->resize(count, 0.0f);
+  }
+  scaleX.resize(count, 1.0f);
+  scaleY.resize(count, 1.0f);
+  scaleZ.resize(count, 1.0f);
+}
+
+// Plain loops, and the tails the SIMD kernels leave. std::sin/std::cos make the models match glm::rotate's exactly.
+static void updateTransformsScalar(TransformBatch &batch, float time, uint32_t first, uint32_t count, glm::mat4 *models)
+{
+  for (uint32_t i = first; i < first + count; i++)
+  {
+    float angle = time * batch.spin[i];
+    float c = std::cos(angle);
+    float s = std::sin(angle);
+    float sx = batch.scaleX[i], sy = batch.scaleY[i], sz = batch.scaleZ[i];
+
+    glm::mat4 &model = models[i];
+    model[0] = glm::vec4(c * sx, s * sx, 0.0f, 0.0f);
+    model[1] = glm::vec4(-s * sy, c * sy, 0.0f, 0.0f);
+    model[2] = glm::vec4(0.0f, 0.0f, sz, 0.0f);
+    model[3] = glm::vec4(batch.positionX[i], batch.positionY[i], batch.positionZ[i], 1.0f);
+
+    float x = sx * batch.boundsX[i];
+    float y = sy * batch.boundsY[i];
+    batch.worldX[i] = batch.positionX[i] + c * x - s * y;
+    batch.worldY[i] = batch.positionY[i] + s * x + c * y;
+    batch.worldZ[i] = batch.positionZ[i] + sz * batch.boundsZ[i];
+    batch.worldRadius[i] = batch.boundsRadius[i] * std::max({ std::abs(sx), std::abs(sy), std::abs(sz) });
+  }
+}
+
+static void updateModelsScalar(TransformBatch const &batch, float time, uint32_t first, uint32_t count, glm::vec4 *modelRows)
+{
+  for (uint32_t i = first; i < first + count; i++)
+  {
+    float angle = time * batch.spin[i];
+    float c = std::cos(angle);
+    float s = std::sin(angle);
+    float sx = batch.scaleX[i], sy = batch.scaleY[i], sz = batch.scaleZ[i];
+
+    glm::vec4 *rows = modelRows + 3 * i;
+    rows[0] = glm::vec4(c * sx, -s * sy, 0.0f, batch.positionX[i]);
+    rows[1] = glm::vec4(s * sx, c * sy, 0.0f, batch.positionY[i]);
+    rows[2] = glm::vec4(0.0f, 0.0f, sz, batch.positionZ[i]);
+  }
+}
+
+static uint32_t cullSpheresScalar(TransformBatch const &batch, Frustum const &frustum, uint32_t first, uint32_t count, uint32_t *visible)
+{
+  uint32_t visibleCount = 0;
+  for (uint32_t i = first; i < first + count; i++)
+  {
+    bool inside = true;
+    for (glm::vec4 const &plane : frustum.planes)
+    {
+      float distance = plane.x * batch.worldX[i] + plane.y * batch.worldY[i] + plane.z * batch.worldZ[i] + plane.w;
+      inside &= distance >= -batch.worldRadius[i];
+    }
+
+    // Always written, only kept when visible, so there's no branch to mispredict
+    visible[visibleCount] = i;
+    visibleCount += inside ? 1 : 0;
+  }
+  return visibleCount;
+}
+
+TransformKernels const &getTransformKernels(SimdLevel level)
+{
+  static const TransformKernels Scalar = { SimdLevel::Scalar, updateTransformsScalar, cullSpheresScalar, updateModelsScalar };
+
+  SimdLevel supported = std::min(level, detectSimdLevel());
+#if LEONARD_X86
+  if (supported == SimdLevel::Avx2) return getAvx2TransformKernels();
+  if (supported == SimdLevel::Sse2) return getSse2TransformKernels();
+#endif
+  return Scalar;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "CpuFeatures.hpp"
+#include "FrustumCulling.hpp"
+
+// Per-object transforms and bounds as a structure of arrays, so the kernels below can load 4 or 8 objects'
+// worth of one field at a time. An object's model is T * Rz(spin * time) * S, the same as
+// glm::scale(glm::rotate(glm::translate(I, position), spin * time, z), scale).
+struct TransformBatch
+{
+  std::vector<float> positionX, positionY, positionZ;
+  std::vector<float> scaleX, scaleY, scaleZ;
+  std::vector<float> spin; // Radians per second about z
+  std::vector<float> boundsX, boundsY, boundsZ, boundsRadius; // Object space sphere
+  std::vector<float> worldX, worldY, worldZ, worldRadius;     // World space sphere, written by updateTransforms
+
+  uint32_t size() const { return static_cast<uint32_t>(spin.size()); }
+
+  // New objects sit at the origin, unscaled and still, with empty bounds
+  void resize(uint32_t count);
+};
+
+// One implementation of every kernel. Each works on objects [first, first + count) so a job can take a slice.
+struct TransformKernels
+{
+  SimdLevel level;
+
+  // Writes models[i] and the world space bounds of each object at the given time
+  void (*updateTransforms)(TransformBatch &batch, float time, uint32_t first, uint32_t count, glm::mat4 *models);
+
+  // Writes the indices of the objects whose world space bounds touch the frustum to visible, which needs room
+  // for count of them, and returns how many there were
+  uint32_t (*cullSpheres)(TransformBatch const &batch, Frustum const &frustum, uint32_t first, uint32_t count, uint32_t *visible);
+
+  // Only the models, for callers which don't cull on the CPU. Each takes three vec4s in modelRows, its top three
+  // rows as InstanceData has them, so object i starts at modelRows[3 * i].
+  void (*updateModels)(TransformBatch const &batch, float time, uint32_t first, uint32_t count, glm::vec4 *modelRows);
+};
+
+// Kernels for the given level, or the best below it if this build or CPU doesn't have it
+TransformKernels const &getTransformKernels(SimdLevel level = detectSimdLevel());
@@ -0,0 +1,188 @@
+#include "TransformBatch.hpp"
+
+// Every function in here uses AVX2 and FMA, so none of them may run until detectSimdLevel() has said the CPU has them
+#if LEONARD_X86
+#include <immintrin.h>
+
+// sin and cos of 8 angles, the same reduction and polynomials as TransformBatchSse2.cpp's
+LEONARD_TARGET_AVX2 static inline void sinCos(__m256 x, __m256 &sinOut, __m256 &cosOut)
+{
+  const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(static_cast<int>(0x80000000)));
+  __m256 sinSign = _mm256_and_ps(x, signMask);
+  x = _mm256_andnot_ps(signMask, x);
+
+  // Octant, rounded up to even
+  __m256i octant = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(1.27323954473516f)));
+  octant = _mm256_and_si256(_mm256_add_epi32(octant, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+  __m256 y = _mm256_cvtepi32_ps(octant);
+
+  sinSign = _mm256_xor_ps(sinSign, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(octant, _mm256_set1_epi32(4)), 29)));
+  __m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_andnot_si256(_mm256_sub_epi32(octant, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29));
+  __m256 sinPolyMask = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(octant, _mm256_set1_epi32(2)), _mm256_setzero_si256()));
+
+  x = _mm256_fnmadd_ps(y, _mm256_set1_ps(0.78515625f), x);
+  x = _mm256_fnmadd_ps(y, _mm256_set1_ps(2.4187564849853515625e-4f), x);
+  x = _mm256_fnmadd_ps(y, _mm256_set1_ps(3.77489497744594108e-8f), x);
+  __m256 z = _mm256_mul_ps(x, x);
+
+  __m256 cosPoly = _mm256_set1_ps(2.443315711809948e-5f);
+  cosPoly = _mm256_fmadd_ps(cosPoly, z, _mm256_set1_ps(-1.388731625493765e-3f));
+  cosPoly = _mm256_fmadd_ps(cosPoly, z, _mm256_set1_ps(4.166664568298827e-2f));
+  cosPoly = _mm256_mul_ps(_mm256_mul_ps(cosPoly, z), z);
+  cosPoly = _mm256_add_ps(_mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), cosPoly), _mm256_set1_ps(1.0f));
+
+  __m256 sinPoly = _mm256_set1_ps(-1.9515295891e-4f);
+  sinPoly = _mm256_fmadd_ps(sinPoly, z, _mm256_set1_ps(8.3321608736e-3f));
+  sinPoly = _mm256_fmadd_ps(sinPoly, z, _mm256_set1_ps(-1.6666654611e-1f));
+  sinPoly = _mm256_fmadd_ps(_mm256_mul_ps(sinPoly, z), x, x);
+
+  sinOut = _mm256_xor_ps(_mm256_blendv_ps(cosPoly, sinPoly, sinPolyMask), sinSign);
+  cosOut = _mm256_xor_ps(_mm256_blendv_ps(sinPoly, cosPoly, sinPolyMask), cosSign);
+}
+
+// One column each of 8 consecutive models. The two 128 bit halves transpose separately, the low half holds
+// models 0-3 and the high half 4-7.
+LEONARD_TARGET_AVX2 static inline void storeColumn(glm::mat4 *models, int column, __m256 x, __m256 y, __m256 z, __m256 w)
+{
+  __m256 xy0 = _mm256_unpacklo_ps(x, y);
+  __m256 xy1 = _mm256_unpackhi_ps(x, y);
+  __m256 zw0 = _mm256_unpacklo_ps(z, w);
+  __m256 zw1 = _mm256_unpackhi_ps(z, w);
+  __m256 columns[4] =
+  {
+    _mm256_shuffle_ps(xy0, zw0, _MM_SHUFFLE(1, 0, 1, 0)),
+    _mm256_shuffle_ps(xy0, zw0, _MM_SHUFFLE(3, 2, 3, 2)),
+    _mm256_shuffle_ps(xy1, zw1, _MM_SHUFFLE(1, 0, 1, 0)),
+    _mm256_shuffle_ps(xy1, zw1, _MM_SHUFFLE(3, 2, 3, 2))
+  };
+  for (int model = 0; model < 4; model++)
+  {
+    _mm_storeu_ps(&models[model][column][0], _mm256_castps256_ps128(columns[model]));
+    _mm_storeu_ps(&models[model + 4][column][0], _mm256_extractf128_ps(columns[model], 1));
+  }
+}
+
+// The same for one row each of 8 consecutive objects' top three rows
+LEONARD_TARGET_AVX2 static inline void storeRow(glm::vec4 *modelRows, int row, __m256 x, __m256 y, __m256 z, __m256 w)
+{
+  __m256 xy0 = _mm256_unpacklo_ps(x, y);
+  __m256 xy1 = _mm256_unpackhi_ps(x, y);
+  __m256 zw0 = _mm256_unpacklo_ps(z, w);
+  __m256 zw1 = _mm256_unpackhi_ps(z, w);
+  __m256 rows[4] =
+  {
+    _mm256_shuffle_ps(xy0, zw0, _MM_SHUFFLE(1, 0, 1, 0)),
+    _mm256_shuffle_ps(xy0, zw0, _MM_SHUFFLE(3, 2, 3, 2)),
+    _mm256_shuffle_ps(xy1, zw1, _MM_SHUFFLE(1, 0, 1, 0)),
+    _mm256_shuffle_ps(xy1, zw1, _MM_SHUFFLE(3, 2, 3, 2))
+  };
+  for (int object = 0; object < 4; object++)
+  {
+    _mm_storeu_ps(&modelRows[3 * object + row][0], _mm256_castps256_ps128(rows[object]));
+    _mm_storeu_ps(&modelRows[3 * (object + 4) + row][0], _mm256_extractf128_ps(rows[object], 1));
+  }
+}
+
+LEONARD_TARGET_AVX2 static void updateTransformsAvx2(TransformBatch &batch, float time, uint32_t first, uint32_t count, glm::mat4 *models)
+{
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  const __m256 t = _mm256_set1_ps(time);
+
+  uint32_t end = first + count;
+  uint32_t i = first;
+  for (; i + 8 <= end; i += 8)
+  {
+    __m256 s, c;
+    sinCos(_mm256_mul_ps(t, _mm256_loadu_ps(&batch.spin[i])), s, c);
+
+    __m256 sx = _mm256_loadu_ps(&batch.scaleX[i]);
+    __m256 sy = _mm256_loadu_ps(&batch.scaleY[i]);
+    __m256 sz = _mm256_loadu_ps(&batch.scaleZ[i]);
+    __m256 px = _mm256_loadu_ps(&batch.positionX[i]);
+    __m256 py = _mm256_loadu_ps(&batch.positionY[i]);
+    __m256 pz = _mm256_loadu_ps(&batch.positionZ[i]);
+
+    storeColumn(models + i, 0, _mm256_mul_ps(c, sx), _mm256_mul_ps(s, sx), zero, zero);
+    storeColumn(models + i, 1, _mm256_sub_ps(zero, _mm256_mul_ps(s, sy)), _mm256_mul_ps(c, sy), zero, zero);
+    storeColumn(models + i, 2, zero, zero, sz, zero);
+    storeColumn(models + i, 3, px, py, pz, one);
+
+    __m256 x = _mm256_mul_ps(sx, _mm256_loadu_ps(&batch.boundsX[i]));
+    __m256 y = _mm256_mul_ps(sy, _mm256_loadu_ps(&batch.boundsY[i]));
+    _mm256_storeu_ps(&batch.worldX[i], _mm256_fnmadd_ps(s, y, _mm256_fmadd_ps(c, x, px)));
+    _mm256_storeu_ps(&batch.worldY[i], _mm256_fmadd_ps(c, y, _mm256_fmadd_ps(s, x, py)));
+    _mm256_storeu_ps(&batch.worldZ[i], _mm256_fmadd_ps(sz, _mm256_loadu_ps(&batch.boundsZ[i]), pz));
+
+    __m256 maxScale = _mm256_max_ps(_mm256_max_ps(_mm256_and_ps(sx, absMask), _mm256_and_ps(sy, absMask)), _mm256_and_ps(sz, absMask));
+    _mm256_storeu_ps(&batch.worldRadius[i], _mm256_mul_ps(_mm256_loadu_ps(&batch.boundsRadius[i]), maxScale));
+  }
+
+  getTransformKernels(SimdLevel::Scalar).updateTransforms(batch, time, i, end - i, models);
+}
+
+LEONARD_TARGET_AVX2 static void updateModelsAvx2(TransformBatch const &batch, float time, uint32_t first, uint32_t count, glm::vec4 *modelRows)
+{
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 t = _mm256_set1_ps(time);
+
+  uint32_t end = first + count;
+  uint32_t i = first;
+  for (; i + 8 <= end; i += 8)
+  {
+    __m256 s, c;
+    sinCos(_mm256_mul_ps(t, _mm256_loadu_ps(&batch.spin[i])), s, c);
+
+    __m256 sx = _mm256_loadu_ps(&batch.scaleX[i]);
+    __m256 sy = _mm256_loadu_ps(&batch.scaleY[i]);
+    storeRow(modelRows + 3 * i, 0, _mm256_mul_ps(c, sx), _mm256_sub_ps(zero, _mm256_mul_ps(s, sy)), zero, _mm256_loadu_ps(&batch.positionX[i]));
+    storeRow(modelRows + 3 * i, 1, _mm256_mul_ps(s, sx), _mm256_mul_ps(c, sy), zero, _mm256_loadu_ps(&batch.positionY[i]));
+    storeRow(modelRows + 3 * i, 2, zero, zero, _mm256_loadu_ps(&batch.scaleZ[i]), _mm256_loadu_ps(&batch.positionZ[i]));
+  }
+
+  getTransformKernels(SimdLevel::Scalar).updateModels(batch, time, i, end - i, modelRows);
+}
+
+LEONARD_TARGET_AVX2 static uint32_t cullSpheresAvx2(TransformBatch const &batch, Frustum const &frustum, uint32_t first, uint32_t count, uint32_t *visible)
+{
+  __m256 planes[6][4];
+  for (int p = 0; p < 6; p++)
+  {
+    for (int component = 0; component < 4; component++) planes[p][component] = _mm256_set1_ps(frustum.planes[p][component]);
+  }
+
+  uint32_t end = first + count;
+  uint32_t i = first;
+  uint32_t visibleCount = 0;
+  for (; i + 8 <= end; i += 8)
+  {
+    __m256 x = _mm256_loadu_ps(&batch.worldX[i]);
+    __m256 y = _mm256_loadu_ps(&batch.worldY[i]);
+    __m256 z = _mm256_loadu_ps(&batch.worldZ[i]);
+    __m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&batch.worldRadius[i]));
+
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int p = 0; p < 6; p++)
+    {
+      __m256 distance = _mm256_fmadd_ps(planes[p][2], z, _mm256_fmadd_ps(planes[p][1], y, _mm256_fmadd_ps(planes[p][0], x, planes[p][3])));
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+    }
+
+    int mask = _mm256_movemask_ps(inside);
+    for (uint32_t lane = 0; lane < 8; lane++)
+    {
+      visible[visibleCount] = i + lane;
+      visibleCount += (mask >> lane) & 1;
+    }
+  }
+
+  return visibleCount + getTransformKernels(SimdLevel::Scalar).cullSpheres(batch, frustum, i, end - i, visible + visibleCount);
+}
+
+TransformKernels const &getAvx2TransformKernels()
+{
+  static const TransformKernels Kernels = { SimdLevel::Avx2, updateTransformsAvx2, cullSpheresAvx2, updateModelsAvx2 };
+  return Kernels;
+}
+#endif
@@ -0,0 +1,170 @@
+#include "TransformBatch.hpp"
+
+#if LEONARD_X86
+#include <emmintrin.h>
+
+// sin and cos of 4 angles, Cephes' sinf/cosf polynomials after reducing to [-pi/4, pi/4] by octant. Within a
+// couple of ulps of std::sin/std::cos for angles up to a few thousand radians.
+static inline void sinCos(__m128 x, __m128 &sinOut, __m128 &cosOut)
+{
+  const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(0x80000000)));
+  __m128 sinSign = _mm_and_ps(x, signMask);
+  x = _mm_andnot_ps(signMask, x);
+
+  // Octant, rounded up to even
+  __m128i octant = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+  octant = _mm_and_si128(_mm_add_epi32(octant, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+  __m128 y = _mm_cvtepi32_ps(octant);
+
+  sinSign = _mm_xor_ps(sinSign, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(octant, _mm_set1_epi32(4)), 29)));
+  __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(octant, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+  __m128 sinPolyMask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(octant, _mm_set1_epi32(2)), _mm_setzero_si128()));
+
+  // pi/4 in three parts, so x - y * pi/4 keeps its precision
+  x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(0.78515625f)));
+  x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(2.4187564849853515625e-4f)));
+  x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(3.77489497744594108e-8f)));
+  __m128 z = _mm_mul_ps(x, x);
+
+  __m128 cosPoly = _mm_set1_ps(2.443315711809948e-5f);
+  cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(-1.388731625493765e-3f));
+  cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(4.166664568298827e-2f));
+  cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly, z), z);
+  cosPoly = _mm_add_ps(_mm_sub_ps(cosPoly, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+  __m128 sinPoly = _mm_set1_ps(-1.9515295891e-4f);
+  sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(8.3321608736e-3f));
+  sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(-1.6666654611e-1f));
+  sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, z), x), x);
+
+  // Odd octant pairs swap which polynomial is which
+  __m128 sinValue = _mm_or_ps(_mm_and_ps(sinPolyMask, sinPoly), _mm_andnot_ps(sinPolyMask, cosPoly));
+  __m128 cosValue = _mm_or_ps(_mm_and_ps(sinPolyMask, cosPoly), _mm_andnot_ps(sinPolyMask, sinPoly));
+  sinOut = _mm_xor_ps(sinValue, sinSign);
+  cosOut = _mm_xor_ps(cosValue, cosSign);
+}
+
+// One column each of 4 consecutive models, given as that column's x, y, z and w of all 4
+static inline void storeColumn(glm::mat4 *models, int column, __m128 x, __m128 y, __m128 z, __m128 w)
+{
+  _MM_TRANSPOSE4_PS(x, y, z, w);
+  _mm_storeu_ps(&models[0][column][0], x);
+  _mm_storeu_ps(&models[1][column][0], y);
+  _mm_storeu_ps(&models[2][column][0], z);
+  _mm_storeu_ps(&models[3][column][0], w);
+}
+
+// One row each of 4 consecutive objects' top three rows, given as that row's x, y, z and w of all 4
+static inline void storeRow(glm::vec4 *modelRows, int row, __m128 x, __m128 y, __m128 z, __m128 w)
+{
+  _MM_TRANSPOSE4_PS(x, y, z, w);
+  _mm_storeu_ps(&modelRows[row][0], x);
+  _mm_storeu_ps(&modelRows[3 + row][0], y);
+  _mm_storeu_ps(&modelRows[6 + row][0], z);
+  _mm_storeu_ps(&modelRows[9 + row][0], w);
+}
+
+static void updateTransformsSse2(TransformBatch &batch, float time, uint32_t first, uint32_t count, glm::mat4 *models)
+{
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  const __m128 t = _mm_set1_ps(time);
+
+  uint32_t end = first + count;
+  uint32_t i = first;
+  for (; i + 4 <= end; i += 4)
+  {
+    __m128 s, c;
+    sinCos(_mm_mul_ps(t, _mm_loadu_ps(&batch.spin[i])), s, c);
+
+    __m128 sx = _mm_loadu_ps(&batch.scaleX[i]);
+    __m128 sy = _mm_loadu_ps(&batch.scaleY[i]);
+    __m128 sz = _mm_loadu_ps(&batch.scaleZ[i]);
+    __m128 px = _mm_loadu_ps(&batch.positionX[i]);
+    __m128 py = _mm_loadu_ps(&batch.positionY[i]);
+    __m128 pz = _mm_loadu_ps(&batch.positionZ[i]);
+
+    storeColumn(models + i, 0, _mm_mul_ps(c, sx), _mm_mul_ps(s, sx), zero, zero);
+    storeColumn(models + i, 1, _mm_sub_ps(zero, _mm_mul_ps(s, sy)), _mm_mul_ps(c, sy), zero, zero);
+    storeColumn(models + i, 2, zero, zero, sz, zero);
+    storeColumn(models + i, 3, px, py, pz, one);
+
+    __m128 x = _mm_mul_ps(sx, _mm_loadu_ps(&batch.boundsX[i]));
+    __m128 y = _mm_mul_ps(sy, _mm_loadu_ps(&batch.boundsY[i]));
+    _mm_storeu_ps(&batch.worldX[i], _mm_sub_ps(_mm_add_ps(px, _mm_mul_ps(c, x)), _mm_mul_ps(s, y)));
+    _mm_storeu_ps(&batch.worldY[i], _mm_add_ps(_mm_add_ps(py, _mm_mul_ps(s, x)), _mm_mul_ps(c, y)));
+    _mm_storeu_ps(&batch.worldZ[i], _mm_add_ps(pz, _mm_mul_ps(sz, _mm_loadu_ps(&batch.boundsZ[i]))));
+
+    __m128 maxScale = _mm_max_ps(_mm_max_ps(_mm_and_ps(sx, absMask), _mm_and_ps(sy, absMask)), _mm_and_ps(sz, absMask));
+    _mm_storeu_ps(&batch.worldRadius[i], _mm_mul_ps(_mm_loadu_ps(&batch.boundsRadius[i]), maxScale));
+  }
+
+  getTransformKernels(SimdLevel::Scalar).updateTransforms(batch, time, i, end - i, models);
+}
+
+static void updateModelsSse2(TransformBatch const &batch, float time, uint32_t first, uint32_t count, glm::vec4 *modelRows)
+{
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 t = _mm_set1_ps(time);
+
+  uint32_t end = first + count;
+  uint32_t i = first;
+  for (; i + 4 <= end; i += 4)
+  {
+    __m128 s, c;
+    sinCos(_mm_mul_ps(t, _mm_loadu_ps(&batch.spin[i])), s, c);
+
+    __m128 sx = _mm_loadu_ps(&batch.scaleX[i]);
+    __m128 sy = _mm_loadu_ps(&batch.scaleY[i]);
+    storeRow(modelRows + 3 * i, 0, _mm_mul_ps(c, sx), _mm_sub_ps(zero, _mm_mul_ps(s, sy)), zero, _mm_loadu_ps(&batch.positionX[i]));
+    storeRow(modelRows + 3 * i, 1, _mm_mul_ps(s, sx), _mm_mul_ps(c, sy), zero, _mm_loadu_ps(&batch.positionY[i]));
+    storeRow(modelRows + 3 * i, 2, zero, zero, _mm_loadu_ps(&batch.scaleZ[i]), _mm_loadu_ps(&batch.positionZ[i]));
+  }
+
+  getTransformKernels(SimdLevel::Scalar).updateModels(batch, time, i, end - i, modelRows);
+}
+
+static uint32_t cullSpheresSse2(TransformBatch const &batch, Frustum const &frustum, uint32_t first, uint32_t count, uint32_t *visible)
+{
+  __m128 planes[6][4];
+  for (int p = 0; p < 6; p++)
+  {
+    for (int component = 0; component < 4; component++) planes[p][component] = _mm_set1_ps(frustum.planes[p][component]);
+  }
+
+  uint32_t end = first + count;
+  uint32_t i = first;
+  uint32_t visibleCount = 0;
+  for (; i + 4 <= end; i += 4)
+  {
+    __m128 x = _mm_loadu_ps(&batch.worldX[i]);
+    __m128 y = _mm_loadu_ps(&batch.worldY[i]);
+    __m128 z = _mm_loadu_ps(&batch.worldZ[i]);
+    __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&batch.worldRadius[i]));
+
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int p = 0; p < 6; p++)
+    {
+      __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(planes[p][0], x), _mm_mul_ps(planes[p][1], y)), _mm_mul_ps(planes[p][2], z)), planes[p][3]);
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+    }
+
+    // Compacted without branching, every lane is written and only the visible ones move the count on
+    int mask = _mm_movemask_ps(inside);
+    for (uint32_t lane = 0; lane < 4; lane++)
+    {
+      visible[visibleCount] = i + lane;
+      visibleCount += (mask >> lane) & 1;
+    }
+  }
+
+  return visibleCount + getTransformKernels(SimdLevel::Scalar).cullSpheres(batch, frustum, i, end - i, visible + visibleCount);
+}
+
+TransformKernels const &getSse2TransformKernels()
+{
+  static const TransformKernels Kernels = { SimdLevel::Sse2, updateTransformsSse2, cullSpheresSse2, updateModelsSse2 };
+  return Kernels;
+}
+#endif
@@ -1,9 +1,23 @@
 #pragma once
 #include <glm/glm.hpp>
 
-struct UniformBufferObject 
+// Shared by every object, written once per frame
+struct CameraUniforms
 {
-  glm::mat4 model;
-  glm::mat4 view;
-  glm::mat4 proj;
+  glm::mat4 viewProj;
 };
+
+// Per object. Models are affine, so the bottom row is always 0 0 0 1 and only the top three rows are sent,
+// which the shaders read as a mat3x4 and multiply as vec4 * mat3x4.
+struct ObjectUniforms
+{
+  glm::vec4 modelRows[3];
+
+  static ObjectUniforms fromModel(glm::mat4 const &model)
+  {
+    ObjectUniforms object;
+    for (int row = 0; row < 3; row++) object.modelRows[row] = glm::vec4(model[0][row], model[1][row], model[2][row], model[3][row]);
+    return object;
+  }
+};
+static_assert(sizeof(ObjectUniforms) == 48, "ObjectUniforms must match the std430 layout of a mat3x4");
@@ -0,0 +1,67 @@
+#include "UniformRing.hpp"
+#include "UnrecoverableException.hpp"
+
+#include <algorithm>
+#include <limits>
+
+static vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+void UniformRing::init( vk::PhysicalDeviceLimits const &limits, vk::DeviceSize _elementSize, uint32_t _elementCapacity, uint32_t _regionCount
+                      , vk::DescriptorType _descriptorType)
+{
+  elementSize = _elementSize;
+  elementCapacity = std::max(_elementCapacity, 1U);
+  regionCount = std::max(_regionCount, 1U);
+  descriptorType = _descriptorType;
+
+  if (descriptorType == vk::DescriptorType::eStorageBufferDynamic)
+  {
+    vk::DeviceSize alignment = std::max<vk::DeviceSize>(limits.minStorageBufferOffsetAlignment, 1);
+    elementStride = elementSize;
+    regionSize = alignUp(elementStride * elementCapacity, alignment);
+
+    if (regionSize > limits.maxStorageBufferRange)
+    {
+      throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Storage ring region is bigger than maxStorageBufferRange!"), "UniformRing::init");
+    }
+  }
+  else
+  {
+    if (elementSize > limits.maxUniformBufferRange)
+    {
+      throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Uniform ring element is bigger than maxUniformBufferRange!"), "UniformRing::init");
+    }
+
+    vk::DeviceSize alignment = std::max<vk::DeviceSize>(limits.minUniformBufferOffsetAlignment, 1);
+    elementStride = alignUp(elementSize, alignment);
+    regionSize = elementStride * elementCapacity;
+  }
+
+  // Dynamic offsets are only 32 bits
+  if (getSize() > std::numeric_limits<uint32_t>::max())
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Uniform ring doesn't fit in 32 bit dynamic offsets!"), "UniformRing::init");
+  }
+
+  buffer = nullptr;
+  mapping = nullptr;
+}
+
+void UniformRing::setStorage(vk::Buffer _buffer, void *_mapping)
+{
+  buffer = _buffer;
+  mapping = static_cast<char*>(_mapping);
+}
+
+uint32_t UniformRing::getDynamicOffset(uint32_t region, uint32_t element) const
+{
+  return static_cast<uint32_t>(region * regionSize + element * elementStride);
+}
+
+void *UniformRing::getElement(uint32_t region, uint32_t element)
+{
+  return mapping + getDynamicOffset(region, element);
+}
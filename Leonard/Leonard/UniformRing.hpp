@@ -0,0 +1,49 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+#include <cstring>
+
+// Lays out a persistently mapped buffer as one region per frame slot, each holding up to elementCapacity elements.
+// Bound through a single dynamic descriptor of range getDescriptorRange(), either
+//  - eUniformBufferDynamic: elements are spaced by minUniformBufferOffsetAlignment, each draw picks its element
+//    with getDynamicOffset(region, element)
+//  - eStorageBufferDynamic: elements are packed into an array (std430), the descriptor covers a whole region
+//    picked with getDynamicOffset(region) and shaders index into it
+// A slot's region must only be written once the GPU is done with that slot's last frame.
+class UniformRing
+{
+public:
+  void init( vk::PhysicalDeviceLimits const &limits, vk::DeviceSize _elementSize, uint32_t _elementCapacity, uint32_t _regionCount
+           , vk::DescriptorType _descriptorType = vk::DescriptorType::eUniformBufferDynamic);
+
+  // The buffer is owned by the caller, it must be at least getSize() bytes, host visible/coherent and mapped
+  void setStorage(vk::Buffer _buffer, void *_mapping);
+
+  vk::DeviceSize getSize() const { return regionSize * regionCount; }
+  vk::Buffer getBuffer() const { return buffer; }
+  vk::DeviceSize getElementSize() const { return elementSize; }
+  vk::DeviceSize getElementStride() const { return elementStride; }
+  uint32_t getElementCapacity() const { return elementCapacity; }
+  uint32_t getRegionCount() const { return regionCount; }
+  vk::DescriptorType getDescriptorType() const { return descriptorType; }
+  vk::DeviceSize getDescriptorRange() const { return descriptorType == vk::DescriptorType::eStorageBufferDynamic ? regionSize : elementSize; }
+
+  uint32_t getDynamicOffset(uint32_t region, uint32_t element = 0) const;
+  void *getElement(uint32_t region, uint32_t element);
+
+  template<typename T>
+  void write(uint32_t region, uint32_t element, T const &value)
+  {
+    memcpy(getElement(region, element), &value, sizeof(T));
+  }
+
+private:
+  vk::Buffer buffer;
+  char *mapping = nullptr;
+  vk::DeviceSize elementSize = 0;
+  vk::DeviceSize elementStride = 0;
+  vk::DeviceSize regionSize = 0;
+  uint32_t elementCapacity = 0;
+  uint32_t regionCount = 0;
+  vk::DescriptorType descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+};
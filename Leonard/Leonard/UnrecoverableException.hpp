@@ -1,5 +1,6 @@
 #pragma once
 #include <stdexcept>
+#include <system_error>
 #include "ExceptionMessage.hpp"
 
 template<class BaseExceptionType>
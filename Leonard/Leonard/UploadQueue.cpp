@@ -0,0 +1,240 @@
+#include "UploadQueue.hpp"
+#include "UnrecoverableException.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <cstring>
+
+static vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+void UploadQueue::init(vk::Device _device, vk::Queue _queue, uint32_t _queueFamilyIndex, vk::Buffer _ringBuffer, void *_ringMapping, vk::DeviceSize _ringSize)
+{
+  device = _device;
+  queue = _queue;
+  ringBuffer = _ringBuffer;
+  ringMapping = static_cast<char*>(_ringMapping);
+  ringSize = _ringSize;
+
+  vk::CommandPoolCreateInfo poolInfo;
+  poolInfo.setQueueFamilyIndex(_queueFamilyIndex)
+          .setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient);
+  commandPool = device.createCommandPool(poolInfo);
+
+  vk::CommandBufferAllocateInfo allocInfo;
+  allocInfo.setCommandPool(commandPool)
+           .setLevel(vk::CommandBufferLevel::ePrimary)
+           .setCommandBufferCount(MaxBatchesInFlight);
+  auto commandBuffers = device.allocateCommandBuffers(allocInfo);
+
+  for (uint32_t i = 0; i < MaxBatchesInFlight; i++)
+  {
+    batches[i].commandBuffer = commandBuffers[i];
+    batches[i].fence = device.createFence(vk::FenceCreateInfo());
+    freeBatches.push_back(i);
+  }
+}
+
+void UploadQueue::destroy()
+{
+  if (!device) return;
+
+  for (auto &batch : batches)
+  {
+    if (batch.fence) device.destroyFence(batch.fence);
+    batch = Batch();
+  }
+  if (commandPool) device.destroyCommandPool(commandPool);
+  commandPool = nullptr;
+  batchesInFlight.clear();
+  freeBatches.clear();
+  pendingCopies.clear();
+}
+
+UploadQueue::Ticket UploadQueue::upload(vk::Buffer dst, vk::DeviceSize dstOffset, const void *data, vk::DeviceSize size)
+{
+  Ticket ticket = nextTicket;
+  const char *src = static_cast<const char*>(data);
+
+  // Anything bigger than the ring goes through in ring sized chunks
+  while (size > 0)
+  {
+    vk::DeviceSize chunkSize = std::min(size, ringSize);
+    void *staging = beginUpload(dst, dstOffset, chunkSize, &ticket);
+    memcpy(staging, src, static_cast<size_t>(chunkSize));
+
+    src += chunkSize;
+    dstOffset += chunkSize;
+    size -= chunkSize;
+  }
+
+  return ticket;
+}
+
+void *UploadQueue::beginUpload(vk::Buffer dst, vk::DeviceSize dstOffset, vk::DeviceSize size, Ticket *ticket)
+{
+  if (size > ringSize)
+  {
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Upload is bigger than the staging ring!"), "UploadQueue::beginUpload");
+  }
+
+  vk::DeviceSize offset = reserveRing(size);
+
+  PendingCopy copy;
+  copy.dst = dst;
+  copy.region.setSrcOffset(offset)
+             .setDstOffset(dstOffset)
+             .setSize(size);
+  pendingCopies.push_back(copy);
+  bytesUploaded += size;
+
+  // reserveRing() may have flushed to make room, so only now do we know which batch this lands in
+  if (ticket) *ticket = nextTicket;
+
+  return ringMapping + offset;
+}
+
+UploadQueue::Ticket UploadQueue::flush()
+{
+  if (pendingCopies.empty()) return nextTicket - 1;
+
+  retireCompletedBatches();
+  if (freeBatches.empty()) waitForOldestBatch();
+
+  uint32_t batchIndex = freeBatches.back();
+  freeBatches.pop_back();
+  Batch &batch = batches[batchIndex];
+
+  batch.commandBuffer.reset(vk::CommandBufferResetFlags());
+
+  vk::CommandBufferBeginInfo beginInfo;
+  beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+  batch.commandBuffer.begin(beginInfo);
+
+  // Group consecutive copies into the same buffer into a single command
+  std::vector<vk::BufferCopy> regions;
+  for (size_t i = 0; i < pendingCopies.size(); i++)
+  {
+    regions.push_back(pendingCopies[i].region);
+    if (i + 1 == pendingCopies.size() || pendingCopies[i + 1].dst != pendingCopies[i].dst)
+    {
+      batch.commandBuffer.copyBuffer(ringBuffer, pendingCopies[i].dst, regions);
+      regions.clear();
+    }
+  }
+
+  batch.commandBuffer.end();
+
+  vk::SubmitInfo submitInfo;
+  submitInfo.setCommandBufferCount(1)
+            .setPCommandBuffers(&batch.commandBuffer);
+
+  device.resetFences(batch.fence);
+  queue.submit(submitInfo, batch.fence);
+
+  batch.ticket = nextTicket++;
+  batch.ringEnd = ringHead;
+  batchesInFlight.push_back(batchIndex);
+  pendingCopies.clear();
+  batchesSubmitted++;
+
+  return batch.ticket;
+}
+
+bool UploadQueue::isComplete(Ticket ticket)
+{
+  retireCompletedBatches();
+  return ticket <= completedTicket;
+}
+
+void UploadQueue::wait(Ticket ticket)
+{
+  if (ticket >= nextTicket) flush();
+
+  retireCompletedBatches();
+  while (completedTicket < ticket && !batchesInFlight.empty())
+  {
+    waitForOldestBatch();
+  }
+}
+
+vk::DeviceSize UploadQueue::reserveRing(vk::DeviceSize size)
+{
+  vk::DeviceSize offset;
+  retireCompletedBatches();
+  while (!tryReserveRing(size, offset))
+  {
+    // Out of room, push out whatever is queued and wait for the oldest batch to free up its part of the ring
+    ringStalls++;
+    flush();
+    waitForOldestBatch();
+  }
+  return offset;
+}
+
+bool UploadQueue::tryReserveRing(vk::DeviceSize size, vk::DeviceSize &offset)
+{
+  if (ringEmpty)
+  {
+    ringHead = ringTail = 0;
+  }
+
+  vk::DeviceSize start = alignUp(ringHead, RingAlignment);
+
+  if (ringEmpty || ringHead > ringTail)
+  {
+    // Free space is [head, ringSize) and, once wrapped, [0, tail)
+    if (start + size <= ringSize)
+    {
+      offset = start;
+    }
+    else if (!ringEmpty && size <= ringTail)
+    {
+      offset = 0;
+    }
+    else
+    {
+      return false;
+    }
+  }
+  else
+  {
+    // Already wrapped, free space is [head, tail)
+    if (start + size > ringTail) return false;
+    offset = start;
+  }
+
+  ringHead = offset + size;
+  ringEmpty = false;
+  return true;
+}
+
+void UploadQueue::retireCompletedBatches()
+{
+  while (!batchesInFlight.empty())
+  {
+    Batch &batch = batches[batchesInFlight.front()];
+    if (device.getFenceStatus(batch.fence) != vk::Result::eSuccess) break;
+
+    ringTail = batch.ringEnd;
+    completedTicket = batch.ticket;
+    freeBatches.push_back(batchesInFlight.front());
+    batchesInFlight.pop_front();
+  }
+
+  if (batchesInFlight.empty() && pendingCopies.empty())
+  {
+    ringEmpty = true;
+  }
+}
+
+void UploadQueue::waitForOldestBatch()
+{
+  if (batchesInFlight.empty()) return;
+
+  Batch &batch = batches[batchesInFlight.front()];
+  device.waitForFences(batch.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+  retireCompletedBatches();
+}
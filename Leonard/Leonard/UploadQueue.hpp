@@ -0,0 +1,83 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+#include <vector>
+#include <deque>
+#include <array>
+
+// Streams data to device local buffers through a persistently mapped staging ring. Copies are batched into
+// a single command buffer per flush() and submitted to the transfer queue with a fence, so uploads never
+// stall the graphics queue. Each upload hands back a ticket which can be polled or waited on.
+class UploadQueue
+{
+public:
+  using Ticket = uint64_t;
+
+  static const uint32_t MaxBatchesInFlight = 4;
+  static const vk::DeviceSize RingAlignment = 16;
+
+  // The ring buffer is owned by the caller, it must be host visible/coherent, mapped, and have eTransferSrc usage
+  void init(vk::Device _device, vk::Queue _queue, uint32_t _queueFamilyIndex, vk::Buffer _ringBuffer, void *_ringMapping, vk::DeviceSize _ringSize);
+  void destroy();
+
+  // Copies size bytes into the ring now and queues a copy into dst at dstOffset, splitting anything bigger than the ring
+  Ticket upload(vk::Buffer dst, vk::DeviceSize dstOffset, const void *data, vk::DeviceSize size);
+
+  // Reserves ring space for a copy into dst and returns where to write the data, for callers which can produce
+  // their data straight into the ring. size must not exceed getRingSize().
+  void *beginUpload(vk::Buffer dst, vk::DeviceSize dstOffset, vk::DeviceSize size, Ticket *ticket = nullptr);
+
+  // Submits everything queued so far, returns the ticket covering it
+  Ticket flush();
+
+  bool isComplete(Ticket ticket);
+  void wait(Ticket ticket);
+
+  vk::DeviceSize getRingSize() const { return ringSize; }
+  uint64_t getBytesUploaded() const { return bytesUploaded; }
+  uint32_t getBatchesSubmitted() const { return batchesSubmitted; }
+  uint32_t getRingStalls() const { return ringStalls; }
+
+private:
+  struct PendingCopy
+  {
+    vk::Buffer dst;
+    vk::BufferCopy region;
+  };
+
+  struct Batch
+  {
+    vk::CommandBuffer commandBuffer;
+    vk::Fence fence;
+    Ticket ticket = 0;
+    vk::DeviceSize ringEnd = 0; // Ring head at submission, everything before it (back to the previous batch) is freed once the fence signals
+  };
+
+  vk::DeviceSize reserveRing(vk::DeviceSize size);
+  bool tryReserveRing(vk::DeviceSize size, vk::DeviceSize &offset);
+  void retireCompletedBatches();
+  void waitForOldestBatch();
+
+  vk::Device device;
+  vk::Queue queue;
+  vk::CommandPool commandPool;
+
+  vk::Buffer ringBuffer;
+  char *ringMapping = nullptr;
+  vk::DeviceSize ringSize = 0;
+  vk::DeviceSize ringHead = 0;
+  vk::DeviceSize ringTail = 0;
+  bool ringEmpty = true;
+
+  std::vector<PendingCopy> pendingCopies;
+  std::array<Batch, MaxBatchesInFlight> batches;
+  std::deque<uint32_t> batchesInFlight; // Oldest first
+  std::vector<uint32_t> freeBatches;
+
+  Ticket nextTicket = 1;      // Ticket the pending copies will be submitted under
+  Ticket completedTicket = 0; // Everything up to and including this has landed
+
+  uint64_t bytesUploaded = 0;
+  uint32_t batchesSubmitted = 0;
+  uint32_t ringStalls = 0;
+};
@@ -0,0 +1,92 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+// Bytes taken by one attribute of the given format, 0 for formats vertex layouts don't know about
+constexpr uint32_t getVertexFormatSize(vk::Format format)
+{
+  switch (format)
+  {
+  case vk::Format::eR32G32B32A32Sfloat: return 16;
+  case vk::Format::eR32G32B32Sfloat:    return 12;
+  case vk::Format::eR32G32Sfloat:       return 8;
+  case vk::Format::eR16G16B16A16Sfloat: return 8;
+  case vk::Format::eR16G16B16A16Snorm:  return 8;
+  case vk::Format::eR32Sfloat:          return 4;
+  case vk::Format::eR16G16Sfloat:       return 4;
+  case vk::Format::eR16G16Snorm:        return 4;
+  case vk::Format::eR16G16Unorm:        return 4;
+  case vk::Format::eR8G8B8A8Unorm:      return 4;
+  case vk::Format::eR8G8B8A8Snorm:      return 4;
+  case vk::Format::eA2B10G10R10UnormPack32: return 4;
+  default: return 0;
+  }
+}
+
+struct VertexAttribute
+{
+  uint32_t location;
+  vk::Format format;
+  uint32_t offset;
+};
+
+// A vertex buffer binding described once at compile time, see makeVertexLayout(). The Vulkan structs are
+// filled in from it when the pipeline is created.
+template <size_t AttributeCount>
+struct VertexLayout
+{
+  uint32_t stride;
+  vk::VertexInputRate inputRate;
+  std::array<VertexAttribute, AttributeCount> attributes;
+
+  // Every attribute has a known format and fits inside the stride, and no two overlap or share a location
+  constexpr bool isValid() const
+  {
+    for (size_t i = 0; i < AttributeCount; i++)
+    {
+      uint32_t size = getVertexFormatSize(attributes[i].format);
+      if (size == 0 || attributes[i].offset + size > stride) return false;
+
+      for (size_t j = 0; j < i; j++)
+      {
+        uint32_t otherSize = getVertexFormatSize(attributes[j].format);
+        bool overlaps = attributes[i].offset < attributes[j].offset + otherSize && attributes[j].offset < attributes[i].offset + size;
+        if (overlaps || attributes[i].location == attributes[j].location) return false;
+      }
+    }
+    return true;
+  }
+
+  // Bytes of the stride actually read, anything else is padding
+  constexpr uint32_t getAttributeBytes() const
+  {
+    uint32_t bytes = 0;
+    for (size_t i = 0; i < AttributeCount; i++) bytes += getVertexFormatSize(attributes[i].format);
+    return bytes;
+  }
+
+  vk::VertexInputBindingDescription getBindingDescription(uint32_t binding) const
+  {
+    return vk::VertexInputBindingDescription(binding, stride, inputRate);
+  }
+
+  std::array<vk::VertexInputAttributeDescription, AttributeCount> getAttributeDescriptions(uint32_t binding) const
+  {
+    std::array<vk::VertexInputAttributeDescription, AttributeCount> descriptions;
+    for (size_t i = 0; i < AttributeCount; i++)
+    {
+      descriptions[i] = vk::VertexInputAttributeDescription(attributes[i].location, binding, attributes[i].format, attributes[i].offset);
+    }
+    return descriptions;
+  }
+};
+
+// The stride comes from the vertex type, the attribute count from the argument list
+template <typename VertexType, typename... Attributes>
+constexpr VertexLayout<sizeof...(Attributes)> makeVertexLayout(vk::VertexInputRate inputRate, Attributes const &... attributes)
+{
+  return { static_cast<uint32_t>(sizeof(VertexType)), inputRate, {{ attributes... }} };
+}
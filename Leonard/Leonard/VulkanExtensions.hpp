@@ -31,3 +31,24 @@ void LoadDebugCallbackFuncs(VkInstance instance)
     throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to load vkDestroyDebugReportCallbackEXT"), "vkGetInstanceProcAddr");
 }
 
+
+static PFN_vkCmdDrawIndexedIndirectCountAMD pfn_vkCmdDrawIndexedIndirectCountAMD;
+void vkCmdDrawIndexedIndirectCountAMD(
+  VkCommandBuffer commandBuffer,
+  VkBuffer        buffer,
+  VkDeviceSize    offset,
+  VkBuffer        countBuffer,
+  VkDeviceSize    countBufferOffset,
+  uint32_t        maxDrawCount,
+  uint32_t        stride)
+{
+  pfn_vkCmdDrawIndexedIndirectCountAMD(commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride);
+}
+
+// Only call with VK_AMD_draw_indirect_count enabled on the device
+void LoadDrawIndirectCountFuncs(VkDevice device)
+{
+  pfn_vkCmdDrawIndexedIndirectCountAMD = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountAMD>(vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountAMD"));
+  if (pfn_vkCmdDrawIndexedIndirectCountAMD == nullptr)
+    throw UnrecoverableRuntimeException(CreateBasicExceptionMessage("Failed to load vkCmdDrawIndexedIndirectCountAMD"), "vkGetDeviceProcAddr");
+}
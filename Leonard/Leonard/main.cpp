@@ -1,15 +1,177 @@
 #include "HelloTriangleApplication.hpp"
+#include "Benchmark.hpp"
 
 #include <iostream>
 #include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <sstream>
 
-int main()
+// "1,64,1024" -> { 1, 64, 1024 }
+static std::vector<uint32_t> parseList(const char *arg)
 {
-  HelloTriangleApplication app;
+  std::vector<uint32_t> values;
+  std::stringstream stream(arg);
+  std::string value;
+  while (std::getline(stream, value, ','))
+  {
+    if (!value.empty()) values.push_back(static_cast<uint32_t>(std::stoul(value)));
+  }
+  return values;
+}
+
+static ApplicationSettings parseArguments(int argc, char *argv[], BenchmarkSettings &benchmarkSettings)
+{
+  ApplicationSettings settings;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+    {
+      settings.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+    }
+    else if (strcmp(argv[i], "--headless") == 0)
+    {
+      settings.headless = true;
+    }
+    else if (strcmp(argv[i], "--pipeline-cache") == 0 && i + 1 < argc)
+    {
+      settings.pipelineCachePath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+    {
+      settings.traceOutputPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+    {
+      settings.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+    }
+    else if (strcmp(argv[i], "--readback") == 0 && i + 1 < argc)
+    {
+      i++;
+      if (strcmp(argv[i], "none") == 0)      settings.readbackMode = ReadbackMode::Disabled;
+      else if (strcmp(argv[i], "hash") == 0) settings.readbackMode = ReadbackMode::Hash;
+      else if (strcmp(argv[i], "ppm") == 0)  settings.readbackMode = ReadbackMode::Ppm;
+      else std::cerr << "Unknown readback mode: " << argv[i] << std::endl;
+    }
+    else if (strcmp(argv[i], "--readback-output") == 0 && i + 1 < argc)
+    {
+      settings.readbackOutputPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--fixed-time-step") == 0 && i + 1 < argc)
+    {
+      settings.fixedTimeStep = std::stof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--quads") == 0 && i + 1 < argc)
+    {
+      settings.quadCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+    }
+    else if (strcmp(argv[i], "--draws") == 0 && i + 1 < argc)
+    {
+      settings.drawCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+    }
+    else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc)
+    {
+      settings.meshPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--mesh-lod") == 0 && i + 1 < argc)
+    {
+      settings.meshLod = static_cast<uint32_t>(std::stoul(argv[++i]));
+    }
+    else if (strcmp(argv[i], "--direct-draws") == 0)
+    {
+      settings.indirectDraws = false;
+    }
+    else if (strcmp(argv[i], "--no-culling") == 0)
+    {
+      settings.gpuCulling = false;
+    }
+    else if (strcmp(argv[i], "--optimize-mesh") == 0)
+    {
+      settings.optimizeMesh = true;
+    }
+    else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+    {
+      settings.instanceCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+    }
+    else if (strcmp(argv[i], "--simd") == 0 && i + 1 < argc)
+    {
+      i++;
+      if (strcmp(argv[i], "scalar") == 0)    settings.maxSimdLevel = SimdLevel::Scalar;
+      else if (strcmp(argv[i], "sse2") == 0) settings.maxSimdLevel = SimdLevel::Sse2;
+      else if (strcmp(argv[i], "avx2") == 0) settings.maxSimdLevel = SimdLevel::Avx2;
+      else std::cerr << "Unknown SIMD level: " << argv[i] << std::endl;
+    }
+    else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+    {
+      settings.jobThreads = static_cast<uint32_t>(std::stoul(argv[++i]));
+    }
+    else if (strcmp(argv[i], "--benchmark") == 0)
+    {
+      benchmarkSettings.enabled = true;
+    }
+    else if (strcmp(argv[i], "--job-benchmark") == 0)
+    {
+      benchmarkSettings.jobSystem = true;
+    }
+    else if (strcmp(argv[i], "--transform-benchmark") == 0)
+    {
+      benchmarkSettings.transformKernels = true;
+    }
+    else if (strcmp(argv[i], "--benchmark-output") == 0 && i + 1 < argc)
+    {
+      benchmarkSettings.outputPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--benchmark-quads") == 0 && i + 1 < argc)
+    {
+      benchmarkSettings.quadCounts = parseList(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--benchmark-draws") == 0 && i + 1 < argc)
+    {
+      benchmarkSettings.drawCounts = parseList(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--benchmark-instances") == 0 && i + 1 < argc)
+    {
+      benchmarkSettings.instanceCounts = parseList(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--benchmark-frames-in-flight") == 0 && i + 1 < argc)
+    {
+      benchmarkSettings.framesInFlight = parseList(argv[++i]);
+    }
+    else
+    {
+      std::cerr << "Unknown argument: " << argv[i] << std::endl;
+    }
+  }
 
+  return settings;
+}
+
+int main(int argc, char *argv[])
+{
   try
   {
-    app.run();
+    BenchmarkSettings benchmarkSettings;
+    ApplicationSettings settings = parseArguments(argc, argv, benchmarkSettings);
+
+    if (benchmarkSettings.jobSystem)
+    {
+      runJobSystemBenchmark(benchmarkSettings);
+    }
+    else if (benchmarkSettings.transformKernels)
+    {
+      runTransformBenchmark(benchmarkSettings);
+    }
+    else if (benchmarkSettings.enabled)
+    {
+      runBenchmarks(settings, benchmarkSettings);
+    }
+    else
+    {
+      HelloTriangleApplication app(settings);
+      app.run();
+    }
   }
   catch (UnrecoverableRuntimeException const &e)
   {
@@ -37,6 +199,12 @@ int main()
     std::cerr << e.what() << std::endl;
     return EXIT_FAILURE;
   }
+  catch (std::logic_error const &e)
+  {
+    // std::stoul and std::stof throw invalid_argument or out_of_range for anything that isn't a number
+    std::cerr << "Invalid number in the arguments (" << e.what() << ")" << std::endl;
+    return EXIT_FAILURE;
+  }
 
   return EXIT_SUCCESS;
 }
@@ -1,4 +1,5 @@
 %VULKAN_SDK%\Bin32\glslc.exe -fshader-stage=vertex -o triangle.vert.spv triangle.vert
 %VULKAN_SDK%\Bin32\glslc.exe -fshader-stage=fragment -o triangle.frag.spv triangle.frag
-robocopy . ../../x64/Debug/shaders/ triangle.vert.spv triangle.frag.spv
+%VULKAN_SDK%\Bin32\glslc.exe -fshader-stage=compute -o cull.comp.spv cull.comp
+robocopy . ../../x64/Debug/shaders/ triangle.vert.spv triangle.frag.spv cull.comp.spv
 pause
\ No newline at end of file
@@ -1,12 +1,44 @@
 // shadertype=glsl
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shader_draw_parameters : enable
 
-layout(binding = 0) uniform UniformBufferObject {
-  mat4 model;
-  mat4 view;
-  mat4 proj;
-} ubo;
+// The model's top three rows, see ObjectUniforms
+struct ObjectData
+{
+  mat3x4 model;
+};
+
+// This frame's objects, picked by the dynamic offset
+layout(std430, binding = 0) readonly buffer Objects {
+  ObjectData objects[];
+};
+
+// Object drawn by each draw command
+layout(std430, binding = 1) readonly buffer DrawObjects {
+  uint drawObjects[];
+};
+
+// Shared by every object, one per frame picked by the dynamic offset
+layout(binding = 2) uniform Camera {
+  mat4 viewProj;
+} camera;
+
+// This frame's instances, picked by the dynamic offset
+layout(std430, binding = 3) readonly buffer Instances {
+  ObjectData instances[];
+};
+
+// Instances the commands draw, each command's firstInstance is where its run of them starts. With culling only
+// the visible ones are listed, see cull.comp.
+layout(std430, binding = 4) readonly buffer InstanceList {
+  uint instanceList[];
+};
+
+// gl_DrawIDARB counts from 0 in every vkCmdDraw*, so draws which don't start at the first command say where they do
+layout(push_constant) uniform DrawConstants {
+  uint firstCommand;
+} drawConstants;
 
 layout(location = 0) in vec2 inPosition;
 layout(location = 1) in vec3 inColor;
@@ -20,6 +52,11 @@ out gl_PerVertex
 
 void main()
 {
-  gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 0.0, 1.0);
+  // Matrix * vector all the way, never matrix * matrix per vertex
+  ObjectData object = objects[drawObjects[drawConstants.firstCommand + gl_DrawIDARB]];
+  ObjectData instance = instances[instanceList[gl_InstanceIndex]];
+  vec3 instancePosition = vec4(inPosition, 0.0, 1.0) * instance.model;
+  vec3 worldPosition = vec4(instancePosition, 1.0) * object.model;
+  gl_Position = camera.viewProj * vec4(worldPosition, 1.0);
   fragColor = inColor;
 }